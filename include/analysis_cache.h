@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "fs.h"
+#include "options.h"
+
+namespace cin
+{
+    /**
+     * Incremental 64 bit hash of a byte stream.
+     *
+     * The result only depends on the bytes, not on how they are split across
+     * update() calls, so it does not change with the block size.
+     */
+    class ContentHash {
+    public:
+        /**
+         * Construct a hash.
+         *
+         * @param seed Mixed into the initial state.
+         */
+        explicit ContentHash(uint64_t seed = 0);
+
+        /**
+         * Hash @p size more bytes.
+         *
+         * @param data Pointer to the data.
+         * @param size Number of bytes.
+         */
+        void update(const void* data, size_t size);
+
+        /**
+         * Return the hash of all bytes passed so far.
+         *
+         * @return Hash value.
+         */
+        uint64_t value() const;
+
+    private:
+        void mix(uint64_t word);
+
+        uint64_t m_state;
+        uint64_t m_pending{0};
+        size_t m_num_pending{0};
+        uint64_t m_length{0};
+    };
+
+    /**
+     * Persistent cache of loudness measurements.
+     *
+     * Measurements are keyed by a hash of the decoded sample data. A second
+     * table maps input files, identified by path, size and modification time,
+     * to that hash, so an unchanged file is never read again to look up its
+     * measurement. Both are kept in an append-only text file.
+     */
+    class AnalysisCache {
+    public:
+        /**
+         * Cached measurement.
+         */
+        struct Entry {
+            /** Integrated loudness in LUFS. */
+            double integrated_lufs;
+            /** True peak in dBTP. */
+            double true_peak_dbtp;
+        };
+
+        /**
+         * Open or create the cache at @p path and load existing entries.
+         *
+         * @param path Location of the cache file.
+         * @param policy Whether appended entries are synced to disk.
+         * @throws OutputFile::CouldNotWrite if the cache cannot be opened.
+         */
+        AnalysisCache(const std::filesystem::path& path, FsyncPolicy policy);
+
+        AnalysisCache(const AnalysisCache&) = delete;
+        AnalysisCache& operator=(const AnalysisCache&) = delete;
+
+        ~AnalysisCache();
+
+        /**
+         * Look up the measurement of @p input. Safe to call from multiple
+         * threads.
+         *
+         * @param input Path of the input file.
+         * @param seed Seed the hash was computed with, identifies settings
+         *   that change the analyzed samples such as the downmix.
+         * @param[out] entry Measurement if found.
+         * @return true if @p input is unchanged and its measurement is known.
+         */
+        bool find(const std::filesystem::path& input, uint64_t seed, Entry& entry) const;
+
+        /**
+         * Store the measurement of @p input. Safe to call from multiple
+         * threads.
+         *
+         * @param input Path of the input file.
+         * @param seed Seed the hash was computed with.
+         * @param hash Hash of the analyzed samples.
+         * @param entry Measurement.
+         * @throws OutputFile::CouldNotWrite in case of I/O errors.
+         */
+        void store(const std::filesystem::path& input, uint64_t seed, uint64_t hash, const Entry& entry);
+
+    private:
+        struct File {
+            FileStamp stamp;
+            uint64_t seed;
+            uint64_t hash;
+        };
+
+        std::filesystem::path m_path;
+        FsyncPolicy m_policy;
+        int m_fd{-1};
+        mutable std::mutex m_mutex;
+        std::unordered_map<std::string, File> m_files;
+        std::unordered_map<uint64_t, Entry> m_measurements;
+    };
+}
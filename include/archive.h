@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "buffer.h"
+#include "fs.h"
+#include "options.h"
+
+namespace cin
+{
+    /**
+     * Read-only view of the WAV members of a tar or zip archive.
+     *
+     * Opening an archive only reads its headers: the member headers of a
+     * tar, which are skipped over without reading the data in between, or
+     * the central directory of a zip. Members are then read on demand with
+     * pread(), so any number of threads can load different members at once.
+     * Tar (ustar, GNU long names and pax paths) and zip (stored or deflated,
+     * including zip64) are supported. Compressed tarballs are not, since
+     * their members cannot be reached without decompressing everything
+     * before them.
+     *
+     * Members are addressed by virtual paths, the archive path joined with
+     * the member name, so they can be mirrored by OutputLayout like files in
+     * a directory.
+     */
+    class Archive {
+    public:
+        /**
+         * Thrown if the archive or one of its members cannot be read.
+         */
+        class CouldNotRead : public std::runtime_error {
+        public:
+            /**
+             * Construct CouldNotRead error.
+             *
+             * @param msg Error message.
+             */
+            CouldNotRead(const std::string& msg) : std::runtime_error{msg} {}
+        };
+
+        /**
+         * Index the WAV members of @p path.
+         *
+         * Members whose names are absolute or contain ".." are skipped, they
+         * would be mirrored outside the output directory.
+         *
+         * @param path Path of a .tar or .zip file.
+         * @throws CouldNotRead if @p path cannot be opened or parsed, or a
+         *   member's sizes do not fit in the file.
+         */
+        explicit Archive(const std::filesystem::path& path);
+
+        Archive(const Archive&) = delete;
+        Archive& operator=(const Archive&) = delete;
+
+        ~Archive();
+
+        /**
+         * Return the virtual paths of the WAV members, in archive order.
+         *
+         * @return One path per member.
+         */
+        Paths paths() const;
+
+        /**
+         * Return the uncompressed size of a member.
+         *
+         * @param member Virtual path returned by paths().
+         * @return Size in bytes, 0 if @p member is not in the archive.
+         */
+        uint64_t size(const std::filesystem::path& member) const;
+
+        /**
+         * Load a member into memory. Safe to call from multiple threads.
+         *
+         * @param member Virtual path returned by paths().
+         * @param[out] contents Uncompressed bytes of the member.
+         * @throws CouldNotRead if the member is unknown, cannot be read or
+         *   fails its checksum.
+         */
+        void read(const std::filesystem::path& member, Buffer<uint8_t>& contents) const;
+
+    private:
+        struct Member {
+            uint64_t offset;
+            uint64_t size;
+            uint64_t compressed_size;
+            bool deflated;
+            bool has_crc;
+            uint32_t crc;
+        };
+
+        void index_tar();
+        void index_zip();
+        void add(const std::string& name, const Member& member);
+        void read_at(uint64_t offset, void* data, size_t size) const;
+
+        std::filesystem::path m_path;
+        int m_fd{-1};
+        uint64_t m_file_size{0};
+        std::vector<std::string> m_names;
+        std::unordered_map<std::string, Member> m_members;
+    };
+
+    /**
+     * Check if @p path names an archive Archive can open.
+     *
+     * @param path Path of a file.
+     * @return true for regular files ending in .tar or .zip.
+     */
+    bool is_archive(const std::filesystem::path& path);
+
+    /**
+     * Write the files below @p directory to a new tar archive at @p path.
+     *
+     * Members are named by their path relative to @p directory and stored in
+     * sorted order. The archive is published atomically like an MP3.
+     *
+     * @param path Path of the archive to create.
+     * @param directory Directory whose files are packed.
+     * @param policy When to sync the archive to stable storage.
+     * @return Number of files packed.
+     * @throws OutputFile::CouldNotWrite in case of I/O errors.
+     */
+    size_t write_tar(const std::filesystem::path& path, const std::filesystem::path& directory, FsyncPolicy policy);
+}
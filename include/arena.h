@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace cin
+{
+    /**
+     * Counters of an Arena.
+     */
+    struct ArenaStats {
+        /** Number of reset() calls, i.e. files processed. */
+        size_t resets{0};
+        /** Number of chunks requested from the heap. */
+        size_t chunk_allocations{0};
+        /** Bytes currently held in chunks. */
+        size_t reserved_bytes{0};
+        /** Largest number of bytes handed out between two resets. */
+        size_t peak_bytes{0};
+        /** Bytes handed out over the lifetime of the arena. */
+        size_t total_bytes{0};
+    };
+
+    /**
+     * Monotonic allocator for state that lives as long as one file.
+     *
+     * Memory is carved from large chunks and only released all at once by
+     * reset(). After a reset the chunks are kept (and merged into one if a
+     * file needed several), so a worker stops calling malloc() once it has
+     * seen its largest file. Not thread safe, each worker owns one arena.
+     */
+    class Arena {
+    public:
+        /**
+         * Construct an empty arena.
+         *
+         * @param chunk_size Minimum size of chunks requested from the heap.
+         */
+        explicit Arena(size_t chunk_size = 256 * 1024);
+
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        /**
+         * Allocate uninitialized memory.
+         *
+         * @param size Number of bytes.
+         * @param alignment Required alignment, a power of two.
+         * @return Pointer valid until the next reset().
+         */
+        void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+        /**
+         * Allocate uninitialized storage for @p count objects of type T.
+         *
+         * @param count Number of objects.
+         * @return Pointer valid until the next reset().
+         */
+        template <typename T>
+        T* allocate(size_t count)
+        {
+            return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+        }
+
+        /**
+         * Copy @p s into the arena as a null-terminated string.
+         *
+         * @param s String to copy.
+         * @return Pointer valid until the next reset().
+         */
+        const char* copy_string(std::string_view s);
+
+        /**
+         * Release everything allocated since the last reset.
+         */
+        void reset();
+
+        /**
+         * Return the counters of this arena.
+         *
+         * @return Statistics.
+         */
+        const ArenaStats& stats() const;
+
+    private:
+        struct Chunk {
+            std::unique_ptr<std::byte[]> data;
+            size_t size;
+        };
+
+        void add_chunk(size_t size);
+
+        size_t m_chunk_size;
+        std::vector<Chunk> m_chunks;
+        size_t m_offset{0};
+        size_t m_used{0};
+        ArenaStats m_stats;
+    };
+}
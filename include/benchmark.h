@@ -0,0 +1,23 @@
+#pragma once
+
+#include "fs.h"
+#include "options.h"
+
+namespace cin
+{
+    /**
+     * Encode @p paths once per block size and log the throughput and Buffer
+     * counters (buffer_stats()) per encoded second of each run.
+     *
+     * Outputs go to a scratch directory below the system temporary directory
+     * which is removed afterwards, so the inputs' own outputs are untouched.
+     * An untimed run comes first, and each run starts from an empty scratch
+     * directory without journal, ledger or analysis cache, so every run does
+     * the same work.
+     *
+     * @param paths WAV files to encode.
+     * @param options Base settings. Block size and outputs are overridden,
+     *   and journal, ledger, bundle, output archive and verification are off.
+     */
+    void benchmark_block_sizes(const Paths& paths, const Options& options);
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include "arena.h"
+
+namespace cin
+{
+    /**
+     * Allocation and growth counters of the calling thread.
+     */
+    struct BufferStats {
+        /** Number of heap allocations made by Buffer. */
+        size_t allocations{0};
+        /** Total bytes allocated by Buffer. */
+        size_t allocated_bytes{0};
+        /**
+         * Bytes added to buffer sizes by resize(), in arena and heap buffers
+         * alike. std::vector clears these, Buffer leaves them to the producer.
+         */
+        size_t resized_bytes{0};
+    };
+
+    /**
+     * Return the allocation counters of the calling thread.
+     *
+     * @return Counters accumulated since the thread started.
+     */
+    BufferStats& buffer_stats();
+
+    /**
+     * Contiguous storage for trivial types that never initializes elements.
+     *
+     * Unlike std::vector, growing the size does not zero-fill the new
+     * elements and shrinking keeps the capacity, so a buffer that is resized
+     * every block touches no memory besides what the producer writes. Storage
+     * comes from the heap or, if given, from an Arena that outlives the buffer.
+     */
+    template <typename T>
+    class Buffer {
+        static_assert(std::is_trivial<T>::value, "Buffer only holds trivial types");
+
+    public:
+        Buffer() = default;
+
+        /**
+         * Construct a buffer with room for @p capacity elements.
+         *
+         * @param capacity Number of elements to allocate.
+         */
+        explicit Buffer(size_t capacity)
+        {
+            reserve(capacity);
+        }
+
+        /**
+         * Construct a buffer with room for @p capacity elements in @p arena.
+         *
+         * @param capacity Number of elements to allocate.
+         * @param arena Arena providing the storage.
+         */
+        Buffer(size_t capacity, Arena& arena)
+        : m_arena{&arena}
+        {
+            reserve(capacity);
+        }
+
+        Buffer(const Buffer&) = delete;
+        Buffer& operator=(const Buffer&) = delete;
+
+        ~Buffer()
+        {
+            release();
+        }
+
+        /**
+         * Make room for at least @p capacity elements, keeping the contents.
+         *
+         * @param capacity Number of elements.
+         */
+        void reserve(size_t capacity)
+        {
+            if (capacity <= m_capacity) {
+                return;
+            }
+
+            T* data{m_arena ? m_arena->allocate<T>(capacity) : new T[capacity]};
+            std::copy(m_data, m_data + m_size, data);
+            release();
+            m_data = data;
+            m_capacity = capacity;
+
+            if (!m_arena) {
+                auto& stats{buffer_stats()};
+                stats.allocations++;
+                stats.allocated_bytes += capacity * sizeof(T);
+            }
+        }
+
+        /**
+         * Set the number of valid elements. New elements are uninitialized,
+         * growing beyond the capacity at least doubles it.
+         *
+         * @param size Number of elements.
+         */
+        void resize(size_t size)
+        {
+            if (size > m_capacity) {
+                reserve(std::max(size, 2 * m_capacity));
+            }
+
+            if (size > m_size) {
+                buffer_stats().resized_bytes += (size - m_size) * sizeof(T);
+            }
+
+            m_size = size;
+        }
+
+        void clear()
+        {
+            m_size = 0;
+        }
+
+        T* data()
+        {
+            return m_data;
+        }
+
+        const T* data() const
+        {
+            return m_data;
+        }
+
+        size_t size() const
+        {
+            return m_size;
+        }
+
+        size_t capacity() const
+        {
+            return m_capacity;
+        }
+
+        bool empty() const
+        {
+            return m_size == 0;
+        }
+
+        T& operator[](size_t index)
+        {
+            return m_data[index];
+        }
+
+        const T& operator[](size_t index) const
+        {
+            return m_data[index];
+        }
+
+        T* begin()
+        {
+            return data();
+        }
+
+        T* end()
+        {
+            return data() + m_size;
+        }
+
+        const T* begin() const
+        {
+            return data();
+        }
+
+        const T* end() const
+        {
+            return data() + m_size;
+        }
+
+    private:
+        void release()
+        {
+            if (!m_arena) {
+                delete[] m_data;
+            }
+        }
+
+        T* m_data{nullptr};
+        Arena* m_arena{nullptr};
+        size_t m_size{0};
+        size_t m_capacity{0};
+    };
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "buffer.h"
+#include "options.h"
+
+namespace cin
+{
+    /**
+     * One encoded stream in a bundle.
+     */
+    struct BundleEntry {
+        /** Position of the stream in the bundle file. */
+        uint64_t offset;
+        /** Size of the stream in bytes. */
+        uint64_t length;
+        /** Duration of the encoded audio in seconds. */
+        double duration;
+    };
+
+    /**
+     * Writes encoded streams into one bundle file instead of one file each.
+     *
+     * A bundle is a 32 byte header, the streams back to back, and an index
+     * at the end. The header holds the magic "CINBNDL1" and the offset, size
+     * and entry count of the index, all little endian 64 bit. Each index
+     * entry is offset, length, duration (IEEE double), a 16 bit name length
+     * and the name, sorted by name.
+     *
+     * A worker that finished a stream reserves its region with one atomic
+     * add and writes it with pwrite(), so workers never wait for each other
+     * while writing. Like OutputFile, the bundle is written under the same
+     * hidden temporary name, which remove_stale_parts() cleans up after a
+     * crash, and only appears under its final name once commit() wrote the
+     * index.
+     */
+    class BundleWriter {
+    public:
+        /**
+         * Thrown if the bundle cannot be created or written.
+         */
+        class CouldNotWrite : public std::runtime_error {
+        public:
+            /**
+             * Construct CouldNotWrite error.
+             *
+             * @param msg Error message.
+             */
+            CouldNotWrite(const std::string& msg) : std::runtime_error{msg} {}
+        };
+
+        /**
+         * Create a temporary file for the bundle at @p path.
+         *
+         * @param path Final destination of the bundle.
+         * @param policy When to sync the bundle to stable storage.
+         * @throws CouldNotWrite if the temporary file cannot be created.
+         */
+        BundleWriter(const std::filesystem::path& path, FsyncPolicy policy);
+
+        BundleWriter(const BundleWriter&) = delete;
+        BundleWriter& operator=(const BundleWriter&) = delete;
+
+        /**
+         * Remove the temporary file unless everything was committed.
+         */
+        ~BundleWriter();
+
+        /**
+         * Add a stream. Safe to call from multiple threads.
+         *
+         * @param name Name to look the stream up by.
+         * @param data Encoded stream.
+         * @param size Size of @p data in bytes.
+         * @param duration Duration of the stream in seconds.
+         * @throws CouldNotWrite in case of I/O errors.
+         */
+        void append(const std::string& name, const uint8_t* data, size_t size, double duration);
+
+        /**
+         * Write the index and publish the bundle under its final name. Later
+         * calls do nothing, streams can no longer be appended.
+         *
+         * @return Number of streams in the bundle.
+         * @throws CouldNotWrite in case of I/O errors.
+         */
+        size_t commit();
+
+    private:
+        std::filesystem::path m_path;
+        std::string m_temp_path;
+        FsyncPolicy m_policy;
+        int m_fd{-1};
+        std::atomic<uint64_t> m_end{0};
+        size_t m_count{0};
+        // Held shared by append() while it writes, exclusively by commit().
+        std::shared_mutex m_file_mutex;
+        std::mutex m_mutex;
+        std::vector<std::pair<std::string, BundleEntry>> m_entries;
+    };
+
+    /**
+     * Looks up streams in a bundle written by BundleWriter.
+     */
+    class BundleReader {
+    public:
+        /**
+         * Thrown if the bundle cannot be read.
+         */
+        class CouldNotRead : public std::runtime_error {
+        public:
+            /**
+             * Construct CouldNotRead error.
+             *
+             * @param msg Error message.
+             */
+            CouldNotRead(const std::string& msg) : std::runtime_error{msg} {}
+        };
+
+        /**
+         * Open the bundle at @p path and load its index.
+         *
+         * @param path Path of the bundle.
+         * @throws CouldNotRead if @p path is not a complete bundle.
+         */
+        explicit BundleReader(const std::filesystem::path& path);
+
+        BundleReader(const BundleReader&) = delete;
+        BundleReader& operator=(const BundleReader&) = delete;
+
+        ~BundleReader();
+
+        /**
+         * Return the names of all streams, in index order.
+         *
+         * @return Stream names.
+         */
+        const std::vector<std::string>& names() const;
+
+        /**
+         * Find a stream.
+         *
+         * @param name Name the stream was appended as.
+         * @return The entry, nullptr if there is no stream of that name.
+         */
+        const BundleEntry* find(const std::string& name) const;
+
+        /**
+         * Read a stream with a single pread(). Safe to call from multiple
+         * threads.
+         *
+         * @param name Name the stream was appended as.
+         * @param[out] data Contents of the stream.
+         * @return false if there is no stream of that name.
+         * @throws CouldNotRead in case of I/O errors.
+         */
+        bool read(const std::string& name, Buffer<uint8_t>& data) const;
+
+    private:
+        std::filesystem::path m_path;
+        int m_fd{-1};
+        std::vector<std::string> m_names;
+        std::unordered_map<std::string, BundleEntry> m_entries;
+    };
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "encoder.h"
+#include "worker_pool.h"
+
+namespace cin
+{
+    /**
+     * Encoding service on a local Unix domain socket.
+     *
+     * One worker per core is started once and keeps its arena across jobs, so
+     * a job pays neither process start-up nor thread and buffer set-up. Jobs
+     * share verifiers and ledgers with earlier jobs of the same settings, and
+     * each directory is only searched for temporary files of crashed runs
+     * by the first job writing to it, see EncoderResources. Every message in
+     * either direction is a frame: a 32 bit little endian length followed by
+     * that many bytes.
+     *
+     * A job is the client's working directory followed by a command line,
+     * each NUL terminated, parsed like the arguments of the encoder itself.
+     * The reply is text, one "key value" pair per line: status (ok, failed or
+     * error), priority, files, failed, wait_ms, encode_ms and total_ms, then
+     * one "queue <class> <files> <p50_ms> <p99_ms> <max_ms> <late>" line per
+     * priority class with the queue waits since the daemon started, then one
+     * "file <ok|error> <ms> <path>[: <message>]" line per input. Jobs queue
+     * their files with --priority and --deadline, see WorkerPool. Invalid jobs
+     * get status error and a message line. A connection may send any number
+     * of jobs, each is answered in turn.
+     */
+    class Daemon {
+    public:
+        /**
+         * Thrown if the socket cannot be set up or used.
+         */
+        class SocketError : public std::runtime_error {
+        public:
+            /**
+             * Construct SocketError.
+             *
+             * @param msg Error message.
+             */
+            SocketError(const std::string& msg) : std::runtime_error{msg} {}
+        };
+
+        /**
+         * Bind @p socket_path and start the workers.
+         *
+         * A stale socket file at @p socket_path is replaced.
+         *
+         * @param socket_path Path of the socket.
+         * @throws SocketError if the socket cannot be bound.
+         */
+        explicit Daemon(const std::filesystem::path& socket_path);
+
+        Daemon(const Daemon&) = delete;
+        Daemon& operator=(const Daemon&) = delete;
+
+        /**
+         * Stop workers and connections and remove the socket.
+         */
+        ~Daemon();
+
+        /**
+         * Serve jobs until SIGINT or SIGTERM.
+         */
+        void run();
+
+    private:
+        struct Job;
+
+        void run_file(Job& job, size_t index, Arena& arena);
+        void serve(int fd);
+        std::string run_job(const std::string& request);
+
+        std::filesystem::path m_socket_path;
+        int m_listen_fd{-1};
+        std::atomic<uint64_t> m_next_job{1};
+
+        // Declared before the pool, whose workers use it until they stop.
+        EncoderResources m_resources;
+        WorkerPool m_pool;
+
+        // Connection threads are detached so a long running daemon does not
+        // collect finished ones, the destructor waits for the set to drain.
+        std::mutex m_connection_mutex;
+        std::condition_variable m_disconnected;
+        std::set<int> m_connections;
+    };
+
+    /**
+     * Send the command line in @p argv to the daemon at @p socket_path, print
+     * its reply and return an exit status.
+     *
+     * @param socket_path Path of the daemon socket.
+     * @param argc Number of arguments.
+     * @param argv Arguments, --submit and its value are left out of the job.
+     * @return EXIT_SUCCESS if the job's status is ok.
+     * @throws Daemon::SocketError if the daemon cannot be reached.
+     */
+    int submit_job(const std::filesystem::path& socket_path, int argc, const char* argv[]);
+}
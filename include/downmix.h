@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace cin
+{
+    /**
+     * Mix interleaved multichannel PCM down to stereo.
+     *
+     * Each output channel is a weighted sum of the input channels. Channel
+     * order follows WAVE_FORMAT_EXTENSIBLE as delivered by libsndfile, e.g.
+     * L, R, C, LFE, Ls, Rs for 5.1 and L, R, C, LFE, Lb, Rb, Ls, Rs for 7.1.
+     */
+    class Downmix {
+    public:
+        /** Largest supported number of input channels. */
+        static constexpr int max_channels{8};
+
+        /**
+         * Construct a downmix from a custom matrix.
+         *
+         * @param num_channels Number of input channels.
+         * @param matrix Row-major 2 x @p num_channels coefficients, first row
+         *   is the left output.
+         * @throws cin::Encoder::UnsupportedFormat if @p matrix does not match
+         *   @p num_channels or @p num_channels exceeds max_channels.
+         */
+        Downmix(int num_channels, const std::vector<float>& matrix);
+
+        /**
+         * Construct the ITU-R BS.775 downmix for @p num_channels.
+         *
+         * Surrounds and centre are mixed in at -3 dB, LFE is dropped and the
+         * result is scaled so a full-scale input on all channels cannot clip.
+         *
+         * @param num_channels Number of input channels, 3 to 8.
+         * @return Downmix for the standard layout of @p num_channels.
+         * @throws cin::Encoder::UnsupportedFormat for other channel counts.
+         */
+        static Downmix itu(int num_channels);
+
+        /**
+         * Downmix @p num_frames frames.
+         *
+         * @param input Interleaved samples, num_frames * channels.
+         * @param num_frames Number of frames.
+         * @param[out] output Interleaved stereo samples, num_frames * 2.
+         */
+        void apply(const int16_t* input, size_t num_frames, int16_t* output) const;
+
+    private:
+        int m_channels;
+        alignas(16) float m_left[max_channels]{};
+        alignas(16) float m_right[max_channels]{};
+    };
+}
@@ -1,9 +1,76 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "analysis_cache.h"
+#include "archive.h"
+#include "arena.h"
+#include "bundle.h"
 #include "fs.h"
+#include "journal.h"
+#include "ledger.h"
+#include "options.h"
+#include "perf.h"
+#include "verify.h"
 
 namespace cin
 {
+    /**
+     * State a long running process shares between the Encoders of its jobs.
+     *
+     * Jobs with the same settings use one Verifier and one Ledger instead of
+     * starting their threads each time, and each directory is searched for
+     * temporary files of crashed runs only by the first job writing to it.
+     * All functions are safe to call from multiple threads.
+     */
+    class EncoderResources {
+    public:
+        /**
+         * Return the verifier writing @p report, started on first use.
+         *
+         * @param report Path of the failure report.
+         * @param policy Durability of the report.
+         * @return Verifier shared by all callers with the same arguments.
+         */
+        std::shared_ptr<Verifier> verifier(const std::filesystem::path& report, FsyncPolicy policy);
+
+        /**
+         * Return the ledger in @p directory, opened on first use.
+         *
+         * @param directory Ledger directory.
+         * @param input_root Directory the inputs were enumerated from.
+         * @param lease Seconds after which an untouched claim expires.
+         * @return Ledger shared by all callers with the same arguments.
+         * @throws OutputFile::CouldNotWrite if the directory cannot be created.
+         */
+        std::shared_ptr<Ledger> ledger(const std::filesystem::path& directory, const std::filesystem::path& input_root, double lease);
+
+        /**
+         * Check whether @p directory still has to be cleaned, and remember
+         * that it is cleaned from now on.
+         *
+         * @param directory Directory to clean.
+         * @param recursive Whether subdirectories are cleaned as well.
+         * @return true the first time it is called with these arguments.
+         */
+        bool first_cleanup(const std::filesystem::path& directory, bool recursive);
+
+    private:
+        std::mutex m_mutex;
+        std::map<std::pair<std::filesystem::path, FsyncPolicy>, std::shared_ptr<Verifier>> m_verifiers;
+        std::map<std::tuple<std::filesystem::path, std::filesystem::path, double>, std::shared_ptr<Ledger>> m_ledgers;
+        std::set<std::pair<std::filesystem::path, bool>> m_cleaned;
+    };
+
     /**
      * Encodes a list of potential WAV files.
      */
@@ -25,19 +92,121 @@ namespace cin
         /**
          * Construct a new encoder.
          *
+         * Inputs recorded as complete in the journal given by @p options are
+         * dropped from @p paths.
+         *
          * @p paths List of potential WAV files.
+         * @p options Output and durability settings.
+         * @p resources Verifiers and ledgers to share with other Encoders,
+         *   which must outlive this one, nullptr to start its own.
+         * @throws OutputFile::CouldNotWrite if the journal or the ledger cannot
+         *   be opened.
          */
-        Encoder(Paths&& paths);
+        Encoder(Paths&& paths, const Options& options = {}, EncoderResources* resources = nullptr);
+
+        Encoder(const Encoder&) = delete;
+        Encoder& operator=(const Encoder&) = delete;
+
+        /**
+         * Wait for verifications of this Encoder's files still pending.
+         */
+        ~Encoder();
 
         /**
          * Encode the list of files given in the constructor.
          *
+         * With verification enabled each MP3 is decoded on a separate pool
+         * while the next files encode, both return once all are checked. With
+         * a ledger, both return once every input is done by some process.
+         *
          * @throws std::runtime_error in case of I/O or encoding issues.
          */
         void encodemulti() const;
         void encode() const;
 
+        /**
+         * Return the files left to encode after journal filtering.
+         *
+         * @return Paths given to the constructor, minus completed ones.
+         */
+        const Paths& paths() const;
+
+        /**
+         * Encode a single file, for callers that run their own workers.
+         * Safe to call from multiple threads with one arena each. With a
+         * ledger, an input another process has claimed or finished is skipped.
+         *
+         * @param path One of paths().
+         * @param arena Per-worker arena, reset before returning.
+         * @return false if another process holds the claim on @p path, which
+         *   then has to be tried again after retry_interval().
+         * @throws std::runtime_error in case of I/O or encoding issues.
+         */
+        bool encode_one(const std::filesystem::path& path, Arena& arena) const;
+
+        /**
+         * Return how long to wait before trying an input again that
+         * encode_one() found claimed by another process.
+         *
+         * @return The ledger's retry interval, 0 without a ledger.
+         */
+        std::chrono::milliseconds retry_interval() const;
+
+        /**
+         * Return where outputs go, with the output root resolved the way
+         * encoding resolves it, e.g. to the directory collecting the outputs
+         * of an output archive.
+         *
+         * @return Layout used by encode_one().
+         */
+        const OutputLayout& layout() const;
+
+        /**
+         * Wait for pending verifications and write the verification report.
+         * With an output archive, pack the outputs into it. With a bundle,
+         * write its index and publish it. With hardware counters, log their
+         * totals over the files encoded since the last call.
+         *
+         * @param keep_outputs Leave the packed outputs in their directory, so
+         *   a later run can tell which inputs are up to date.
+         * @return Number of files that failed verification, 0 if disabled.
+         * @throws OutputFile::CouldNotWrite if the report cannot be written.
+         * @throws BundleWriter::CouldNotWrite if the bundle cannot be written.
+         */
+        size_t finish(bool keep_outputs = false) const;
+
+        /**
+         * Return the number of inputs that could not be encoded by the last
+         * encode() or encodemulti(), or whose MP3 failed verification.
+         *
+         * @return Number of failed inputs.
+         */
+        size_t failures() const;
+
     private:
+        float normalization_gain(const std::filesystem::path& path, const Buffer<uint8_t>* contents, Arena& arena) const;
+        void estimate_jobs(std::vector<uint64_t>& costs, std::vector<uint64_t>& bytes) const;
+        void encode_held(Paths&& held, Arena& arena) const;
+        void complete(const std::filesystem::path& path) const;
+        void verified(const std::filesystem::path& path, bool passed) const;
+
         Paths m_paths;
+        Options m_options;
+        OutputLayout m_layout;
+        std::unique_ptr<Journal> m_journal;
+        std::shared_ptr<Ledger> m_ledger;
+        std::unique_ptr<AnalysisCache> m_analysis_cache;
+        std::shared_ptr<Verifier> m_verifier;
+        std::unique_ptr<Archive> m_archive;
+        std::unique_ptr<BundleWriter> m_bundle;
+        std::unique_ptr<PerfTotals> m_perf;
+        mutable std::atomic<size_t> m_failures{0};
+
+        // Verifications submitted and not finished yet, a shared Verifier
+        // may be busy with files of other Encoders.
+        mutable std::mutex m_verify_mutex;
+        mutable std::condition_variable m_verify_idle;
+        mutable size_t m_verifying{0};
+        mutable size_t m_verify_failures{0};
     };
 }
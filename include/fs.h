@@ -1,7 +1,11 @@
 #pragma once
 
+#include <cstdint>
 #include <vector>
 #include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_set>
 
 namespace cin
 {
@@ -11,10 +15,100 @@ namespace cin
      * Enumerate WAV files located in @p path.
      *
      * A "WAV" file is any regular file in @p path that ends in .wav. @p path is
-     * not read recursively and files themselves are not opened or analyzed yet.
+     * only read recursively if @p recursive is set and files themselves are
+     * not opened or analyzed yet. If @p path is a tar or zip archive, its WAV
+     * members at any depth are returned as virtual paths, see Archive.
      *
-     * @param path Path denoting a directory.
+     * @param path Path denoting a directory or an archive.
+     * @param recursive Descend into subdirectories.
      * @return A vector of file paths.
      */
-    Paths get_valid_wav_files(const std::filesystem::path& path);
+    Paths get_valid_wav_files(const std::filesystem::path& path, bool recursive = false);
+
+    /**
+     * Hash the path of @p path relative to @p root.
+     *
+     * The result depends only on the relative path, so it is the same on
+     * every host and in every run even where @p root is mounted elsewhere.
+     *
+     * @param path Path of a file below @p root.
+     * @param root Directory the path was enumerated from.
+     * @return 64 bit FNV-1a hash of the relative path.
+     */
+    uint64_t stable_hash(const std::filesystem::path& path, const std::filesystem::path& root);
+
+    /**
+     * Size and modification time of a file, used to detect changed inputs.
+     */
+    struct FileStamp {
+        /** Size in bytes. */
+        uint64_t size;
+        /** Modification time in nanoseconds since the epoch. */
+        int64_t mtime;
+
+        bool operator==(const FileStamp& other) const
+        {
+            return size == other.size && mtime == other.mtime;
+        }
+    };
+
+    /**
+     * Stat @p path. An archive member, named <archive>/<member>, gets the
+     * stamp of its archive, so records keyed by its path stay valid until
+     * the archive changes.
+     *
+     * @param path Path of a file or archive member.
+     * @param[out] result Stamp of @p path.
+     * @return false if @p path cannot be stat'ed.
+     */
+    bool stamp_file(const std::filesystem::path& path, FileStamp& result);
+
+    /**
+     * Map input files to output files.
+     *
+     * Without an output root, outputs are placed next to their inputs. With an
+     * output root, the directory tree below the input root is mirrored below
+     * the output root. Output directories are created on first use by whichever
+     * worker needs them, so no upfront pass over the tree is necessary.
+     */
+    class OutputLayout {
+    public:
+        /**
+         * Construct a layout.
+         *
+         * @param input_root Directory the inputs were enumerated from.
+         * @param output_root Directory to mirror into, empty to write next to
+         *   the inputs.
+         */
+        OutputLayout(const std::filesystem::path& input_root, const std::filesystem::path& output_root);
+
+        /**
+         * Return the MP3 path for @p input.
+         *
+         * @param input Path of a WAV file below the input root.
+         * @return Path of the output file.
+         */
+        std::filesystem::path output_path(const std::filesystem::path& input) const;
+
+        /**
+         * Make sure the directory containing @p output exists. Safe to call
+         * from multiple threads.
+         *
+         * @param output Path returned by output_path().
+         * @throws std::filesystem::filesystem_error if it cannot be created.
+         */
+        void prepare(const std::filesystem::path& output) const;
+
+        /**
+         * Forget the directories prepare() created, after the output tree was
+         * removed, so they are created again when needed.
+         */
+        void forget() const;
+
+    private:
+        std::filesystem::path m_input_root;
+        std::filesystem::path m_output_root;
+        mutable std::mutex m_mutex;
+        mutable std::unordered_set<std::string> m_created;
+    };
 }
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "loudness.h"
+
+namespace cin
+{
+    namespace id3
+    {
+        /** Size of the ID3v2 tag reserved at the start of tagged outputs. */
+        constexpr size_t reserved_size{256};
+
+        /** A complete tag of reserved_size bytes including padding. */
+        using Tag = std::array<uint8_t, reserved_size>;
+
+        /**
+         * Return an ID3v2.3 tag that only consists of padding.
+         *
+         * Written before the MP3 stream so the real tag can replace it in
+         * place once the stream has been analyzed.
+         *
+         * @return Empty tag.
+         */
+        Tag empty_tag();
+
+        /**
+         * Return an ID3v2.3 tag with ReplayGain TXXX frames.
+         *
+         * @param result Loudness measurement of the stream.
+         * @return Tag carrying REPLAYGAIN_TRACK_GAIN and REPLAYGAIN_TRACK_PEAK.
+         */
+        Tag replaygain_tag(const LoudnessResult& result);
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "fs.h"
+#include "options.h"
+
+namespace cin
+{
+    /**
+     * Append-only record of input files that were encoded successfully.
+     *
+     * Each line stores size, modification time and path of an input. A file
+     * counts as done on restart if its size and modification time still match,
+     * so inputs that changed since the last run are encoded again.
+     */
+    class Journal {
+    public:
+        /**
+         * Open or create the journal at @p path and load existing entries.
+         *
+         * @param path Location of the journal file.
+         * @param policy Whether appended entries are synced to disk.
+         * @throws OutputFile::CouldNotWrite if the journal cannot be opened.
+         */
+        Journal(const std::filesystem::path& path, FsyncPolicy policy);
+
+        Journal(const Journal&) = delete;
+        Journal& operator=(const Journal&) = delete;
+
+        ~Journal();
+
+        /**
+         * Check if @p input was completed in a previous run.
+         *
+         * @param input Path of the input file.
+         * @return true if @p input is unchanged since it was recorded.
+         */
+        bool is_complete(const std::filesystem::path& input) const;
+
+        /**
+         * Record @p input as complete. Safe to call from multiple threads.
+         *
+         * @param input Path of the input file.
+         * @throws OutputFile::CouldNotWrite in case of I/O errors.
+         */
+        void record(const std::filesystem::path& input);
+
+    private:
+        std::filesystem::path m_path;
+        FsyncPolicy m_policy;
+        int m_fd;
+        std::mutex m_mutex;
+        std::unordered_map<std::string, FileStamp> m_entries;
+    };
+}
@@ -1,9 +1,10 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
-#include <vector>
 #include <stdexcept>
 #include <lame/lame.h>
+#include "buffer.h"
 
 namespace cin
 {
@@ -48,24 +49,54 @@ namespace cin
          */
         Lame(int num_channels, int sample_rate);
 
+        /**
+         * Return the worst-case MP3 output size for one encode() call.
+         *
+         * Uses the bound documented in lame.h, 1.25 * samples per channel +
+         * 7200 bytes, which also covers the data returned by flush().
+         *
+         * @param num_frames Number of frames passed to encode().
+         * @return Required size of the output buffer in bytes.
+         */
+        static size_t max_encoded_size(size_t num_frames);
+
         /**
          * Encode PCM samples into MP3 blocks.
          *
          * @param samples 16 bit PCM samples.
-         * @param[out] data Output MP3 data, vector is resized if necessary.
+         * @param[out] data Output MP3 data, resized to the encoded size. Its
+         *   capacity must be at least max_encoded_size() of the frame count.
+         * @throws EncodeError in case encoding error.
+         * @returns Size of @p data.
+         */
+        size_t encode(const Buffer<int16_t>& samples, Buffer<uint8_t>& data) const;
+
+        /**
+         * Encode @p num_samples interleaved PCM samples into MP3 blocks.
+         *
+         * @param samples 16 bit PCM samples.
+         * @param num_samples Number of samples, frames * channels.
+         * @param[out] data Output MP3 data, as for the Buffer overload.
          * @throws EncodeError in case encoding error.
          * @returns Size of @p data.
          */
-        size_t encode(const std::vector<int16_t>& samples, std::vector<uint8_t>& data) const;
+        size_t encode(const int16_t* samples, size_t num_samples, Buffer<uint8_t>& data) const;
 
         /**
          * Encode remaining data.
          *
-         * @param[out] data Output MP3 data, vector is resized if necessary.
+         * @param[out] data Output MP3 data, resized to the encoded size.
          * @throws EncodeError in case encoding error.
          * @returns Size of @p data in number of bytes.
          */
-        size_t flush(std::vector<uint8_t>& data) const;
+        size_t flush(Buffer<uint8_t>& data) const;
+
+        /**
+         * Return the number of silent frames LAME puts before the samples.
+         *
+         * @returns Encoder delay in frames.
+         */
+        int encoder_delay() const;
 
     private:
         bool m_mono;
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include "fs.h"
+#include "options.h"
+
+namespace cin
+{
+    /**
+     * Work ledger shared by encoder processes on one or more hosts.
+     *
+     * The ledger is a directory, typically next to the library on the same
+     * NFS mount. Each input is named by a hash of its path relative to the
+     * input root, so hosts may mount the library in different places. A
+     * process claims an input by creating "<key>.claim" with O_EXCL and marks
+     * it finished by renaming a "<key>.done" file with the input's size and
+     * modification time into place. A finished input that changed since is
+     * encoded again.
+     *
+     * Claims are leases: a background thread touches every claim this
+     * process holds a few times per lease period. A claim that was not
+     * touched for a whole lease belongs to a crashed process and is taken
+     * over by renaming it aside, which only one contender can do. Hosts are
+     * expected to have synchronized clocks.
+     */
+    class Ledger {
+    public:
+        /**
+         * Outcome of claim().
+         */
+        enum class Claim
+        {
+            /** This process owns the input now. */
+            claimed,
+            /** Another process already encoded the unchanged input. */
+            done,
+            /** Another live process is encoding the input. */
+            held,
+        };
+
+        /**
+         * Open the ledger, creating its directory if needed.
+         *
+         * @param directory Ledger directory.
+         * @param input_root Directory the inputs were enumerated from.
+         * @param lease Seconds after which an untouched claim expires.
+         * @throws OutputFile::CouldNotWrite if the directory cannot be created.
+         */
+        Ledger(const std::filesystem::path& directory, const std::filesystem::path& input_root, double lease);
+
+        Ledger(const Ledger&) = delete;
+        Ledger& operator=(const Ledger&) = delete;
+
+        /**
+         * Stop renewing leases and release claims still held.
+         */
+        ~Ledger();
+
+        /**
+         * Try to take @p input. Safe to call from multiple threads.
+         *
+         * @param input Path of the input file.
+         * @return Whether the caller should encode @p input.
+         * @throws OutputFile::CouldNotWrite if the claim cannot be created.
+         */
+        Claim claim(const std::filesystem::path& input);
+
+        /**
+         * Mark a claimed input as encoded and drop the claim. Safe to call
+         * from multiple threads.
+         *
+         * @param input Path passed to claim().
+         * @throws OutputFile::CouldNotWrite if the marker cannot be written.
+         */
+        void complete(const std::filesystem::path& input);
+
+        /**
+         * Drop the claim on an input that failed, so another process may try
+         * it. Safe to call from multiple threads.
+         *
+         * @param input Path passed to claim().
+         */
+        void release(const std::filesystem::path& input);
+
+        /**
+         * Return how long to wait before claiming held inputs again.
+         *
+         * @return A quarter of the lease, at least one second.
+         */
+        std::chrono::milliseconds retry_interval() const;
+
+    private:
+        std::filesystem::path entry_path(const std::filesystem::path& input, const char* suffix) const;
+        bool is_done(const std::filesystem::path& input, const std::filesystem::path& marker) const;
+        bool expire(const std::filesystem::path& claim) const;
+        void renew();
+
+        std::filesystem::path m_directory;
+        std::filesystem::path m_input_root;
+        std::chrono::duration<double> m_lease;
+        std::string m_owner;
+
+        std::mutex m_mutex;
+        std::condition_variable m_stopping;
+        bool m_stop{false};
+        std::set<std::filesystem::path> m_claims;
+        size_t m_completed{0};
+        size_t m_done_elsewhere{0};
+
+        // Declared last so it starts after everything it renews.
+        std::thread m_renewer;
+    };
+}
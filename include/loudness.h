@@ -0,0 +1,109 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace cin
+{
+    /**
+     * Loudness and peak measurements of one stream.
+     */
+    struct LoudnessResult {
+        /** Integrated loudness in LUFS, -infinity if everything was gated. */
+        double integrated_lufs;
+        /** True peak in dBTP, measured with 4x oversampling below 96 kHz. */
+        double true_peak_dbtp;
+        /** Largest absolute sample value in dBFS. */
+        double sample_peak_dbfs;
+        /** ReplayGain 2.0 track gain in dB, relative to -18 LUFS. */
+        double replaygain_db;
+        /** ReplayGain track peak as a linear factor of full scale. */
+        double replaygain_peak;
+        /** Duration of the measured audio in seconds. */
+        double duration;
+
+        /**
+         * Check if the stream was long and loud enough to be measured.
+         *
+         * @return false for silent or very short streams.
+         */
+        bool valid() const;
+    };
+
+    /**
+     * Multiply samples by @p gain, rounding and saturating to 16 bit.
+     *
+     * @param[in,out] samples Samples to scale in place.
+     * @param count Number of samples.
+     * @param gain Linear gain factor.
+     */
+    void apply_gain(int16_t* samples, size_t count, float gain);
+
+    /**
+     * Streaming EBU R128 / ITU-R BS.1770-4 loudness and peak meter.
+     *
+     * Samples are K-weighted and integrated over 400 ms blocks with 75%
+     * overlap. Block loudness values go into a fixed histogram so memory does
+     * not grow with the length of the stream. True peak interpolates four
+     * phases per sample at once with SIMD.
+     */
+    class LoudnessMeter {
+    public:
+        /** Most channels measured, inputs are downmixed to stereo first. */
+        static constexpr int max_channels{2};
+
+        /**
+         * Construct a meter.
+         *
+         * @param sample_rate Sample rate in Hz.
+         * @param num_channels Number of interleaved channels, 1 or 2.
+         */
+        LoudnessMeter(int sample_rate, int num_channels);
+
+        /**
+         * Feed a block of samples.
+         *
+         * @param samples Interleaved samples, @p num_frames * channels.
+         * @param num_frames Number of frames.
+         */
+        void process(const int16_t* samples, size_t num_frames);
+
+        /**
+         * Return the measurements of everything passed to process() so far.
+         *
+         * @return Loudness and peak values.
+         */
+        LoudnessResult result() const;
+
+    private:
+        static constexpr int histogram_bins{750};
+        static constexpr int true_peak_taps{12};
+
+        struct Biquad {
+            double b0, b1, b2, a1, a2;
+        };
+
+        void finish_hop();
+
+        int m_rate;
+        int m_channels;
+        Biquad m_shelf;
+        Biquad m_highpass;
+        double m_state[max_channels][4]{};
+        double m_hop_energy{0.0};
+        size_t m_hop_frames;
+        size_t m_hop_position{0};
+        std::array<double, 4> m_hops{};
+        size_t m_num_hops{0};
+        std::array<double, histogram_bins> m_bin_energy{};
+        std::array<uint32_t, histogram_bins> m_bin_count{};
+        bool m_oversample;
+        // Each history is stored twice so a window is always contiguous.
+        alignas(16) float m_history[max_channels][2 * true_peak_taps]{};
+        size_t m_history_position{0};
+        float m_true_peak{0.0F};
+        int m_sample_peak{0};
+        uint64_t m_frames{0};
+    };
+}
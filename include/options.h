@@ -0,0 +1,295 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace cin
+{
+    /**
+     * When to call fsync() while publishing output files.
+     */
+    enum class FsyncPolicy
+    {
+        /** Never sync, rely on rename() for atomicity only. */
+        none = 0,
+        /** Sync file contents before the rename. */
+        file,
+        /** Sync file contents and the containing directory after the rename. */
+        full,
+    };
+
+    /**
+     * What the encode loop block size is tuned for.
+     */
+    enum class Workload
+    {
+        /** Large blocks, fewer calls into libsndfile and LAME. */
+        batch = 0,
+        /** One MP3 frame per block to keep latency low. */
+        streaming,
+    };
+
+    /**
+     * Trade-off between speed and stopband attenuation of the Resampler.
+     */
+    enum class ResampleQuality
+    {
+        /** 16 taps per phase, Kaiser beta 6. */
+        fast = 0,
+        /** 32 taps per phase, Kaiser beta 8. */
+        medium,
+        /** 64 taps per phase, Kaiser beta 10. */
+        best,
+    };
+
+    /**
+     * Format of waveform peak files.
+     */
+    enum class PeakFormat
+    {
+        /** No peak file. */
+        none = 0,
+        /** <name>.peaks.json */
+        json,
+        /** <name>.peaks, compact little endian binary. */
+        binary,
+    };
+
+    /**
+     * Scheduling class of a job in a shared worker pool. Higher classes are
+     * served first whenever a worker finishes a file.
+     */
+    enum class Priority
+    {
+        /** Single files someone is waiting for. */
+        interactive = 0,
+        /** Default. */
+        normal,
+        /** Backfills, run when nothing else is queued. */
+        bulk,
+    };
+
+    /**
+     * Instruction set of the sample processing kernels.
+     */
+    enum class SimdLevel
+    {
+        /** Plain C++, runs anywhere. */
+        scalar = 0,
+        /** 128 bit SSE2, the x86-64 baseline. */
+        sse2,
+        /** 256 bit AVX2. */
+        avx2,
+        /** 512 bit AVX-512 F and BW. */
+        avx512,
+    };
+
+    /**
+     * Settings given on the command line.
+     */
+    struct Options {
+        /**
+         * Thrown by parse_options() for malformed command lines.
+         */
+        class InvalidArgument : public std::runtime_error {
+        public:
+            /**
+             * Construct InvalidArgument error.
+             *
+             * @param msg Error message.
+             */
+            InvalidArgument(const std::string& msg) : std::runtime_error{msg} {}
+        };
+
+        /** Directory containing the WAV files. */
+        std::filesystem::path input;
+
+        /**
+         * Root of the mirrored output tree, empty to write next to inputs or,
+         * for an archive, to a directory named after it.
+         */
+        std::filesystem::path output;
+
+        /** Tar archive to pack the outputs into, empty to leave them as files. */
+        std::filesystem::path output_archive;
+
+        /**
+         * Indexed bundle file to write all MP3s into, empty to write one file
+         * per input. Sidecars are still written as files.
+         */
+        std::filesystem::path bundle;
+
+        /** Enumerate WAV files in subdirectories of @ref input as well. */
+        bool recursive{false};
+
+        /**
+         * Frames per read/encode block, 0 to choose from @ref workload and
+         * the file length with a fixed rule: whole MP3 frames, at most 16 for
+         * batch, one for streaming.
+         */
+        size_t block_frames{0};
+
+        /** Profile used when @ref block_frames is 0. */
+        Workload workload{Workload::batch};
+
+        /** Measure throughput across block sizes instead of encoding once. */
+        bool benchmark{false};
+
+        /** Probe the inputs and print corpus statistics instead of encoding. */
+        bool plan{false};
+
+        /** Kernels to use instead of the best ones the CPU supports. */
+        std::optional<SimdLevel> simd;
+
+        /** Check that all kernel variants agree on the inputs instead of encoding. */
+        bool simd_check{false};
+
+        /**
+         * Count cycles, instructions, cache and branch misses per pipeline
+         * stage with perf_event_open(), logged per file and per run.
+         */
+        bool perf_counters{false};
+
+        /** Serve jobs on this Unix domain socket instead of encoding once. */
+        std::filesystem::path daemon_socket;
+
+        /** Keep running and encode WAV files as they arrive in the input. */
+        bool watch{false};
+
+        /** Seconds a new file must stay unchanged before it is encoded. */
+        double watch_settle{1.0};
+
+        /** Send the job to the daemon on this socket and print its status. */
+        std::filesystem::path submit_socket;
+
+        /** Class of the files of this job in the daemon or watch queue. */
+        Priority priority{Priority::normal};
+
+        /**
+         * Seconds after queueing by which each file should have started, 0
+         * for none. Overdue files are served ahead of every class.
+         */
+        double deadline{0.0};
+
+        /**
+         * Row-major 2 x channels matrix to downmix inputs with more than two
+         * channels, empty to use the ITU-R BS.775 coefficients.
+         */
+        std::vector<float> downmix_matrix;
+
+        /**
+         * Output sample rate, 0 to convert only rates LAME cannot encode
+         * (88.2 kHz and up go to 44.1 or 48 kHz).
+         */
+        int resample_rate{0};
+
+        /** Filter quality used when resampling. */
+        ResampleQuality resample_quality{ResampleQuality::medium};
+
+        /** Write loudness and peak values to a .loudness.json sidecar. */
+        bool loudness_json{false};
+
+        /** Prepend an ID3v2 tag with ReplayGain values to the MP3. */
+        bool replaygain_tags{false};
+
+        /** Target integrated loudness in LUFS, unset to keep levels as is. */
+        std::optional<double> normalize_lufs;
+
+        /**
+         * Cache of loudness measurements used by normalization, empty for
+         * .loudness-cache in the output (or input) directory, or next to
+         * the output archive.
+         */
+        std::filesystem::path analysis_cache;
+
+        /** Level in dBFS below which leading and trailing audio is cut. */
+        std::optional<double> trim_threshold_db;
+
+        /** Seconds of trailing silence kept when trimming. */
+        double trim_min_tail{0.1};
+
+        /** Waveform peak file written next to each MP3. */
+        PeakFormat peak_format{PeakFormat::none};
+
+        /** Frames per peak of each zoom level, multiples of the first. */
+        std::vector<size_t> peak_levels{256, 2048, 16384};
+
+        /**
+         * Cache of WAV header probes, empty for .probe-cache in the output (or
+         * input) directory, or next to the output archive.
+         */
+        std::filesystem::path probe_cache;
+
+        /** Probe headers without keeping results across runs. */
+        bool no_probe_cache{false};
+
+        /**
+         * Bytes of buffers all workers may keep in flight, 0 for no limit.
+         * Fewer files are encoded in parallel to stay below it.
+         */
+        uint64_t memory_budget{0};
+
+        /** Decode every MP3 after encoding and compare it to the source. */
+        bool verify{false};
+
+        /**
+         * Report of failed verifications, empty for verify-report.txt in the
+         * output (or input) directory, or next to the output archive.
+         */
+        std::filesystem::path verify_report;
+
+        /** Journal of completed files, empty if resuming is disabled. */
+        std::filesystem::path journal;
+
+        /**
+         * Directory shared with other encoder processes to split the inputs
+         * between them, empty to encode every input.
+         */
+        std::filesystem::path ledger;
+
+        /**
+         * Seconds after which a claim of a crashed process can be taken over,
+         * and after which temporary outputs written on other hosts count as
+         * left behind.
+         */
+        double lease{300.0};
+
+        /** Which of @ref shard_count parts of the inputs to encode, from 0. */
+        size_t shard_index{0};
+
+        /** Number of independent processes the inputs are split across. */
+        size_t shard_count{1};
+
+        /** Where to write this shard's summary, empty for the default. */
+        std::filesystem::path shard_summary;
+
+        /** Print the combined report of the shard summaries in this directory. */
+        std::filesystem::path merge_shards;
+
+        /** Durability of published MP3 files and journal entries. */
+        FsyncPolicy fsync{FsyncPolicy::file};
+    };
+
+    /**
+     * Parse command line arguments.
+     *
+     * @param argc Number of arguments.
+     * @param argv Argument vector as passed to main().
+     * @return Parsed options.
+     * @throws Options::InvalidArgument in case of unknown flags or values.
+     */
+    Options parse_options(int argc, const char* argv[]);
+
+    /**
+     * Return the usage string for the program.
+     *
+     * @param program Name of the executable.
+     * @return Human readable usage.
+     */
+    std::string usage(const char* program);
+}
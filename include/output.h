@@ -0,0 +1,129 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include "arena.h"
+#include "buffer.h"
+#include "options.h"
+
+namespace cin
+{
+    /**
+     * MP3 output that only becomes visible under its final name once complete.
+     *
+     * Data is written to a hidden temporary file next to the destination,
+     * ".<name>.<host>.<pid>.part", which is renamed over the destination by
+     * commit(). An uncommitted file is
+     * removed on destruction, so a crash or an encoding error never leaves a
+     * truncated file under the final name. Names and the write buffer live in
+     * the arena passed to the constructor, which must outlive the object.
+     */
+    class OutputFile {
+    public:
+        /**
+         * Thrown if the output cannot be created, written or published.
+         */
+        class CouldNotWrite : public std::runtime_error {
+        public:
+            /**
+             * Construct CouldNotWrite error.
+             *
+             * @param msg Error message.
+             */
+            CouldNotWrite(const std::string& msg) : std::runtime_error{msg} {}
+        };
+
+        /**
+         * Create a temporary file for @p path.
+         *
+         * @param path Final destination of the output.
+         * @param policy When to sync data to stable storage.
+         * @param arena Arena for transient state.
+         * @throws CouldNotWrite if the temporary file cannot be created.
+         */
+        OutputFile(const std::filesystem::path& path, FsyncPolicy policy, Arena& arena);
+
+        OutputFile(const OutputFile&) = delete;
+        OutputFile& operator=(const OutputFile&) = delete;
+
+        /**
+         * Close and remove the temporary file unless commit() succeeded.
+         */
+        ~OutputFile();
+
+        /**
+         * Append data to the temporary file.
+         *
+         * @param data Pointer to the data.
+         * @param size Number of bytes.
+         * @throws CouldNotWrite in case of I/O errors.
+         */
+        void write(const uint8_t* data, size_t size);
+
+        /**
+         * Overwrite data that was already written.
+         *
+         * @param offset Position in the file.
+         * @param data Pointer to the data.
+         * @param size Number of bytes, @p offset + @p size must not exceed
+         *   what was written so far.
+         * @throws CouldNotWrite in case of I/O errors.
+         */
+        void patch(size_t offset, const uint8_t* data, size_t size);
+
+        /**
+         * Flush, sync according to the policy and rename to the final name.
+         *
+         * @throws CouldNotWrite in case of I/O errors.
+         */
+        void commit();
+
+    private:
+        void flush();
+
+        const char* m_path;
+        const char* m_temp_path;
+        FsyncPolicy m_policy;
+        int m_fd;
+        bool m_committed{false};
+        Buffer<uint8_t> m_buffer;
+    };
+
+    /**
+     * Return the temporary name OutputFile uses for @p path, for other
+     * writers that publish by rename() and want remove_stale_parts() to clean
+     * up after them.
+     *
+     * @param path Final destination.
+     * @return Hidden path in the same directory, ".<name>.<host>.<pid>.part".
+     */
+    std::string temp_path(const std::filesystem::path& path);
+
+    /**
+     * Sync the directory containing @p path to stable storage.
+     *
+     * @param path Path of a file in the directory.
+     * @throws OutputFile::CouldNotWrite in case the directory cannot be synced.
+     */
+    void sync_parent_directory(const std::filesystem::path& path);
+
+    /**
+     * Remove temporary files of OutputFile that crashed runs left behind.
+     *
+     * A file written on this host counts as left behind if the process named
+     * in it no longer runs. Whether a process on another host still runs
+     * cannot be checked, so a file written there (or by an older version
+     * without the host in the name) counts as left behind once it was not
+     * modified for @p min_age.
+     *
+     * @param directory Directory to clean, missing directories are ignored.
+     * @param recursive Clean subdirectories as well.
+     * @param min_age Time since the last modification of files written on
+     *   other hosts.
+     * @return Number of files removed.
+     */
+    size_t remove_stale_parts(const std::filesystem::path& directory, bool recursive, std::chrono::seconds min_age);
+}
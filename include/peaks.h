@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+#include "arena.h"
+#include "buffer.h"
+#include "options.h"
+
+namespace cin
+{
+    /**
+     * Waveform overview of a stream at several zoom levels.
+     *
+     * Each level stores the minimum and maximum sample of every channel over
+     * a fixed number of frames. The finest level is reduced from the samples
+     * with SIMD, coarser levels are derived from it, so every level must be a
+     * multiple of the first.
+     */
+    class PeakBuilder {
+    public:
+        /** Most channels supported, inputs are downmixed to stereo first. */
+        static constexpr int max_channels{2};
+
+        /**
+         * Construct a builder.
+         *
+         * @param num_channels Number of interleaved channels, 1 or 2.
+         * @param sample_rate Sample rate in Hz, stored in the output.
+         * @param levels Frames per peak of each zoom level, ascending, each a
+         *   multiple of the first.
+         * @param arena Arena for the finest level, must outlive this.
+         */
+        PeakBuilder(int num_channels, int sample_rate, const std::vector<size_t>& levels, Arena& arena);
+
+        /**
+         * Feed a block of samples.
+         *
+         * @param samples Interleaved samples, @p num_frames * channels.
+         * @param num_frames Number of frames.
+         */
+        void process(const int16_t* samples, size_t num_frames);
+
+        /**
+         * Write all levels to @p path.
+         *
+         * A partially filled last peak is included. JSON output is an object
+         * with sample_rate, channels and a levels array, each level holding
+         * frames_per_peak and data as flat min, max pairs per channel. Binary
+         * output is the little endian equivalent, see peaks.cpp.
+         *
+         * @param path Destination, published atomically.
+         * @param format Output format.
+         * @param policy Durability of the output.
+         * @param arena Arena for the output file.
+         * @throws OutputFile::CouldNotWrite in case of I/O errors.
+         */
+        void write(const std::filesystem::path& path, PeakFormat format, FsyncPolicy policy, Arena& arena);
+
+    private:
+        void finish_peak();
+
+        int m_channels;
+        int m_rate;
+        std::vector<size_t> m_levels;
+        Buffer<int16_t> m_finest;
+        int16_t m_min[max_channels];
+        int16_t m_max[max_channels];
+        size_t m_count{0};
+    };
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace cin
+{
+    /**
+     * Part of the encode pipeline that hardware counters are attributed to.
+     */
+    enum class PerfStage {
+        /** Reading samples from the WAV file, including the downmix. */
+        read = 0,
+        /** Trimming, gain, loudness, peaks, resampling and verification capture. */
+        process,
+        /** Lame::encode() and Lame::flush(). */
+        encode,
+        /** Writing MP3 data to the output file or bundle. */
+        write,
+    };
+
+    /** Number of PerfStage values. */
+    constexpr size_t num_perf_stages{4};
+
+    /**
+     * Hardware counter values of the calling thread, user space only.
+     */
+    struct PerfCounts {
+        /** Core cycles. */
+        uint64_t cycles{0};
+        /** Retired instructions. */
+        uint64_t instructions{0};
+        /** Last level cache misses. */
+        uint64_t cache_misses{0};
+        /** Mispredicted branches. */
+        uint64_t branch_misses{0};
+
+        PerfCounts& operator+=(const PerfCounts& other);
+    };
+
+    /**
+     * Counter values per pipeline stage, for one file or a whole run.
+     */
+    class PerfStages {
+    public:
+        /**
+         * Construct empty stages.
+         *
+         * @param enabled Whether to count at all. Stays disabled if the
+         *   counters cannot be opened on the calling thread.
+         */
+        explicit PerfStages(bool enabled = false);
+
+        /**
+         * Return whether counters are read on this thread.
+         *
+         * @return True if PerfScope records anything.
+         */
+        bool enabled() const;
+
+        /**
+         * Return the counts of one stage.
+         *
+         * @param stage Pipeline stage.
+         * @return Counts accumulated so far.
+         */
+        const PerfCounts& operator[](PerfStage stage) const;
+
+        /**
+         * Add @p counts to @p stage.
+         *
+         * @param stage Pipeline stage.
+         * @param counts Counts to add.
+         */
+        void add(PerfStage stage, const PerfCounts& counts);
+
+        /**
+         * Add all stages of @p other.
+         *
+         * @param other Stages to add.
+         * @return This.
+         */
+        PerfStages& operator+=(const PerfStages& other);
+
+        /**
+         * Log one line per stage that ran, indented below a file's messages
+         * at debug level or as a run summary at info level.
+         *
+         * @param title Heading of the lines.
+         * @param summary Log at info level instead of debug.
+         */
+        void log(const std::string& title, bool summary) const;
+
+    private:
+        bool m_enabled;
+        std::array<PerfCounts, num_perf_stages> m_stages{};
+    };
+
+    /**
+     * Attributes the counts between construction and destruction to a stage.
+     * Does nothing if the stages are disabled.
+     */
+    class PerfScope {
+    public:
+        /**
+         * Read the counters of the calling thread.
+         *
+         * @param stages Stages to add to.
+         * @param stage Stage the enclosed code belongs to.
+         */
+        PerfScope(PerfStages& stages, PerfStage stage);
+
+        PerfScope(const PerfScope&) = delete;
+        PerfScope& operator=(const PerfScope&) = delete;
+
+        /**
+         * Read the counters again and add the difference to the stage.
+         */
+        ~PerfScope();
+
+    private:
+        PerfStages& m_stages;
+        PerfStage m_stage;
+        PerfCounts m_start;
+    };
+
+    /**
+     * Counts of all files of a run. Safe to add to from multiple threads.
+     */
+    class PerfTotals {
+    public:
+        /**
+         * Add the counts of one file.
+         *
+         * @param stages Counts of the file, ignored if disabled.
+         */
+        void add(const PerfStages& stages);
+
+        /**
+         * Log the totals of the run if any file was counted, then start over.
+         */
+        void report();
+
+    private:
+        std::mutex m_mutex;
+        PerfStages m_stages;
+        size_t m_files{0};
+    };
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "fs.h"
+#include "options.h"
+
+namespace cin
+{
+    /**
+     * Probe @p paths and log what encoding them would take.
+     *
+     * Logs total audio hours, a histogram of file sizes, a breakdown by
+     * channels, sample rate and bit depth, and a wall time estimate. The
+     * estimate divides the audio of each stream layout by the LAME throughput
+     * of one core, calibrated by encoding a few seconds of synthetic audio with
+     * the same settings, and spreads the files over all cores. Nothing is
+     * written apart from the probe cache.
+     *
+     * @param paths WAV files to plan for.
+     * @param options Settings the batch would run with.
+     */
+    void plan_batch(const Paths& paths, const Options& options);
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "fs.h"
+#include "options.h"
+
+namespace cin
+{
+    /**
+     * Stream parameters of a WAV file as found in its header.
+     */
+    struct WavInfo {
+        /** Number of channels, 0 if the file is not a WAV file we can probe. */
+        int num_channels;
+        /** Sample rate in Hz. */
+        int sample_rate;
+        /** Bits per sample. */
+        int bits_per_sample;
+        /** true for IEEE float samples, false for integer PCM. */
+        bool float_samples;
+        /** Number of frames in the data chunk. */
+        uint64_t num_frames;
+
+        /** Return the duration in seconds. */
+        double duration() const
+        {
+            return sample_rate > 0 ? 1.0 * num_frames / sample_rate : 0.0;
+        }
+    };
+
+    /**
+     * Read the stream parameters of @p path from its RIFF header.
+     *
+     * Only the first 4 KiB and the headers of chunks beyond them are read, no
+     * libsndfile state is set up. Files that are no PCM or float RIFF/WAVE,
+     * including RF64, are reported as not probed and still go to WavFile.
+     *
+     * @param path Path of the file.
+     * @param[out] info Parameters, num_channels is 0 if probing failed.
+     * @return true if @p path is a WAV file whose header could be parsed.
+     */
+    bool probe_wav(const std::filesystem::path& path, WavInfo& info);
+
+    /**
+     * Persistent cache of probe results.
+     *
+     * Entries are keyed by device and inode and are valid as long as size and
+     * modification time match, so renamed or moved files still hit. Failed
+     * probes are cached as well. Losing the cache only costs probing again, so
+     * new entries are appended in batches and never synced.
+     */
+    class ProbeCache {
+    public:
+        /**
+         * Open or create the cache at @p path and load existing entries.
+         *
+         * @param path Location of the cache file.
+         * @throws OutputFile::CouldNotWrite if the cache cannot be opened.
+         */
+        explicit ProbeCache(const std::filesystem::path& path);
+
+        ProbeCache(const ProbeCache&) = delete;
+        ProbeCache& operator=(const ProbeCache&) = delete;
+
+        /**
+         * Append pending entries and close the cache.
+         */
+        ~ProbeCache();
+
+        /**
+         * Return the parameters of @p input, probing it on a miss. Safe to
+         * call from multiple threads.
+         *
+         * @param input Path of the input file.
+         * @param[out] info Parameters, as for probe_wav().
+         * @return true if @p input is a WAV file whose header could be parsed.
+         */
+        bool probe(const std::filesystem::path& input, WavInfo& info);
+
+        /**
+         * Append entries added since the last flush to the cache file.
+         *
+         * @throws OutputFile::CouldNotWrite in case of I/O errors.
+         */
+        void flush();
+
+    private:
+        struct Key {
+            uint64_t device;
+            uint64_t inode;
+
+            bool operator==(const Key& other) const
+            {
+                return device == other.device && inode == other.inode;
+            }
+        };
+
+        struct KeyHash {
+            size_t operator()(const Key& key) const
+            {
+                return std::hash<uint64_t>{}(key.inode * 0x9e3779b97f4a7c15ULL ^ key.device);
+            }
+        };
+
+        struct Entry {
+            FileStamp stamp;
+            WavInfo info;
+        };
+
+        void flush_locked();
+
+        std::filesystem::path m_path;
+        int m_fd{-1};
+        std::mutex m_mutex;
+        std::unordered_map<Key, Entry, KeyHash> m_entries;
+        std::string m_pending;
+        size_t m_hits{0};
+        size_t m_misses{0};
+    };
+
+    /**
+     * Open the probe cache @p options ask for.
+     *
+     * @param options Settings naming the cache, by default .probe-cache in the
+     *   output (or input) directory.
+     * @return The cache, nullptr if disabled or it cannot be opened.
+     */
+    std::unique_ptr<ProbeCache> open_probe_cache(const Options& options);
+
+    /**
+     * Probe @p paths on all cores.
+     *
+     * @param paths Input files.
+     * @param cache Cache to consult and fill, nullptr to read every header.
+     * @return Parameters of each path in the same order, num_channels is 0
+     *   where probing failed.
+     */
+    std::vector<WavInfo> probe_files(const Paths& paths, ProbeCache* cache);
+}
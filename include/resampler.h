@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "arena.h"
+#include "buffer.h"
+#include "options.h"
+
+namespace cin
+{
+    /**
+     * Polyphase FIR sample rate converter for interleaved 16 bit PCM.
+     *
+     * The rate ratio is reduced to L/M and a windowed-sinc prototype is split
+     * into L phases, each output sample is then one dot product over a phase.
+     * Filter banks are immutable and shared between all instances with the
+     * same ratio and quality, per-stream state is owned by each instance, so
+     * one Resampler per worker can run concurrently.
+     */
+    class Resampler {
+    public:
+        /**
+         * Construct a resampler.
+         *
+         * @param input_rate Input sample rate in Hz.
+         * @param output_rate Output sample rate in Hz.
+         * @param num_channels Number of interleaved channels.
+         * @param quality Filter length and window.
+         * @param max_block_frames Largest number of frames passed to process().
+         * @param arena Arena for the per-stream history, must outlive this.
+         * @throws cin::Encoder::UnsupportedFormat if the rate ratio cannot be
+         *   reduced to a reasonable number of phases.
+         */
+        Resampler(int input_rate, int output_rate, int num_channels, ResampleQuality quality,
+            size_t max_block_frames, Arena& arena);
+
+        /**
+         * Return the largest number of frames process() or flush() produce.
+         *
+         * @param input_frames Number of input frames per call.
+         * @return Upper bound of output frames.
+         */
+        size_t max_output_frames(size_t input_frames) const;
+
+        /**
+         * Convert a block of samples.
+         *
+         * @param input Interleaved samples, @p num_frames * channels.
+         * @param num_frames Number of input frames, at most max_block_frames.
+         * @param[out] output Interleaved output, resized to the frames produced.
+         * @return Number of output frames.
+         */
+        size_t process(const int16_t* input, size_t num_frames, Buffer<int16_t>& output);
+
+        /**
+         * Drain the filter delay at the end of the stream.
+         *
+         * @param[out] output Interleaved output, resized to the frames produced.
+         * @return Number of output frames.
+         */
+        size_t flush(Buffer<int16_t>& output);
+
+        /**
+         * Check if @p rate can be passed to LAME as output sample rate.
+         *
+         * @param rate Sample rate in Hz.
+         * @return true for the MPEG-1/2/2.5 sample rates.
+         */
+        static bool is_mp3_rate(int rate);
+
+        /**
+         * Pick the MP3 rate to convert @p rate to if LAME cannot take it.
+         *
+         * @param rate Input sample rate in Hz.
+         * @return 44100 for multiples of 44.1 kHz, 48000 otherwise, or @p rate
+         *   itself if it is an MP3 rate.
+         */
+        static int default_output_rate(int rate);
+
+        /**
+         * Polyphase coefficients for one rate ratio and quality, opaque.
+         */
+        struct FilterBank;
+
+    private:
+        size_t run(size_t available, Buffer<int16_t>& output);
+
+        std::shared_ptr<const FilterBank> m_filter;
+        int m_channels;
+        size_t m_max_block_frames;
+        size_t m_stride;
+        Buffer<float> m_history;
+        size_t m_length{0};
+        size_t m_index;
+        size_t m_phase{0};
+        uint64_t m_frames_in{0};
+        uint64_t m_frames_out{0};
+    };
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace cin
+{
+    /**
+     * Hands files to encoder workers, largest first, within a memory budget.
+     *
+     * Every job carries an estimate of the buffer bytes it keeps in flight. A
+     * job is only admitted while the admitted estimates fit the budget, so
+     * parallelism drops instead of the process running out of memory. A job
+     * larger than the budget on its own still runs, alone.
+     */
+    class BatchScheduler {
+    public:
+        /**
+         * Construct a scheduler.
+         *
+         * @param costs Relative encode time of each job, largest go first.
+         * @param bytes Estimated in-flight bytes of each job.
+         * @param budget Budget in bytes, 0 for unlimited.
+         */
+        BatchScheduler(const std::vector<uint64_t>& costs, std::vector<uint64_t> bytes, uint64_t budget);
+
+        /**
+         * Wait until a job fits the budget and admit it. Safe to call from
+         * multiple threads.
+         *
+         * @param[out] index Index of the admitted job.
+         * @return false once every job was admitted.
+         */
+        bool next(size_t& index);
+
+        /**
+         * Release the budget of a job returned by next().
+         *
+         * @param index Index of the finished job.
+         */
+        void done(size_t index);
+
+        /**
+         * Return the largest sum of admitted estimates so far.
+         *
+         * @return Bytes.
+         */
+        uint64_t peak_bytes() const;
+
+        /**
+         * Return how often a worker waited for budget to be released.
+         *
+         * @return Number of waits.
+         */
+        size_t num_waits() const;
+
+    private:
+        bool fits(size_t index) const;
+
+        std::vector<uint64_t> m_bytes;
+        uint64_t m_budget;
+        std::vector<size_t> m_order;
+        std::vector<bool> m_taken;
+        size_t m_head{0};
+        uint64_t m_in_flight{0};
+        uint64_t m_peak{0};
+        size_t m_waits{0};
+        mutable std::mutex m_mutex;
+        std::condition_variable m_released;
+    };
+}
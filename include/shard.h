@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include "fs.h"
+#include "options.h"
+
+namespace cin
+{
+    /**
+     * Inputs of one shard of a corpus split across independent processes.
+     */
+    struct Shard {
+        /** Inputs of this shard. */
+        Paths paths;
+        /** Estimated work of this shard, in samples. */
+        uint64_t cost{0};
+        /** Estimated work of the whole corpus, in samples. */
+        uint64_t total_cost{0};
+        /** Duration of the inputs of this shard. */
+        double audio_seconds{0.0};
+        /** Size of the inputs of this shard. */
+        uint64_t input_bytes{0};
+        /** Number of inputs of the whole corpus. */
+        size_t total_files{0};
+        /**
+         * Hash of the relative paths and estimated work of the whole corpus.
+         * Shards that disagree on it may have split it differently.
+         */
+        uint64_t corpus_hash{0};
+    };
+
+    /**
+     * Select shard options.shard_index of options.shard_count from @p paths.
+     *
+     * Every shard probes the whole corpus and computes the same split without
+     * talking to the others. Inputs are taken largest first and go to the
+     * shard their stable_hash() names unless that shard is already more than
+     * the input's cost ahead of the least loaded one, which then takes it.
+     * Shards end up within about one large file of each other in estimated
+     * encode time, and most inputs keep their shard when the corpus grows.
+     * Where an input goes depends on the whole corpus, so shards that
+     * enumerate or probe it while files arrive can disagree. The corpus hash
+     * lets merge_shard_summaries() detect that.
+     *
+     * @param paths All inputs, in any order.
+     * @param options Shard index and count, input root and probe cache.
+     * @return The inputs of this shard in the order they were assigned.
+     */
+    Shard select_shard(const Paths& paths, const Options& options);
+
+    /**
+     * Write the summary of this shard's run for merge_shard_summaries().
+     *
+     * The summary goes to options.shard_summary, by default
+     * shard-<index>-of-<count>.summary in the output (or input) directory,
+     * as "key value" lines.
+     *
+     * @param shard Shard returned by select_shard().
+     * @param failed Number of inputs that failed.
+     * @param wall_seconds Time the shard took to encode.
+     * @param options Settings naming the summary.
+     * @throws OutputFile::CouldNotWrite if the summary cannot be written.
+     */
+    void write_shard_summary(const Shard& shard, size_t failed, double wall_seconds, const Options& options);
+
+    /**
+     * Combine the *.summary files in @p directory and print one report.
+     *
+     * @param directory Directory the shards wrote their summaries to.
+     * @return EXIT_SUCCESS if all shards reported on the same corpus, their
+     *   inputs add up to it and no input failed.
+     */
+    int merge_shard_summaries(const std::filesystem::path& directory);
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include "fs.h"
+#include "options.h"
+
+namespace cin
+{
+    /**
+     * The sample processing kernels of one instruction set.
+     *
+     * Every variant produces bit-identical results: floating point sums are
+     * evaluated in the order of the 128 bit SSE2 kernels, wider variants
+     * only widen loads, conversions and multiplications, and conversions to
+     * 16 bit clamp before rounding. Kernels without a profitable wider form
+     * reuse the next narrower one.
+     */
+    struct Kernels {
+        /** Instruction set of this table. */
+        SimdLevel level;
+
+        /**
+         * Mix interleaved frames down to stereo, rounding and saturating.
+         * @p left and @p right hold eight coefficients, 16 byte aligned,
+         * zero beyond @p channels.
+         */
+        void (*downmix)(const float* left, const float* right, int channels,
+            const int16_t* input, size_t num_frames, int16_t* output);
+
+        /** Scale samples in place, rounding and saturating to 16 bit. */
+        void (*apply_gain)(int16_t* samples, size_t count, float gain);
+
+        /** Largest absolute sample value. */
+        int (*sample_peak)(const int16_t* samples, size_t count);
+
+        /** Widen per channel minima and maxima, for 1 or 2 channels. */
+        void (*min_max)(const int16_t* samples, size_t num_frames, int channels, int16_t* mins, int16_t* maxs);
+
+        /** Dot product of two float vectors. */
+        float (*dot)(const float* a, const float* b, size_t n);
+
+        /**
+         * Largest magnitude of four interpolated phases of a 12 sample
+         * window, @p coefficients holds 12 taps of 4 phases, 16 byte aligned.
+         */
+        float (*interpolated_peak)(const float* window, const float* coefficients);
+
+        /** Index of the first sample above @p threshold in magnitude, @p count if none. */
+        size_t (*find_first_loud)(const int16_t* samples, size_t count, int16_t threshold);
+
+        /** One past the index of the last sample above @p threshold in magnitude, 0 if none. */
+        size_t (*find_last_loud)(const int16_t* samples, size_t count, int16_t threshold);
+    };
+
+    /**
+     * Thrown if kernels are requested that the CPU or the build lacks.
+     */
+    class UnsupportedSimd : public std::runtime_error {
+    public:
+        /**
+         * Construct UnsupportedSimd error.
+         *
+         * @param msg Error message.
+         */
+        UnsupportedSimd(const std::string& msg) : std::runtime_error{msg} {}
+    };
+
+    /**
+     * Return the best instruction set of this CPU. Detected once.
+     *
+     * @return Widest level with kernels in this build that the CPU and the
+     *   operating system support.
+     */
+    SimdLevel detect_simd();
+
+    /**
+     * Return the kernels of a specific instruction set.
+     *
+     * @param level Instruction set, at most detect_simd().
+     * @return Kernel table.
+     * @throws UnsupportedSimd if @p level is beyond detect_simd().
+     */
+    const Kernels& kernels_for(SimdLevel level);
+
+    /**
+     * Return the kernels in use, those of detect_simd() unless overridden.
+     *
+     * @return Kernel table.
+     */
+    const Kernels& simd();
+
+    /**
+     * Use the kernels of @p level from now on. Must be called before any
+     * worker starts.
+     *
+     * @param level Instruction set, at most detect_simd().
+     * @throws UnsupportedSimd if @p level is beyond detect_simd().
+     */
+    void select_simd(SimdLevel level);
+
+    /**
+     * Return the name of an instruction set as accepted by --simd.
+     *
+     * @param level Instruction set.
+     * @return Name, e.g. "avx2".
+     */
+    const char* simd_name(SimdLevel level);
+
+    /**
+     * Run every kernel variant the CPU supports over the samples of
+     * @p paths and compare the results with the scalar kernels byte by byte.
+     * Prints one line per instruction set to stdout.
+     *
+     * @param paths WAV files to read.
+     * @return EXIT_SUCCESS if all variants agree on all files.
+     */
+    int check_simd(const Paths& paths);
+}
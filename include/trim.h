@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "arena.h"
+#include "buffer.h"
+
+namespace cin
+{
+    /**
+     * Drop leading and trailing silence from a stream of blocks.
+     *
+     * A frame is silent if no channel exceeds the threshold. Leading silence
+     * is dropped as it is read. Silence after the last loud frame is held
+     * back since it might turn out to be a pause: it is released once sound
+     * follows or it grows beyond a cap, and cut to the minimum tail length at
+     * the end of the stream.
+     */
+    class SilenceTrimmer {
+    public:
+        /**
+         * Construct a trimmer.
+         *
+         * @param num_channels Number of interleaved channels.
+         * @param sample_rate Sample rate in Hz.
+         * @param threshold_db Level in dBFS at or below which samples count
+         *   as silence.
+         * @param min_tail Seconds of silence kept after the last loud frame.
+         * @param arena Arena for held back samples, must outlive this.
+         */
+        SilenceTrimmer(int num_channels, int sample_rate, double threshold_db, double min_tail, Arena& arena);
+
+        /**
+         * Feed a block and return how many frames may be passed on.
+         *
+         * @param samples Interleaved samples, @p num_frames * channels.
+         * @param num_frames Number of frames.
+         * @return Number of frames available in output(), possibly 0.
+         */
+        size_t process(const int16_t* samples, size_t num_frames);
+
+        /**
+         * End the stream and return the kept part of the tail.
+         *
+         * @return Number of frames available in output().
+         */
+        size_t finish();
+
+        /**
+         * Return the frames produced by the last process() or finish() call.
+         *
+         * @return Interleaved samples, valid until the next call.
+         */
+        int16_t* output();
+
+        /**
+         * Return the number of silent frames dropped at the start.
+         *
+         * @return Number of frames.
+         */
+        uint64_t leading_frames() const;
+
+        /**
+         * Return the number of silent frames dropped at the end.
+         *
+         * @return Number of frames, 0 before finish().
+         */
+        uint64_t trailing_frames() const;
+
+    private:
+        void append(Buffer<int16_t>& buffer, const int16_t* samples, size_t num_frames);
+
+        int m_channels;
+        int16_t m_threshold;
+        size_t m_min_tail;
+        size_t m_max_pending;
+        bool m_started{false};
+        Buffer<int16_t> m_pending;
+        Buffer<int16_t> m_output;
+        uint64_t m_leading{0};
+        uint64_t m_trailing{0};
+    };
+}
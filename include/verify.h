@@ -0,0 +1,138 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "options.h"
+
+namespace cin
+{
+    /**
+     * Samples LAME was given for one file, kept to check the decoded MP3.
+     *
+     * Only a window of every stride is kept, which is enough to estimate
+     * the SNR of a lossy encode without holding the whole stream.
+     */
+    class VerifyReference {
+    public:
+        /** Frames per compared window, one MP3 frame. */
+        static constexpr size_t window_frames{1152};
+
+        /** Distance between the starts of two windows in frames. */
+        static constexpr size_t stride_frames{32 * window_frames};
+
+        /**
+         * Construct an empty reference.
+         *
+         * @param input Path of the source file, for the report.
+         * @param output Path of the MP3 once it is published.
+         */
+        VerifyReference(const std::filesystem::path& input, const std::filesystem::path& output);
+
+        /**
+         * Describe the stream LAME encodes, call before capture().
+         *
+         * @param num_channels Number of channels.
+         * @param sample_rate Sample rate of the MP3.
+         * @param encoder_delay Frames of silence LAME prepends.
+         */
+        void start(int num_channels, int sample_rate, int encoder_delay);
+
+        /**
+         * Record a block of samples passed to LAME.
+         *
+         * @param samples Interleaved samples, @p num_frames * channels.
+         * @param num_frames Number of frames.
+         */
+        void capture(const int16_t* samples, size_t num_frames);
+
+        std::filesystem::path input;
+        std::filesystem::path output;
+        int num_channels{0};
+        int sample_rate{0};
+        int encoder_delay{0};
+        uint64_t num_frames{0};
+
+        /** Windows starting at multiples of stride_frames, back to back. */
+        std::vector<int16_t> windows;
+    };
+
+    /**
+     * Decodes finished MP3 files on its own threads and checks them.
+     *
+     * Each file is checked for a clean chain of frame headers, frames the
+     * decoder rejects, a duration matching the source and an SNR estimate
+     * over the reference windows. Failures are logged and listed in a report.
+     */
+    class Verifier {
+    public:
+        /** SNR below which a file counts as corrupted. */
+        static constexpr double min_snr_db{6.0};
+
+        /**
+         * Start the verification threads.
+         *
+         * @param report Path of the failure report written by wait().
+         * @param policy Durability of the report.
+         * @param num_threads Number of decoding threads, at least one is used.
+         */
+        Verifier(const std::filesystem::path& report, FsyncPolicy policy, unsigned int num_threads);
+
+        Verifier(const Verifier&) = delete;
+        Verifier& operator=(const Verifier&) = delete;
+
+        /**
+         * Finish pending files and stop the threads.
+         */
+        ~Verifier();
+
+        /**
+         * Queue a published MP3 for verification. Safe to call from multiple
+         * threads.
+         *
+         * @param reference Samples captured while encoding the file.
+         * @param on_verified Called on a verification thread with whether
+         *   the file passed, must not throw.
+         */
+        void submit(VerifyReference&& reference, std::function<void(bool)> on_verified = {});
+
+        /**
+         * Write the report of every file that failed so far. Callers wait for
+         * the outcome of their own files through the callback of submit().
+         *
+         * @throws OutputFile::CouldNotWrite if the report cannot be written.
+         */
+        void report();
+
+    private:
+        struct Failure {
+            std::filesystem::path output;
+            std::string reason;
+        };
+
+        struct Pending {
+            VerifyReference reference;
+            std::function<void(bool)> on_verified;
+        };
+
+        void run();
+
+        std::filesystem::path m_report;
+        FsyncPolicy m_policy;
+        std::mutex m_mutex;
+        std::condition_variable m_pending;
+        std::mutex m_report_mutex;
+        std::deque<Pending> m_queue;
+        size_t m_verified{0};
+        bool m_stop{false};
+        std::vector<Failure> m_failures;
+        std::vector<std::thread> m_threads;
+    };
+}
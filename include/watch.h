@@ -0,0 +1,100 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include "encoder.h"
+#include "fs.h"
+#include "options.h"
+#include "worker_pool.h"
+
+namespace cin
+{
+    /**
+     * Encodes WAV files as they are written to a directory.
+     *
+     * The input directory, and with --recursive every directory below it, is
+     * watched with inotify for files closed after writing or moved in. A file
+     * is queued to the worker pool once it has been quiet and unchanged in
+     * size and modification time for the settle time, so uploads that close
+     * and reopen the file are encoded once they are complete. Files are
+     * never rescanned. Only at start-up, and after an inotify queue overflow,
+     * are inputs without an up to date MP3 picked up by a scan. With an
+     * output archive, the outputs are packed when watching stops and stay in
+     * the directory next to the archive for the next start-up scan.
+     */
+    class Watcher {
+    public:
+        /**
+         * Thrown if the directory cannot be watched.
+         */
+        class CouldNotWatch : public std::runtime_error {
+        public:
+            /**
+             * Construct CouldNotWatch.
+             *
+             * @param msg Error message.
+             */
+            CouldNotWatch(const std::string& msg) : std::runtime_error{msg} {}
+        };
+
+        /**
+         * Start watching options.input.
+         *
+         * @param options Encoder settings, input is the watched directory.
+         * @throws CouldNotWatch if inotify cannot be set up.
+         */
+        explicit Watcher(const Options& options);
+
+        Watcher(const Watcher&) = delete;
+        Watcher& operator=(const Watcher&) = delete;
+
+        /**
+         * Finish queued files and stop watching.
+         */
+        ~Watcher();
+
+        /**
+         * Encode arriving files until SIGINT or SIGTERM.
+         */
+        void run();
+
+    private:
+        using clock = std::chrono::steady_clock;
+
+        struct Pending {
+            clock::time_point changed;
+            FileStamp stamp;
+        };
+
+        void add_watch(const std::filesystem::path& directory);
+        void scan(const std::filesystem::path& directory);
+        void read_events();
+        void note(const std::filesystem::path& path, clock::duration delay = clock::duration::zero());
+        void submit_settled();
+        void submit(const std::filesystem::path& path);
+
+        Options m_options;
+        Encoder m_encoder;
+        int m_fd{-1};
+        std::unordered_map<int, std::filesystem::path> m_directories;
+        std::map<std::filesystem::path, Pending> m_pending;
+        size_t m_queued{0};
+
+        // Files being encoded, a file written again meanwhile waits for it.
+        // Files another process holds in the ledger are noted again.
+        std::mutex m_mutex;
+        std::condition_variable m_idle;
+        std::set<std::filesystem::path> m_running;
+        Paths m_held;
+
+        // Declared last so workers stop before anything they use goes away.
+        WorkerPool m_pool;
+    };
+}
@@ -1,9 +1,11 @@
 #pragma once
 
+#include <cstdint>
 #include <filesystem>
 #include <memory>
-#include <vector>
+#include <stdexcept>
 #include <sndfile.h>
+#include "buffer.h"
 
 namespace cin
 {
@@ -35,6 +37,18 @@ namespace cin
          */
         WavFile(const std::filesystem::path& path);
 
+        /**
+         * Construct a new reader of a WAV file held in memory, such as an
+         * archive member.
+         *
+         * @param data Contents of the file, must outlive the reader.
+         * @param size Size of @p data in bytes.
+         * @throws CouldNotRead if @p data cannot be parsed.
+         * @throws cin::Encoder::UnsupportedFormat if @p data is an
+         *   unsupported WAV file format.
+         */
+        WavFile(const uint8_t* data, size_t size);
+
         /**
          * Return number of channels.
          *
@@ -62,14 +76,25 @@ namespace cin
          * Read samples @p num_frames frames into @p samples. A frame consists
          * of as many samples as number of channels.
          *
-         * @param samples Output data vector that is resized if necessary.
+         * @param samples Output buffer, resized to the number of samples read.
          * @param num_frames Number of frames to read.
-         * @return Size of @p samples in number of bytes.
+         * @return Size of @p samples in number of samples.
          */
-        size_t read_samples(std::vector<int16_t>& samples, int num_frames) const;
+        size_t read_samples(Buffer<int16_t>& samples, int num_frames) const;
 
     private:
+        struct Memory {
+            const uint8_t* data;
+            sf_count_t size;
+            sf_count_t position;
+        };
+
+        void check_format() const;
+
         SF_INFO m_info{0, 0, 0, 0, 0, 0};
+        // Read position of a file in memory, kept at a fixed address for
+        // libsndfile.
+        std::unique_ptr<Memory> m_memory;
         std::unique_ptr<SNDFILE, void(*)(SNDFILE *)> m_sf;
     };
 }
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "arena.h"
+#include "options.h"
+
+namespace cin
+{
+    /**
+     * Return the command line name of @p priority.
+     *
+     * @param priority Scheduling class.
+     * @return "interactive", "normal" or "bulk".
+     */
+    const char* priority_name(Priority priority);
+
+    /**
+     * Long lived encoder threads fed from a queue.
+     *
+     * Each worker owns an arena that is kept across tasks, so buffers are set
+     * up once per thread rather than once per file or job.
+     *
+     * Tasks are queued per priority class. A worker that becomes free takes
+     * the overdue task with the earliest deadline if there is one, otherwise
+     * the task with the earliest deadline, then the oldest, of the highest
+     * non-empty class. Since every task is one file, interactive work
+     * overtakes a backfill at the next file boundary without interrupting
+     * an encode.
+     */
+    class WorkerPool {
+    public:
+        /** Work item, runs on a worker with that worker's arena. */
+        using Task = std::function<void(Arena&)>;
+
+        using clock = std::chrono::steady_clock;
+
+        /**
+         * Time tasks of one class spent queued before a worker took them.
+         */
+        struct WaitStats {
+            /** Tasks started. */
+            size_t count{0};
+            /** Median wait over the recent tasks. */
+            double p50_ms{0.0};
+            /** 99th percentile wait over the recent tasks. */
+            double p99_ms{0.0};
+            /** Longest wait since the pool was started. */
+            double max_ms{0.0};
+            /** Tasks started after their deadline. */
+            size_t late{0};
+        };
+
+        /**
+         * Start the workers.
+         *
+         * @param num_workers Number of threads, at least one is started.
+         */
+        explicit WorkerPool(unsigned int num_workers);
+
+        WorkerPool(const WorkerPool&) = delete;
+        WorkerPool& operator=(const WorkerPool&) = delete;
+
+        /**
+         * Run the queued tasks and stop the workers.
+         */
+        ~WorkerPool();
+
+        /**
+         * Queue a task. Safe to call from multiple threads.
+         *
+         * @param task Task, must not throw.
+         * @param priority Class of the task.
+         * @param deadline Time by which the task should start.
+         */
+        void submit(Task task, Priority priority = Priority::normal, clock::time_point deadline = clock::time_point::max());
+
+        /**
+         * Return the number of workers.
+         *
+         * @return Number of threads.
+         */
+        size_t size() const;
+
+        /**
+         * Return queue wait times of one class. Safe to call from multiple
+         * threads.
+         *
+         * @param priority Class to report.
+         * @return Wait time statistics.
+         */
+        WaitStats wait_stats(Priority priority) const;
+
+    private:
+        static constexpr size_t num_classes{3};
+
+        // Percentiles are taken over this many of the most recent waits.
+        static constexpr size_t wait_samples{4096};
+
+        struct Entry {
+            Task task;
+            clock::time_point queued;
+        };
+
+        struct Class {
+            // Ordered by deadline, then by arrival.
+            std::map<std::pair<clock::time_point, uint64_t>, Entry> queue;
+            std::vector<float> waits;
+            size_t next_wait{0};
+            size_t count{0};
+            double max_ms{0.0};
+            size_t late{0};
+        };
+
+        void work();
+        bool empty() const;
+        Task take();
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_pending;
+        std::array<Class, num_classes> m_classes;
+        uint64_t m_sequence{0};
+        bool m_stop{false};
+        std::vector<std::thread> m_workers;
+    };
+}
@@ -0,0 +1,163 @@
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include "analysis_cache.h"
+#include "log.h"
+#include "output.h"
+
+namespace
+{
+    constexpr uint64_t multiplier{0x9e3779b97f4a7c15ULL};
+}
+
+cin::ContentHash::ContentHash(uint64_t seed)
+: m_state{seed ^ 0xcbf29ce484222325ULL}
+{}
+
+void cin::ContentHash::mix(uint64_t word)
+{
+    m_state = (m_state ^ word) * multiplier;
+    m_state ^= m_state >> 29;
+}
+
+void cin::ContentHash::update(const void* data, size_t size)
+{
+    const auto* bytes{static_cast<const uint8_t*>(data)};
+    m_length += size;
+
+    while (size > 0 && m_num_pending > 0) {
+        m_pending |= static_cast<uint64_t>(*bytes++) << (8 * m_num_pending);
+        size--;
+
+        if (++m_num_pending == sizeof(uint64_t)) {
+            mix(m_pending);
+            m_pending = 0;
+            m_num_pending = 0;
+        }
+    }
+
+    for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t), bytes += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, bytes, sizeof(word));
+        mix(word);
+    }
+
+    for (; size > 0; --size) {
+        m_pending |= static_cast<uint64_t>(*bytes++) << (8 * m_num_pending++);
+    }
+}
+
+uint64_t cin::ContentHash::value() const
+{
+    uint64_t state{(m_state ^ m_pending) * multiplier};
+    state ^= m_length;
+    state = (state ^ (state >> 31)) * multiplier;
+    return state ^ (state >> 33);
+}
+
+cin::AnalysisCache::AnalysisCache(const std::filesystem::path& path, FsyncPolicy policy)
+: m_path{path}
+, m_policy{policy}
+{
+    std::ifstream existing{path};
+    std::string line;
+
+    // "M <hash> <lufs> <dbtp>" records a measurement, "F <size> <mtime> <seed>
+    // <hash> <path>" a file. Torn lines from a crash are skipped.
+    while (std::getline(existing, line)) {
+        std::istringstream fields{line};
+        std::string type;
+        fields >> type;
+
+        if (type == "M") {
+            uint64_t hash{0};
+            Entry entry{};
+
+            if (fields >> std::hex >> hash >> std::dec >> entry.integrated_lufs >> entry.true_peak_dbtp) {
+                m_measurements[hash] = entry;
+            }
+        }
+        else if (type == "F") {
+            File file{};
+            std::string input;
+
+            if (fields >> file.stamp.size >> file.stamp.mtime >> std::hex >> file.seed >> file.hash
+                && fields.get() == ' ' && std::getline(fields, input)) {
+                m_files[input] = file;
+            }
+        }
+    }
+
+    m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+    if (m_fd < 0) {
+        throw OutputFile::CouldNotWrite{fmt::format("Could not open analysis cache {}: {}", path.string(), std::strerror(errno))};
+    }
+
+    cin::log::debug("Loaded {} measurements for {} files from {}", m_measurements.size(), m_files.size(), path.string());
+}
+
+cin::AnalysisCache::~AnalysisCache()
+{
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+}
+
+bool cin::AnalysisCache::find(const std::filesystem::path& input, uint64_t seed, Entry& entry) const
+{
+    FileStamp current{};
+
+    if (!stamp_file(input, current)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock{m_mutex};
+    const auto file{m_files.find(input.string())};
+
+    if (file == m_files.end() || !(file->second.stamp == current) || file->second.seed != seed) {
+        return false;
+    }
+
+    const auto measurement{m_measurements.find(file->second.hash)};
+
+    if (measurement == m_measurements.end()) {
+        return false;
+    }
+
+    entry = measurement->second;
+    return true;
+}
+
+void cin::AnalysisCache::store(const std::filesystem::path& input, uint64_t seed, uint64_t hash, const Entry& entry)
+{
+    FileStamp current{};
+
+    if (!stamp_file(input, current)) {
+        return;
+    }
+
+    // Silence measures as -inf which does not survive a round trip through
+    // the text file, store it as a value far below the gate instead.
+    const auto finite{[](double value) { return std::isfinite(value) ? value : -999.0; }};
+    const auto lines{fmt::format("M {:x} {:.4f} {:.4f}\nF {} {} {:x} {:x} {}\n",
+        hash, finite(entry.integrated_lufs), finite(entry.true_peak_dbtp),
+        current.size, current.mtime, seed, hash, input.string())};
+
+    std::lock_guard<std::mutex> lock{m_mutex};
+
+    if (::write(m_fd, lines.data(), lines.size()) != static_cast<ssize_t>(lines.size())) {
+        throw OutputFile::CouldNotWrite{fmt::format("Could not append to analysis cache {}: {}", m_path.string(), std::strerror(errno))};
+    }
+
+    if (m_policy != FsyncPolicy::none && ::fdatasync(m_fd) < 0) {
+        throw OutputFile::CouldNotWrite{fmt::format("Could not sync analysis cache {}: {}", m_path.string(), std::strerror(errno))};
+    }
+
+    m_measurements[hash] = entry;
+    m_files[input.string()] = {current, seed, hash};
+}
@@ -0,0 +1,555 @@
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "archive.h"
+#include "arena.h"
+#include "log.h"
+#include "output.h"
+
+namespace
+{
+    constexpr size_t tar_block{512};
+    constexpr size_t copy_chunk{1024 * 1024};
+
+    // Long names and pax headers beyond this are corrupt, not names.
+    constexpr uint64_t max_tar_record{1024 * 1024};
+
+    // Deflate cannot expand by more than this, larger claimed sizes are
+    // corrupt or malicious and would be allocated in full by read().
+    constexpr uint64_t max_inflate_ratio{1032};
+    constexpr uint32_t zip_local_header{0x04034b50};
+    constexpr uint32_t zip_central_header{0x02014b50};
+    constexpr uint32_t zip_end_of_directory{0x06054b50};
+    constexpr uint32_t zip64_locator{0x07064b50};
+    constexpr uint32_t zip64_end_of_directory{0x06064b50};
+
+    uint16_t le16(const uint8_t* p)
+    {
+        return static_cast<uint16_t>(p[0] | (p[1] << 8));
+    }
+
+    uint32_t le32(const uint8_t* p)
+    {
+        return le16(p) | (static_cast<uint32_t>(le16(p + 2)) << 16);
+    }
+
+    uint64_t le64(const uint8_t* p)
+    {
+        return le32(p) | (static_cast<uint64_t>(le32(p + 4)) << 32);
+    }
+
+    std::string field(const uint8_t* p, size_t size)
+    {
+        const auto* text{reinterpret_cast<const char*>(p)};
+        return std::string{text, strnlen(text, size)};
+    }
+
+    // Octal, or big endian binary if the top bit is set (GNU, sizes >= 8 GiB).
+    uint64_t tar_number(const uint8_t* p, size_t size)
+    {
+        uint64_t value{0};
+
+        if (p[0] & 0x80) {
+            for (size_t i = 0; i < size; ++i) {
+                value = (value << 8) | (i == 0 ? p[i] & 0x7f : p[i]);
+            }
+
+            return value;
+        }
+
+        for (size_t i = 0; i < size && p[i] != '\0' && p[i] != ' '; ++i) {
+            value = (value << 3) | (p[i] - '0');
+        }
+
+        return value;
+    }
+
+    uint64_t tar_checksum(const uint8_t* header)
+    {
+        uint64_t sum{0};
+
+        for (size_t i = 0; i < tar_block; ++i) {
+            sum += i >= 148 && i < 156 ? ' ' : header[i];
+        }
+
+        return sum;
+    }
+
+    uint64_t round_up(uint64_t size)
+    {
+        return (size + tar_block - 1) / tar_block * tar_block;
+    }
+
+    // Value of the "path" record of a pax extended header, "<len> path=<value>\n".
+    std::string pax_path(const std::string& records)
+    {
+        for (size_t start = 0; start < records.size();) {
+            const size_t length{std::strtoul(records.c_str() + start, nullptr, 10)};
+            const size_t key{records.find(' ', start)};
+
+            if (length == 0 || key == std::string::npos || key > start + length) {
+                break;
+            }
+
+            const std::string record{records.substr(key + 1, start + length - key - 2)};
+
+            if (record.rfind("path=", 0) == 0) {
+                return record.substr(5);
+            }
+
+            start += length;
+        }
+
+        return {};
+    }
+
+    void put_octal(uint8_t* p, size_t size, uint64_t value)
+    {
+        // Binary for values that do not fit size - 1 octal digits.
+        if (size < 12 || value < (1ULL << (3 * (size - 1)))) {
+            std::snprintf(reinterpret_cast<char*>(p), size, "%0*llo", static_cast<int>(size - 1),
+                static_cast<unsigned long long>(value));
+            return;
+        }
+
+        for (size_t i = size; i-- > 1;) {
+            p[i] = static_cast<uint8_t>(value & 0xff);
+            value >>= 8;
+        }
+
+        p[0] = 0x80;
+    }
+
+    void write_tar_header(cin::OutputFile& file, const std::string& name, uint64_t size, int64_t mtime, char type)
+    {
+        uint8_t header[tar_block]{};
+        std::memcpy(header, name.data(), std::min(name.size(), size_t{100}));
+        put_octal(header + 100, 8, 0644);
+        put_octal(header + 108, 8, 0);
+        put_octal(header + 116, 8, 0);
+        put_octal(header + 124, 12, size);
+        put_octal(header + 136, 12, static_cast<uint64_t>(std::max<int64_t>(mtime, 0)));
+        header[156] = static_cast<uint8_t>(type);
+        std::memcpy(header + 257, "ustar  ", 8);
+        std::snprintf(reinterpret_cast<char*>(header + 148), 8, "%06llo", static_cast<unsigned long long>(tar_checksum(header)));
+        header[155] = ' ';
+        file.write(header, sizeof(header));
+    }
+
+    void pad_tar(cin::OutputFile& file, uint64_t size)
+    {
+        static const uint8_t zeros[tar_block]{};
+        file.write(zeros, round_up(size) - size);
+    }
+}
+
+cin::Archive::Archive(const std::filesystem::path& path)
+: m_path{path}
+{
+    m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (m_fd < 0) {
+        throw CouldNotRead{fmt::format("Could not open {}: {}", path.string(), std::strerror(errno))};
+    }
+
+    struct stat st{};
+    ::fstat(m_fd, &st);
+    m_file_size = static_cast<uint64_t>(st.st_size);
+
+    try {
+        if (path.extension() == ".zip") {
+            index_zip();
+        }
+        else {
+            index_tar();
+        }
+    }
+    catch (...) {
+        ::close(m_fd);
+        throw;
+    }
+
+    cin::log::info("Found {} WAV files in {}", m_names.size(), path.string());
+}
+
+cin::Archive::~Archive()
+{
+    ::close(m_fd);
+}
+
+void cin::Archive::read_at(uint64_t offset, void* data, size_t size) const
+{
+    auto* bytes{static_cast<uint8_t*>(data)};
+
+    while (size > 0) {
+        const ssize_t n{::pread(m_fd, bytes, size, static_cast<off_t>(offset))};
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (n <= 0) {
+            throw CouldNotRead{fmt::format("Could not read {} at offset {}: {}",
+                m_path.string(), offset, n == 0 ? "unexpected end of file" : std::strerror(errno))};
+        }
+
+        bytes += n;
+        size -= n;
+        offset += n;
+    }
+}
+
+void cin::Archive::add(const std::string& name, const Member& member)
+{
+    const std::filesystem::path relative{std::filesystem::path{name}.lexically_normal()};
+
+    if (relative.extension() != ".wav") {
+        return;
+    }
+
+    if (relative.is_absolute() || *relative.begin() == "..") {
+        cin::log::warn("Skipping {} in {}, it points outside the archive", name, m_path.string());
+        return;
+    }
+
+    // A later member of the same name replaces the earlier one, as tar
+    // extracts it.
+    const auto [entry, inserted]{m_members.insert_or_assign(relative.generic_string(), member)};
+
+    if (inserted) {
+        m_names.push_back(entry->first);
+    }
+}
+
+void cin::Archive::index_tar()
+{
+    uint8_t header[tar_block];
+    std::string next_name;
+
+    for (uint64_t offset = 0; offset + tar_block <= m_file_size;) {
+        read_at(offset, header, sizeof(header));
+
+        if (std::all_of(header, header + tar_block, [](uint8_t b) { return b == 0; })) {
+            break;
+        }
+
+        if (tar_number(header + 148, 8) != tar_checksum(header)) {
+            throw CouldNotRead{fmt::format("{} is not a tar archive or is corrupt at offset {}", m_path.string(), offset)};
+        }
+
+        const uint64_t size{tar_number(header + 124, 12)};
+        const uint64_t data{offset + tar_block};
+        const char type{static_cast<char>(header[156])};
+        std::string name{next_name};
+
+        if (name.empty()) {
+            // Only POSIX ustar has a prefix, GNU tar keeps other fields there.
+            const std::string prefix{std::memcmp(header + 257, "ustar", 6) == 0 ? field(header + 345, 155) : ""};
+            name = prefix.empty() ? field(header, 100) : prefix + "/" + field(header, 100);
+        }
+
+        // data is at most m_file_size, GNU binary sizes go up to 2^64 - 1.
+        if (size > m_file_size - data) {
+            throw CouldNotRead{fmt::format("{} is truncated in {}", name, m_path.string())};
+        }
+
+        if ((type == 'L' || type == 'x') && size > max_tar_record) {
+            throw CouldNotRead{fmt::format("{} has a corrupt header at offset {}", m_path.string(), offset)};
+        }
+
+        if (type == 'L' || type == 'x') {
+            // GNU long name or pax extended header for the next member.
+            std::string text(size, '\0');
+            read_at(data, text.data(), size);
+            next_name = type == 'L' ? field(reinterpret_cast<const uint8_t*>(text.data()), size) : pax_path(text);
+        }
+        else {
+            if (type == '0' || type == '\0' || type == '7') {
+                add(name, {data, size, size, false, false, 0});
+            }
+
+            next_name.clear();
+        }
+
+        offset = data + round_up(size);
+    }
+}
+
+void cin::Archive::index_zip()
+{
+    // The end of central directory record is followed by at most a 64 KiB
+    // comment.
+    const uint64_t tail_size{std::min<uint64_t>(m_file_size, 22 + 65535)};
+    std::vector<uint8_t> tail(tail_size);
+    read_at(m_file_size - tail_size, tail.data(), tail.size());
+
+    size_t end{SIZE_MAX};
+
+    for (size_t i = tail_size >= 22 ? tail_size - 22 + 1 : 0; i-- > 0;) {
+        if (le32(&tail[i]) == zip_end_of_directory) {
+            end = i;
+            break;
+        }
+    }
+
+    if (end == SIZE_MAX) {
+        throw CouldNotRead{fmt::format("{} is not a zip archive", m_path.string())};
+    }
+
+    uint64_t entries{le16(&tail[end + 10])};
+    uint64_t directory_size{le32(&tail[end + 12])};
+    uint64_t directory_offset{le32(&tail[end + 16])};
+
+    if ((entries == 0xffff || directory_size == 0xffffffff || directory_offset == 0xffffffff) && end >= 20
+            && le32(&tail[end - 20]) == zip64_locator) {
+        uint8_t record[56];
+        read_at(le64(&tail[end - 20 + 8]), record, sizeof(record));
+
+        if (le32(record) != zip64_end_of_directory) {
+            throw CouldNotRead{fmt::format("{} has a corrupt zip64 directory", m_path.string())};
+        }
+
+        entries = le64(record + 32);
+        directory_size = le64(record + 40);
+        directory_offset = le64(record + 48);
+    }
+
+    if (directory_size > m_file_size || directory_offset > m_file_size - directory_size) {
+        throw CouldNotRead{fmt::format("{} has a corrupt central directory", m_path.string())};
+    }
+
+    std::vector<uint8_t> directory(directory_size);
+    read_at(directory_offset, directory.data(), directory.size());
+
+    size_t p{0};
+
+    for (uint64_t i = 0; i < entries; ++i) {
+        if (p + 46 > directory.size() || le32(&directory[p]) != zip_central_header) {
+            throw CouldNotRead{fmt::format("{} has a corrupt central directory", m_path.string())};
+        }
+
+        const uint8_t* entry{&directory[p]};
+        const uint16_t flags{le16(entry + 8)};
+        const uint16_t method{le16(entry + 10)};
+        uint64_t compressed_size{le32(entry + 20)};
+        uint64_t size{le32(entry + 24)};
+        uint64_t local_offset{le32(entry + 42)};
+        const size_t name_length{le16(entry + 28)};
+        const size_t extra_length{le16(entry + 30)};
+        const size_t comment_length{le16(entry + 32)};
+
+        if (p + 46 + name_length + extra_length > directory.size()) {
+            throw CouldNotRead{fmt::format("{} has a corrupt central directory", m_path.string())};
+        }
+
+        const std::string name{reinterpret_cast<const char*>(entry + 46), name_length};
+
+        // Zip64 sizes and offset are present for those fields that overflowed.
+        for (size_t x = 0; x + 4 <= extra_length;) {
+            const uint8_t* extra{entry + 46 + name_length + x};
+            const size_t length{le16(extra + 2)};
+
+            if (le16(extra) == 0x0001) {
+                const uint8_t* value{extra + 4};
+
+                for (uint64_t* field : {&size, &compressed_size, &local_offset}) {
+                    if (*field == 0xffffffff && value + 8 <= extra + 4 + length) {
+                        *field = le64(value);
+                        value += 8;
+                    }
+                }
+            }
+
+            x += 4 + length;
+        }
+
+        p += 46 + name_length + extra_length + comment_length;
+
+        if (std::filesystem::path{name}.extension() != ".wav") {
+            continue;
+        }
+
+        if ((flags & 1) != 0 || (method != 0 && method != 8)) {
+            cin::log::warn("Skipping {} in {}, it is encrypted or compressed with method {}", name, m_path.string(), method);
+            continue;
+        }
+
+        uint8_t local[30];
+        read_at(local_offset, local, sizeof(local));
+
+        if (le32(local) != zip_local_header) {
+            throw CouldNotRead{fmt::format("{} has a corrupt header for {}", m_path.string(), name)};
+        }
+
+        // local_offset is below m_file_size, the read above succeeded.
+        const uint64_t data{local_offset + sizeof(local) + le16(local + 26) + le16(local + 28)};
+
+        if (data > m_file_size || compressed_size > m_file_size - data) {
+            throw CouldNotRead{fmt::format("{} is truncated in {}", name, m_path.string())};
+        }
+
+        if (method == 0 ? size != compressed_size : size / max_inflate_ratio > compressed_size) {
+            throw CouldNotRead{fmt::format("{} has a corrupt size for {}", m_path.string(), name)};
+        }
+
+        add(name, {data, size, compressed_size, method == 8, true, le32(entry + 16)});
+    }
+}
+
+cin::Paths cin::Archive::paths() const
+{
+    Paths result;
+    result.reserve(m_names.size());
+
+    for (const auto& name : m_names) {
+        result.push_back(m_path / name);
+    }
+
+    return result;
+}
+
+uint64_t cin::Archive::size(const std::filesystem::path& member) const
+{
+    const auto found{m_members.find(member.lexically_relative(m_path).lexically_normal().generic_string())};
+    return found == m_members.end() ? 0 : found->second.size;
+}
+
+void cin::Archive::read(const std::filesystem::path& member, Buffer<uint8_t>& contents) const
+{
+    const auto found{m_members.find(member.lexically_relative(m_path).lexically_normal().generic_string())};
+
+    if (found == m_members.end()) {
+        throw CouldNotRead{fmt::format("{} is not in {}", member.string(), m_path.string())};
+    }
+
+    const Member& entry{found->second};
+    contents.resize(entry.size);
+
+    if (!entry.deflated) {
+        read_at(entry.offset, contents.data(), entry.size);
+    }
+    else {
+        z_stream stream{};
+
+        if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+            throw CouldNotRead{"Could not initialize zlib"};
+        }
+
+        Buffer<uint8_t> chunk{copy_chunk};
+        uint64_t consumed{0};
+        uint64_t produced{0};
+        int status{Z_OK};
+
+        while (status == Z_OK) {
+            if (stream.avail_in == 0) {
+                if (consumed == entry.compressed_size) {
+                    break;
+                }
+
+                const size_t size{static_cast<size_t>(std::min<uint64_t>(copy_chunk, entry.compressed_size - consumed))};
+                read_at(entry.offset + consumed, chunk.data(), size);
+                consumed += size;
+                stream.next_in = chunk.data();
+                stream.avail_in = static_cast<uInt>(size);
+            }
+
+            stream.next_out = contents.data() + produced;
+            stream.avail_out = static_cast<uInt>(std::min<uint64_t>(UINT_MAX, entry.size - produced));
+            const uInt room{stream.avail_out};
+            status = inflate(&stream, Z_NO_FLUSH);
+            produced += room - stream.avail_out;
+        }
+
+        inflateEnd(&stream);
+
+        if (status != Z_STREAM_END || produced != entry.size) {
+            throw CouldNotRead{fmt::format("Could not inflate {}", member.string())};
+        }
+    }
+
+    if (entry.has_crc) {
+        uLong crc{crc32(0, nullptr, 0)};
+
+        for (uint64_t offset = 0; offset < entry.size; offset += UINT_MAX) {
+            crc = crc32(crc, contents.data() + offset, static_cast<uInt>(std::min<uint64_t>(UINT_MAX, entry.size - offset)));
+        }
+
+        if (crc != entry.crc) {
+            throw CouldNotRead{fmt::format("{} fails its checksum", member.string())};
+        }
+    }
+}
+
+bool cin::is_archive(const std::filesystem::path& path)
+{
+    std::error_code error;
+    return (path.extension() == ".tar" || path.extension() == ".zip") && std::filesystem::is_regular_file(path, error);
+}
+
+size_t cin::write_tar(const std::filesystem::path& path, const std::filesystem::path& directory, FsyncPolicy policy)
+{
+    std::vector<std::string> names;
+
+    for (const auto& entry : std::filesystem::recursive_directory_iterator{directory}) {
+        if (entry.is_regular_file()) {
+            names.push_back(entry.path().lexically_relative(directory).generic_string());
+        }
+    }
+
+    std::sort(names.begin(), names.end());
+
+    cin::Arena arena;
+    cin::OutputFile file{path, policy, arena};
+    Buffer<uint8_t> chunk{copy_chunk};
+
+    for (const auto& name : names) {
+        const auto source{directory / name};
+        FileStamp stamp{};
+
+        if (!stamp_file(source, stamp)) {
+            continue;
+        }
+
+        if (name.size() >= 100) {
+            write_tar_header(file, "././@LongLink", name.size() + 1, 0, 'L');
+            file.write(reinterpret_cast<const uint8_t*>(name.c_str()), name.size() + 1);
+            pad_tar(file, name.size() + 1);
+        }
+
+        write_tar_header(file, name, stamp.size, stamp.mtime / 1000000000, '0');
+
+        const int fd{::open(source.c_str(), O_RDONLY | O_CLOEXEC)};
+
+        if (fd < 0) {
+            throw OutputFile::CouldNotWrite{fmt::format("Could not open {}: {}", source.string(), std::strerror(errno))};
+        }
+
+        uint64_t copied{0};
+
+        while (copied < stamp.size) {
+            const ssize_t n{::read(fd, chunk.data(), static_cast<size_t>(std::min<uint64_t>(copy_chunk, stamp.size - copied)))};
+
+            if (n <= 0) {
+                ::close(fd);
+                throw OutputFile::CouldNotWrite{fmt::format("Could not read {} while packing", source.string())};
+            }
+
+            file.write(chunk.data(), static_cast<size_t>(n));
+            copied += static_cast<uint64_t>(n);
+        }
+
+        ::close(fd);
+        pad_tar(file, stamp.size);
+    }
+
+    static const uint8_t end_of_archive[2 * tar_block]{};
+    file.write(end_of_archive, sizeof(end_of_archive));
+    file.commit();
+    return names.size();
+}
@@ -0,0 +1,68 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include "arena.h"
+
+cin::Arena::Arena(size_t chunk_size)
+: m_chunk_size{chunk_size}
+{}
+
+void cin::Arena::add_chunk(size_t size)
+{
+    m_chunks.push_back({std::unique_ptr<std::byte[]>{new std::byte[size]}, size});
+    m_offset = 0;
+    m_stats.chunk_allocations++;
+    m_stats.reserved_bytes += size;
+}
+
+void* cin::Arena::allocate(size_t size, size_t alignment)
+{
+    if (m_chunks.empty()) {
+        add_chunk(std::max(m_chunk_size, size + alignment));
+    }
+
+    auto* chunk{&m_chunks.back()};
+    auto address{reinterpret_cast<uintptr_t>(chunk->data.get()) + m_offset};
+    auto padding{(alignment - address % alignment) % alignment};
+
+    if (m_offset + padding + size > chunk->size) {
+        add_chunk(std::max(m_chunk_size, size + alignment));
+        chunk = &m_chunks.back();
+        address = reinterpret_cast<uintptr_t>(chunk->data.get());
+        padding = (alignment - address % alignment) % alignment;
+    }
+
+    m_offset += padding + size;
+    m_used += padding + size;
+    m_stats.total_bytes += size;
+    m_stats.peak_bytes = std::max(m_stats.peak_bytes, m_used);
+    return chunk->data.get() + m_offset - size;
+}
+
+const char* cin::Arena::copy_string(std::string_view s)
+{
+    auto* result{allocate<char>(s.size() + 1)};
+    std::memcpy(result, s.data(), s.size());
+    result[s.size()] = '\0';
+    return result;
+}
+
+void cin::Arena::reset()
+{
+    // Merge chunks so the next file of the same size fits into a single one.
+    if (m_chunks.size() > 1) {
+        const size_t size{m_stats.reserved_bytes};
+        m_chunks.clear();
+        m_stats.reserved_bytes = 0;
+        add_chunk(size);
+    }
+
+    m_offset = 0;
+    m_used = 0;
+    m_stats.resets++;
+}
+
+const cin::ArenaStats& cin::Arena::stats() const
+{
+    return m_stats;
+}
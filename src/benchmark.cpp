@@ -0,0 +1,107 @@
+#include <algorithm>
+#include <chrono>
+#include <system_error>
+#include <unistd.h>
+#include "benchmark.h"
+#include "buffer.h"
+#include "encoder.h"
+#include "log.h"
+#include "probe.h"
+
+namespace
+{
+    constexpr size_t block_sizes[]{256, 576, 1152, 2304, 4608, 9216, 18432, 36864, 73728, 0};
+
+    uintmax_t total_size(const cin::Paths& paths)
+    {
+        uintmax_t result{0};
+
+        for (const auto& path: paths) {
+            std::error_code error;
+            const auto size{std::filesystem::file_size(path, error)};
+            result += error ? 0 : size;
+        }
+
+        return result;
+    }
+
+    double total_seconds(const cin::Paths& paths)
+    {
+        double result{0.0};
+
+        for (const auto& info: cin::probe_files(paths, nullptr)) {
+            result += info.duration();
+        }
+
+        return result;
+    }
+}
+
+void cin::benchmark_block_sizes(const cin::Paths& paths, const cin::Options& options)
+{
+    using clock = std::chrono::steady_clock;
+
+    constexpr double bytes_per_kib{1024.0};
+    constexpr double bytes_per_mib{1024.0 * 1024.0};
+    const double input_mib{total_size(paths) / bytes_per_mib};
+    const double seconds{std::max(total_seconds(paths), 1e-3)};
+    const auto scratch{std::filesystem::temp_directory_path() / fmt::format("encoder-benchmark-{}", getpid())};
+
+    // Every run starts from the same state: no shared ledger, journal or
+    // analysis cache that lets later runs skip work the first one did, and
+    // outputs that are plain files in an empty scratch directory.
+    const auto run_options{[&](size_t frames) {
+        Options run{options};
+        run.block_frames = frames;
+        run.output = scratch;
+        run.output_archive.clear();
+        run.bundle.clear();
+        run.journal.clear();
+        run.ledger.clear();
+        run.analysis_cache.clear();
+        run.verify = false;
+        run.perf_counters = false;
+        run.fsync = FsyncPolicy::none;
+
+        std::error_code error;
+        std::filesystem::remove_all(scratch, error);
+        std::filesystem::create_directories(scratch);
+        return run;
+    }};
+
+    cin::log::info("Benchmarking {} files ({:.2f} MiB, {:.1f} s of audio) single threaded", paths.size(), input_mib, seconds);
+
+    // Untimed, so the page cache, filter banks and kernels are warm for the
+    // first timed run as for all others.
+    {
+        const Encoder encoder{Paths{paths}, run_options(0)};
+        encoder.encode();
+    }
+
+    // Buffer counters per encoded second of audio: heap allocations, the
+    // bytes they allocate and the bytes resize() adds, which the producers
+    // write without clearing them first.
+    cin::log::info("{:>10} {:>12} {:>12} {:>12} {:>12} {:>12}",
+        "frames", "ms", "MiB/s", "allocs/s", "alloc KiB/s", "resize KiB/s");
+
+    for (const size_t frames: block_sizes) {
+        const Encoder encoder{Paths{paths}, run_options(frames)};
+        const BufferStats before{buffer_stats()};
+
+        const auto start{clock::now()};
+        encoder.encode();
+        const std::chrono::duration<double, std::milli> elapsed{clock::now() - start};
+        const BufferStats& after{buffer_stats()};
+
+        cin::log::info("{:>10} {:>12.2f} {:>12.2f} {:>12.2f} {:>12.2f} {:>12.2f}",
+            frames == 0 ? std::string{"auto"} : std::to_string(frames),
+            elapsed.count(),
+            input_mib / (elapsed.count() / 1000.0),
+            (after.allocations - before.allocations) / seconds,
+            (after.allocated_bytes - before.allocated_bytes) / bytes_per_kib / seconds,
+            (after.resized_bytes - before.resized_bytes) / bytes_per_kib / seconds);
+    }
+
+    std::error_code error;
+    std::filesystem::remove_all(scratch, error);
+}
@@ -0,0 +1,7 @@
+#include "buffer.h"
+
+cin::BufferStats& cin::buffer_stats()
+{
+    thread_local BufferStats stats;
+    return stats;
+}
@@ -0,0 +1,287 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "bundle.h"
+#include "log.h"
+#include "output.h"
+
+namespace
+{
+    constexpr char magic[8]{'C', 'I', 'N', 'B', 'N', 'D', 'L', '1'};
+    constexpr size_t header_size{32};
+    constexpr size_t entry_size{26};
+
+    void put_le(std::string& out, uint64_t value, size_t bytes)
+    {
+        for (size_t i = 0; i < bytes; ++i) {
+            out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+        }
+    }
+
+    uint64_t get_le(const uint8_t* p, size_t bytes)
+    {
+        uint64_t value{0};
+
+        for (size_t i = bytes; i-- > 0;) {
+            value = (value << 8) | p[i];
+        }
+
+        return value;
+    }
+
+    uint64_t double_bits(double value)
+    {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    double bits_double(uint64_t bits)
+    {
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    void write_at(int fd, const uint8_t* data, size_t size, uint64_t offset, const std::string& path)
+    {
+        while (size > 0) {
+            const ssize_t written{::pwrite(fd, data, size, static_cast<off_t>(offset))};
+
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+
+                throw cin::BundleWriter::CouldNotWrite{fmt::format("Could not write {}: {}", path, std::strerror(errno))};
+            }
+
+            data += written;
+            offset += static_cast<uint64_t>(written);
+            size -= static_cast<size_t>(written);
+        }
+    }
+
+    void read_at(int fd, uint8_t* data, size_t size, uint64_t offset, const std::filesystem::path& path)
+    {
+        while (size > 0) {
+            const ssize_t n{::pread(fd, data, size, static_cast<off_t>(offset))};
+
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+
+            if (n <= 0) {
+                throw cin::BundleReader::CouldNotRead{fmt::format("Could not read {} at offset {}: {}",
+                    path.string(), offset, n == 0 ? "unexpected end of file" : std::strerror(errno))};
+            }
+
+            data += n;
+            offset += static_cast<uint64_t>(n);
+            size -= static_cast<size_t>(n);
+        }
+    }
+}
+
+cin::BundleWriter::BundleWriter(const std::filesystem::path& path, FsyncPolicy policy)
+: m_path{path}
+, m_temp_path{temp_path(path)}
+, m_policy{policy}
+{
+    m_fd = ::open(m_temp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if (m_fd < 0) {
+        throw CouldNotWrite{fmt::format("Could not create {}: {}", m_temp_path, std::strerror(errno))};
+    }
+
+    m_end = header_size;
+}
+
+cin::BundleWriter::~BundleWriter()
+{
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        ::unlink(m_temp_path.c_str());
+    }
+}
+
+void cin::BundleWriter::append(const std::string& name, const uint8_t* data, size_t size, double duration)
+{
+    // Shared with other workers, commit() cannot close the file meanwhile.
+    const std::shared_lock file_lock{m_file_mutex};
+
+    if (m_fd < 0) {
+        throw CouldNotWrite{fmt::format("Could not add {}: {} is already committed", name, m_path.string())};
+    }
+
+    // The only point of contact between workers: everything after the
+    // reservation writes to a region no other worker touches.
+    const uint64_t offset{m_end.fetch_add(size)};
+    write_at(m_fd, data, size, offset, m_temp_path);
+
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_entries.push_back({name, {offset, size, duration}});
+}
+
+size_t cin::BundleWriter::commit()
+{
+    const std::unique_lock file_lock{m_file_mutex};
+    std::lock_guard<std::mutex> lock{m_mutex};
+
+    if (m_fd < 0) {
+        return m_count;
+    }
+
+    std::stable_sort(m_entries.begin(), m_entries.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    // A name appended twice, e.g. a watched file written again, keeps its
+    // last stream; the earlier one is left unreferenced.
+    std::string index;
+    size_t count{0};
+
+    for (size_t i = 0; i < m_entries.size(); ++i) {
+        const auto& [name, entry] = m_entries[i];
+
+        if (i + 1 < m_entries.size() && m_entries[i + 1].first == name) {
+            continue;
+        }
+
+        const size_t name_size{std::min<size_t>(name.size(), UINT16_MAX)};
+        put_le(index, entry.offset, 8);
+        put_le(index, entry.length, 8);
+        put_le(index, double_bits(entry.duration), 8);
+        put_le(index, name_size, 2);
+        index.append(name, 0, name_size);
+        ++count;
+    }
+
+    const uint64_t index_offset{m_end.load()};
+    write_at(m_fd, reinterpret_cast<const uint8_t*>(index.data()), index.size(), index_offset, m_temp_path);
+
+    std::string header{magic, sizeof(magic)};
+    put_le(header, index_offset, 8);
+    put_le(header, index.size(), 8);
+    put_le(header, count, 8);
+    write_at(m_fd, reinterpret_cast<const uint8_t*>(header.data()), header.size(), 0, m_temp_path);
+
+    if (m_policy != FsyncPolicy::none && ::fsync(m_fd) < 0) {
+        throw CouldNotWrite{fmt::format("Could not sync {}: {}", m_temp_path, std::strerror(errno))};
+    }
+
+    const int fd{m_fd};
+    m_fd = -1;
+
+    if (::close(fd) < 0) {
+        ::unlink(m_temp_path.c_str());
+        throw CouldNotWrite{fmt::format("Could not close {}: {}", m_temp_path, std::strerror(errno))};
+    }
+
+    if (::rename(m_temp_path.c_str(), m_path.c_str()) < 0) {
+        ::unlink(m_temp_path.c_str());
+        throw CouldNotWrite{fmt::format("Could not rename to {}: {}", m_path.string(), std::strerror(errno))};
+    }
+
+    if (m_policy == FsyncPolicy::full) {
+        sync_parent_directory(m_path);
+    }
+
+    cin::log::info("Wrote {} files to bundle {}", count, m_path.string());
+
+    m_count = count;
+    return count;
+}
+
+cin::BundleReader::BundleReader(const std::filesystem::path& path)
+: m_path{path}
+{
+    m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (m_fd < 0) {
+        throw CouldNotRead{fmt::format("Could not open {}: {}", path.string(), std::strerror(errno))};
+    }
+
+    try {
+        struct stat st{};
+        ::fstat(m_fd, &st);
+        const uint64_t file_size{static_cast<uint64_t>(st.st_size)};
+
+        uint8_t header[header_size];
+
+        if (file_size < header_size) {
+            throw CouldNotRead{fmt::format("{} is not a bundle", path.string())};
+        }
+
+        read_at(m_fd, header, header_size, 0, m_path);
+
+        const uint64_t index_offset{get_le(header + 8, 8)};
+        const uint64_t index_size{get_le(header + 16, 8)};
+        const uint64_t count{get_le(header + 24, 8)};
+
+        if (std::memcmp(header, magic, sizeof(magic)) != 0 || index_offset < header_size
+            || index_offset > file_size || index_size > file_size - index_offset || count > index_size / entry_size) {
+            throw CouldNotRead{fmt::format("{} is not a bundle or is incomplete", path.string())};
+        }
+
+        std::vector<uint8_t> index(index_size);
+        read_at(m_fd, index.data(), index.size(), index_offset, m_path);
+        m_names.reserve(count);
+        m_entries.reserve(count);
+
+        for (size_t pos = 0; m_names.size() < count;) {
+            if (index.size() - pos < entry_size) {
+                throw CouldNotRead{fmt::format("Index of {} is truncated", path.string())};
+            }
+
+            const uint8_t* p{index.data() + pos};
+            const BundleEntry entry{get_le(p, 8), get_le(p + 8, 8), bits_double(get_le(p + 16, 8))};
+            const size_t name_size{get_le(p + 24, 2)};
+            pos += entry_size;
+
+            if (index.size() - pos < name_size || entry.offset > index_offset
+                || entry.length > index_offset - entry.offset) {
+                throw CouldNotRead{fmt::format("Index of {} is corrupt", path.string())};
+            }
+
+            std::string name{reinterpret_cast<const char*>(index.data() + pos), name_size};
+            pos += name_size;
+            m_entries.emplace(name, entry);
+            m_names.push_back(std::move(name));
+        }
+    }
+    catch (...) {
+        ::close(m_fd);
+        throw;
+    }
+}
+
+cin::BundleReader::~BundleReader()
+{
+    ::close(m_fd);
+}
+
+const std::vector<std::string>& cin::BundleReader::names() const
+{
+    return m_names;
+}
+
+const cin::BundleEntry* cin::BundleReader::find(const std::string& name) const
+{
+    const auto entry{m_entries.find(name)};
+    return entry == m_entries.end() ? nullptr : &entry->second;
+}
+
+bool cin::BundleReader::read(const std::string& name, Buffer<uint8_t>& data) const
+{
+    const BundleEntry* entry{find(name)};
+
+    if (entry == nullptr) {
+        return false;
+    }
+
+    data.resize(entry->length);
+    read_at(m_fd, data.data(), entry->length, entry->offset, m_path);
+    return true;
+}
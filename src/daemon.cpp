@@ -0,0 +1,468 @@
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "archive.h"
+#include "arena.h"
+#include "daemon.h"
+#include "encoder.h"
+#include "fs.h"
+#include "log.h"
+#include "options.h"
+
+namespace
+{
+    using clock = std::chrono::steady_clock;
+
+    constexpr uint32_t max_frame_size{16 * 1024 * 1024};
+    constexpr int poll_interval_ms{250};
+
+    volatile std::sig_atomic_t g_stop{0};
+
+    void request_stop(int)
+    {
+        g_stop = 1;
+    }
+
+    bool read_all(int fd, void* data, size_t size)
+    {
+        auto* bytes{static_cast<uint8_t*>(data)};
+
+        while (size > 0) {
+            const ssize_t n{::read(fd, bytes, size)};
+
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+
+            if (n <= 0) {
+                return false;
+            }
+
+            bytes += n;
+            size -= n;
+        }
+
+        return true;
+    }
+
+    bool write_all(int fd, const void* data, size_t size)
+    {
+        const auto* bytes{static_cast<const uint8_t*>(data)};
+
+        while (size > 0) {
+            const ssize_t n{::send(fd, bytes, size, MSG_NOSIGNAL)};
+
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+
+            if (n <= 0) {
+                return false;
+            }
+
+            bytes += n;
+            size -= n;
+        }
+
+        return true;
+    }
+
+    bool read_frame(int fd, std::string& payload)
+    {
+        uint8_t header[4];
+
+        if (!read_all(fd, header, sizeof(header))) {
+            return false;
+        }
+
+        const uint32_t size{header[0] | (header[1] << 8) | (header[2] << 16) | (static_cast<uint32_t>(header[3]) << 24)};
+
+        if (size > max_frame_size) {
+            return false;
+        }
+
+        payload.resize(size);
+        return read_all(fd, payload.data(), size);
+    }
+
+    bool write_frame(int fd, const std::string& payload)
+    {
+        const auto size{static_cast<uint32_t>(payload.size())};
+        const uint8_t header[4]{
+            static_cast<uint8_t>(size & 0xff),
+            static_cast<uint8_t>((size >> 8) & 0xff),
+            static_cast<uint8_t>((size >> 16) & 0xff),
+            static_cast<uint8_t>((size >> 24) & 0xff),
+        };
+
+        return write_all(fd, header, sizeof(header)) && write_all(fd, payload.data(), payload.size());
+    }
+
+    sockaddr_un socket_address(const std::filesystem::path& path)
+    {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+
+        if (path.native().size() >= sizeof(address.sun_path)) {
+            throw cin::Daemon::SocketError{fmt::format("Socket path {} is too long", path.string())};
+        }
+
+        std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+        return address;
+    }
+
+    double milliseconds(clock::duration duration)
+    {
+        return std::chrono::duration<double, std::milli>{duration}.count();
+    }
+
+    // Paths in a job are relative to the client, not to the daemon.
+    void make_absolute(std::filesystem::path& path, const std::filesystem::path& cwd)
+    {
+        if (!path.empty() && path.is_relative()) {
+            path = cwd / path;
+        }
+    }
+}
+
+struct cin::Daemon::Job {
+    std::unique_ptr<Encoder> encoder;
+    std::vector<double> file_ms;
+    std::vector<std::string> errors;
+    std::vector<bool> held;
+    size_t remaining{0};
+    clock::time_point received;
+    clock::time_point started;
+    bool has_started{false};
+    std::mutex mutex;
+    std::condition_variable done;
+};
+
+cin::Daemon::Daemon(const std::filesystem::path& socket_path)
+: m_socket_path{socket_path}
+, m_pool{std::thread::hardware_concurrency()}
+{
+    const sockaddr_un address{socket_address(socket_path)};
+    m_listen_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (m_listen_fd < 0) {
+        throw SocketError{fmt::format("Could not create socket: {}", std::strerror(errno))};
+    }
+
+    // A socket file left behind by a daemon that was killed refuses connections.
+    const int probe_fd{::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+    const bool in_use{probe_fd >= 0 && ::connect(probe_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0};
+
+    if (probe_fd >= 0) {
+        ::close(probe_fd);
+    }
+
+    if (in_use) {
+        ::close(m_listen_fd);
+        throw SocketError{fmt::format("Another daemon is serving {}", socket_path.string())};
+    }
+
+    ::unlink(socket_path.c_str());
+
+    if (::bind(m_listen_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0 || ::listen(m_listen_fd, SOMAXCONN) < 0) {
+        const int error{errno};
+        ::close(m_listen_fd);
+        throw SocketError{fmt::format("Could not listen on {}: {}", socket_path.string(), std::strerror(error))};
+    }
+
+    cin::log::info("Serving jobs on {} with {} workers", socket_path.string(), m_pool.size());
+}
+
+cin::Daemon::~Daemon()
+{
+    {
+        // Connections in the middle of a job still get their reply, the
+        // shutdown only ends their wait for the next request.
+        std::unique_lock lock{m_connection_mutex};
+
+        for (const int fd : m_connections) {
+            ::shutdown(fd, SHUT_RD);
+        }
+
+        m_disconnected.wait(lock, [this]() { return m_connections.empty(); });
+    }
+
+    ::close(m_listen_fd);
+    ::unlink(m_socket_path.c_str());
+}
+
+void cin::Daemon::run()
+{
+    struct sigaction action{};
+    action.sa_handler = request_stop;
+    sigemptyset(&action.sa_mask);
+    ::sigaction(SIGINT, &action, nullptr);
+    ::sigaction(SIGTERM, &action, nullptr);
+
+    while (g_stop == 0) {
+        pollfd listener{m_listen_fd, POLLIN, 0};
+
+        if (::poll(&listener, 1, poll_interval_ms) <= 0) {
+            continue;
+        }
+
+        const int fd{::accept4(m_listen_fd, nullptr, nullptr, SOCK_CLOEXEC)};
+
+        if (fd < 0) {
+            continue;
+        }
+
+        const std::lock_guard lock{m_connection_mutex};
+        m_connections.insert(fd);
+        std::thread{[this, fd]() { serve(fd); }}.detach();
+    }
+
+    cin::log::info("Stopping, waiting for running jobs");
+}
+
+void cin::Daemon::serve(int fd)
+{
+    std::string request;
+
+    while (read_frame(fd, request)) {
+        if (!write_frame(fd, run_job(request))) {
+            break;
+        }
+    }
+
+    const std::lock_guard lock{m_connection_mutex};
+    m_connections.erase(fd);
+    ::close(fd);
+    m_disconnected.notify_all();
+}
+
+std::string cin::Daemon::run_job(const std::string& request)
+{
+    const uint64_t id{m_next_job++};
+    auto job{std::make_shared<Job>()};
+    job->received = clock::now();
+
+    std::vector<std::string> fields;
+
+    for (size_t start = 0; start < request.size();) {
+        const size_t end{std::min(request.find('\0', start), request.size())};
+        fields.push_back(request.substr(start, end - start));
+        start = end + 1;
+    }
+
+    if (fields.empty()) {
+        return "status error\nmessage empty job\n";
+    }
+
+    const std::filesystem::path cwd{fields.front()};
+    std::string input;
+    Priority priority{Priority::normal};
+    auto deadline{WorkerPool::clock::time_point::max()};
+    std::vector<const char*> argv{"encoder"};
+
+    for (size_t i = 1; i < fields.size(); ++i) {
+        argv.push_back(fields[i].c_str());
+    }
+
+    try {
+        Options options{parse_options(static_cast<int>(argv.size()), argv.data())};
+
+        if (options.benchmark || options.plan || options.watch || !options.daemon_socket.empty() || !options.submit_socket.empty()
+                || options.simd || options.simd_check) {
+            return "status error\nmessage --benchmark, --plan, --watch, --daemon, --submit and --simd cannot run as a job\n";
+        }
+
+        for (auto* path : {&options.input, &options.output, &options.output_archive, &options.bundle, &options.journal,
+                &options.analysis_cache, &options.probe_cache, &options.verify_report, &options.ledger}) {
+            make_absolute(*path, cwd);
+        }
+
+        input = options.input.string();
+        priority = options.priority;
+
+        if (options.deadline > 0.0) {
+            deadline = job->received + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>{options.deadline});
+        }
+
+        Paths paths{std::filesystem::is_directory(options.input) || is_archive(options.input)
+            ? get_valid_wav_files(options.input, options.recursive)
+            : Paths{options.input}};
+
+        job->encoder = std::make_unique<Encoder>(std::move(paths), options, &m_resources);
+    }
+    catch (const std::exception& err) {
+        return fmt::format("status error\nmessage {}\n", err.what());
+    }
+
+    const Paths& paths{job->encoder->paths()};
+    job->file_ms.resize(paths.size());
+    job->errors.resize(paths.size());
+    job->held.resize(paths.size());
+    job->remaining = paths.size();
+    cin::log::info("Job {}: {} {} files from {}", id, paths.size(), priority_name(priority), input);
+
+    for (size_t i = 0; i < paths.size(); ++i) {
+        m_pool.submit([this, job, i](Arena& arena) { run_file(*job, i, arena); }, priority, deadline);
+    }
+
+    std::unique_lock lock{job->mutex};
+
+    // Files another process holds in the ledger are queued again until it
+    // finished them or its claim expired.
+    while (true) {
+        job->done.wait(lock, [&job]() { return job->remaining == 0; });
+        std::vector<size_t> held;
+
+        for (size_t i = 0; i < paths.size(); ++i) {
+            if (job->held[i]) {
+                held.push_back(i);
+                job->held[i] = false;
+            }
+        }
+
+        if (held.empty()) {
+            break;
+        }
+
+        cin::log::info("Job {}: waiting for {} files claimed by other processes", id, held.size());
+        job->remaining = held.size();
+        lock.unlock();
+        std::this_thread::sleep_for(job->encoder->retry_interval());
+
+        for (const size_t i : held) {
+            m_pool.submit([this, job, i](Arena& arena) { run_file(*job, i, arena); }, priority, deadline);
+        }
+
+        lock.lock();
+    }
+
+    if (!job->has_started) {
+        job->started = clock::now();
+    }
+
+    size_t failed{0};
+
+    try {
+        failed += job->encoder->finish();
+    }
+    catch (const std::exception& err) {
+        cin::log::error("Job {}: {}", id, err.what());
+        failed++;
+    }
+
+    std::string files;
+
+    for (size_t i = 0; i < paths.size(); ++i) {
+        const bool ok{job->errors[i].empty()};
+        failed += ok ? 0 : 1;
+        files += fmt::format("file {} {:.2f} {}{}{}\n",
+            ok ? "ok" : "error", job->file_ms[i], paths[i].string(), ok ? "" : ": ", job->errors[i]);
+    }
+
+    // Queue waits of every class since the daemon started, so a client can
+    // check how interactive jobs fare while a backfill is running.
+    std::string queues;
+
+    for (const Priority queue : {Priority::interactive, Priority::normal, Priority::bulk}) {
+        const WorkerPool::WaitStats stats{m_pool.wait_stats(queue)};
+        queues += fmt::format("queue {} {} {:.2f} {:.2f} {:.2f} {}\n",
+            priority_name(queue), stats.count, stats.p50_ms, stats.p99_ms, stats.max_ms, stats.late);
+    }
+
+    const auto finished{clock::now()};
+    cin::log::info("Job {}: {} of {} files failed in {:.2f} ms", id, failed, paths.size(), milliseconds(finished - job->received));
+
+    return fmt::format("status {}\npriority {}\nfiles {}\nfailed {}\nwait_ms {:.2f}\nencode_ms {:.2f}\ntotal_ms {:.2f}\n{}{}",
+        failed == 0 ? "ok" : "failed",
+        priority_name(priority),
+        paths.size(),
+        failed,
+        milliseconds(job->started - job->received),
+        milliseconds(finished - job->started),
+        milliseconds(finished - job->received),
+        queues,
+        files);
+}
+
+void cin::Daemon::run_file(Job& job, size_t index, Arena& arena)
+{
+    const auto start{clock::now()};
+
+    {
+        const std::lock_guard lock{job.mutex};
+
+        if (!job.has_started) {
+            job.started = start;
+            job.has_started = true;
+        }
+    }
+
+    std::string error;
+    bool held{false};
+
+    try {
+        held = !job.encoder->encode_one(job.encoder->paths()[index], arena);
+    }
+    catch (const std::exception& err) {
+        error = err.what();
+        cin::log::error("Error processing {}: {}", job.encoder->paths()[index].string(), error);
+    }
+
+    const std::lock_guard lock{job.mutex};
+    job.file_ms[index] += milliseconds(clock::now() - start);
+    job.errors[index] = std::move(error);
+    job.held[index] = held;
+
+    if (--job.remaining == 0) {
+        job.done.notify_all();
+    }
+}
+
+int cin::submit_job(const std::filesystem::path& socket_path, int argc, const char* argv[])
+{
+    std::error_code error;
+    std::string request{std::filesystem::current_path(error).string()};
+    request.push_back('\0');
+
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--submit") == 0) {
+            i++;
+            continue;
+        }
+
+        request += argv[i];
+        request.push_back('\0');
+    }
+
+    const sockaddr_un address{socket_address(socket_path)};
+    const int fd{::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+
+    if (fd < 0 || ::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+        const int connect_error{errno};
+
+        if (fd >= 0) {
+            ::close(fd);
+        }
+
+        throw Daemon::SocketError{fmt::format("Could not connect to {}: {}", socket_path.string(), std::strerror(connect_error))};
+    }
+
+    std::string reply;
+    const bool ok{write_frame(fd, request) && read_frame(fd, reply)};
+    ::close(fd);
+
+    if (!ok) {
+        throw Daemon::SocketError{fmt::format("Daemon on {} closed the connection", socket_path.string())};
+    }
+
+    std::cout << reply << std::flush;
+    return reply.rfind("status ok\n", 0) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,77 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include "downmix.h"
+#include "encoder.h"
+#include "simd.h"
+
+namespace
+{
+    constexpr float minus_3db{0.70710678F};
+}
+
+cin::Downmix::Downmix(int num_channels, const std::vector<float>& matrix)
+: m_channels{num_channels}
+{
+    if (num_channels < 1 || num_channels > max_channels) {
+        throw cin::Encoder::UnsupportedFormat{"Downmix supports at most eight channels"};
+    }
+
+    if (matrix.size() != 2 * static_cast<size_t>(num_channels)) {
+        throw cin::Encoder::UnsupportedFormat{"Downmix matrix does not match the number of channels"};
+    }
+
+    std::copy(matrix.begin(), matrix.begin() + num_channels, m_left);
+    std::copy(matrix.begin() + num_channels, matrix.end(), m_right);
+}
+
+cin::Downmix cin::Downmix::itu(int num_channels)
+{
+    constexpr float c{minus_3db};
+    std::vector<float> matrix;
+
+    switch (num_channels) {
+        case 3:  // L R C
+            matrix = {1, 0, c,
+                      0, 1, c};
+            break;
+        case 4:  // L R Ls Rs
+            matrix = {1, 0, c, 0,
+                      0, 1, 0, c};
+            break;
+        case 5:  // L R C Ls Rs
+            matrix = {1, 0, c, c, 0,
+                      0, 1, c, 0, c};
+            break;
+        case 6:  // L R C LFE Ls Rs
+            matrix = {1, 0, c, 0, c, 0,
+                      0, 1, c, 0, 0, c};
+            break;
+        case 7:  // L R C LFE Cs Ls Rs
+            matrix = {1, 0, c, 0, 0.5F, c, 0,
+                      0, 1, c, 0, 0.5F, 0, c};
+            break;
+        case 8:  // L R C LFE Lb Rb Ls Rs
+            matrix = {1, 0, c, 0, c, 0, c, 0,
+                      0, 1, c, 0, 0, c, 0, c};
+            break;
+        default:
+            throw cin::Encoder::UnsupportedFormat{"No standard downmix for this number of channels"};
+    }
+
+    // Scale both rows by the same factor to keep the stereo balance.
+    const float left_sum{std::accumulate(matrix.begin(), matrix.begin() + num_channels, 0.0F)};
+    const float right_sum{std::accumulate(matrix.begin() + num_channels, matrix.end(), 0.0F)};
+    const float scale{1.0F / std::max(left_sum, right_sum)};
+
+    for (auto& coefficient: matrix) {
+        coefficient *= scale;
+    }
+
+    return Downmix{num_channels, matrix};
+}
+
+void cin::Downmix::apply(const int16_t* input, size_t num_frames, int16_t* output) const
+{
+    cin::simd().downmix(m_left, m_right, m_channels, input, num_frames, output);
+}
@@ -1,7 +1,24 @@
-#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <optional>
+#include <sys/resource.h>
+#include "analysis_cache.h"
+#include "archive.h"
+#include "downmix.h"
 #include "encoder.h"
+#include "id3.h"
 #include "lame_wrapper.h"
 #include "log.h"
+#include "loudness.h"
+#include "output.h"
+#include "peaks.h"
+#include "perf.h"
+#include "probe.h"
+#include "resampler.h"
+#include "scheduler.h"
+#include "trim.h"
+#include "verify.h"
 #include "wav.h"
 #include <vector>
 #include <thread>
@@ -10,79 +27,972 @@
 
 namespace
 {
-    void encode_file(const std::filesystem::path& path)
+    // Samples per channel in an MPEG-1 Layer III frame. Blocks that are a
+    // multiple of it let LAME emit whole frames without carrying a remainder.
+    constexpr size_t mp3_frame_size{1152};
+    constexpr size_t max_batch_frames{16 * mp3_frame_size};
+
+    constexpr double absolute_gate_lufs{-70.0};
+    constexpr double true_peak_ceiling_dbtp{-1.0};
+
+    size_t block_frames_for(const cin::Options& options, int total_frames)
+    {
+        if (options.block_frames > 0) {
+            return options.block_frames;
+        }
+
+        if (options.workload == cin::Workload::streaming) {
+            return mp3_frame_size;
+        }
+
+        // A static heuristic, not tuned at run time: short files are read in
+        // one go, long ones in blocks that keep the sample and MP3 buffers
+        // cache resident. --benchmark shows how it compares to fixed sizes.
+        const size_t frames{static_cast<size_t>(std::max(total_frames, 1))};
+        const size_t rounded{(frames + mp3_frame_size - 1) / mp3_frame_size * mp3_frame_size};
+        return std::min(rounded, max_batch_frames);
+    }
+
+    // Releases the per-file state of a worker once the file is done, also when
+    // encoding failed.
+    class ArenaScope {
+    public:
+        explicit ArenaScope(cin::Arena& arena) : m_arena{arena} {}
+
+        ~ArenaScope()
+        {
+            m_arena.reset();
+        }
+
+    private:
+        cin::Arena& m_arena;
+    };
+
+    void log_arena_stats(const cin::Arena& arena)
+    {
+        constexpr float bytes_per_kib{1024.0F};
+        const auto& stats{arena.stats()};
+
+        cin::log::debug("Arena: {} files, {} chunk allocations, {:.2f} KiB reserved, {:.2f} KiB peak per file, {:.2f} KiB served",
+            stats.resets,
+            stats.chunk_allocations,
+            stats.reserved_bytes / bytes_per_kib,
+            stats.peak_bytes / bytes_per_kib,
+            stats.total_bytes / bytes_per_kib
+            );
+    }
+
+    std::string json_number(double value)
+    {
+        return std::isfinite(value) ? fmt::format("{:.2f}", value) : std::string{"null"};
+    }
+
+    void write_loudness_json(const std::filesystem::path& output_path, const cin::LoudnessResult& result,
+        const cin::Options& options, cin::Arena& arena)
+    {
+        std::filesystem::path json_path{output_path};
+        json_path.replace_extension(".loudness.json");
+
+        const auto json{fmt::format(
+            "{{\"integrated_lufs\": {}, \"true_peak_dbtp\": {}, \"sample_peak_dbfs\": {}, "
+            "\"replaygain_track_gain_db\": {}, \"replaygain_track_peak\": {:.6f}, \"duration\": {:.3f}}}\n",
+            json_number(result.integrated_lufs),
+            json_number(result.true_peak_dbtp),
+            json_number(result.sample_peak_dbfs),
+            json_number(result.replaygain_db),
+            result.replaygain_peak,
+            result.duration)};
+
+        cin::OutputFile file{json_path, options.fsync, arena};
+        file.write(reinterpret_cast<const uint8_t*>(json.data()), json.size());
+        file.commit();
+    }
+
+    // LAME, libsndfile and resampler state that does not scale with the
+    // block size, a conservative round figure.
+    constexpr uint64_t codec_state_bytes{1024 * 1024};
+    constexpr uint64_t output_buffer_bytes{64 * 1024};
+
+    // LAME's default bit rate of 128 kbit/s, which the encoder keeps.
+    constexpr uint64_t mp3_bytes_per_second{128 * 1000 / 8};
+
+    // Upper bound of the buffers encode_file() keeps for @p info, used to
+    // admit files under a memory budget.
+    uint64_t estimate_job_bytes(const cin::WavInfo& info, const cin::Options& options)
     {
-       
+        const uint64_t channels{static_cast<uint64_t>(std::min(info.num_channels, 2))};
+        const uint64_t frames{block_frames_for(options, static_cast<int>(std::min<uint64_t>(info.num_frames, INT32_MAX)))};
+        const int output_rate{options.resample_rate > 0 ? options.resample_rate : cin::Resampler::default_output_rate(info.sample_rate)};
+        const uint64_t output_frames{frames * output_rate / std::max(info.sample_rate, 1) + 64};
+
+        uint64_t bytes{codec_state_bytes + output_buffer_bytes};
+        bytes += frames * info.num_channels * sizeof(int16_t);
+        bytes += frames * channels * sizeof(int16_t);
+        bytes += output_rate != info.sample_rate ? output_frames * channels * sizeof(int16_t) : 0;
+        bytes += cin::Lame::max_encoded_size(output_frames);
+
+        // Trimming holds back up to 10 s of silence, peaks and verification
+        // keep a fraction of the whole file.
+        if (options.trim_threshold_db) {
+            bytes += std::min<uint64_t>(info.num_frames, 10 * info.sample_rate) * channels * sizeof(int16_t);
+        }
+
+        if (options.peak_format != cin::PeakFormat::none) {
+            bytes += info.num_frames / options.peak_levels.front() * channels * 2 * sizeof(int16_t);
+        }
+
+        if (options.verify) {
+            bytes += info.num_frames * output_rate / std::max(info.sample_rate, 1) / 32 * channels * sizeof(int16_t);
+        }
+
+        // A bundle stream is held whole in a buffer that doubles as it grows.
+        if (!options.bundle.empty()) {
+            bytes += 2 * (info.num_frames * mp3_bytes_per_second / std::max(info.sample_rate, 1));
+        }
+
+        return bytes;
+    }
+
+    void log_memory_use(const cin::BatchScheduler& scheduler, uint64_t budget)
+    {
+        constexpr double bytes_per_mib{1024.0 * 1024.0};
+        struct rusage usage{};
+        ::getrusage(RUSAGE_SELF, &usage);
+
+        const double peak_rss_mib{usage.ru_maxrss * 1024.0 / bytes_per_mib};
+        const double peak_estimate_mib{scheduler.peak_bytes() / bytes_per_mib};
+
+        if (budget == 0) {
+            cin::log::debug("Memory: {:.1f} MiB buffers in flight at most, peak RSS {:.1f} MiB", peak_estimate_mib, peak_rss_mib);
+            return;
+        }
+
+        cin::log::info("Memory: {:.1f} MiB buffers in flight at most, peak RSS {:.1f} MiB, budget {:.1f} MiB, {} waits for budget",
+            peak_estimate_mib, peak_rss_mib, budget / bytes_per_mib, scheduler.num_waits());
+
+        if (peak_rss_mib > budget / bytes_per_mib) {
+            cin::log::warn("Peak RSS exceeded the memory budget, lower --memory-budget to leave room for the rest of the process");
+        }
+    }
+
+    // Reads blocks from a WAV file, or from the contents of an archive member
+    // if given, mixing multichannel input to stereo block by block as it is
+    // read.
+    class SampleSource {
+    public:
+        SampleSource(const std::filesystem::path& path, const cin::Buffer<uint8_t>* contents, const cin::Options& options,
+            cin::Arena& arena)
+        : m_wav_file{contents ? cin::WavFile{contents->data(), contents->size()} : cin::WavFile{path}}
+        , m_input{0, arena}
+        {
+            const int input_channels{m_wav_file.num_channels()};
+
+            if (input_channels > 2) {
+                m_downmix = options.downmix_matrix.empty()
+                    ? cin::Downmix::itu(input_channels)
+                    : cin::Downmix{input_channels, options.downmix_matrix};
+                cin::log::debug(" downmixing {} channels to stereo", input_channels);
+            }
+        }
+
+        int num_channels() const
+        {
+            return m_downmix ? 2 : m_wav_file.num_channels();
+        }
+
+        int sample_rate() const
+        {
+            return m_wav_file.sample_rate();
+        }
+
+        int num_frames() const
+        {
+            return m_wav_file.num_samples();
+        }
+
+        // Returns the number of bytes consumed from the file, @p samples is
+        // empty at the end.
+        size_t read(cin::Buffer<int16_t>& samples, size_t num_frames)
+        {
+            if (!m_downmix) {
+                return m_wav_file.read_samples(samples, num_frames) * sizeof(int16_t);
+            }
+
+            const int input_channels{m_wav_file.num_channels()};
+            const size_t num_read{m_wav_file.read_samples(m_input, num_frames)};
+            const size_t frames_read{num_read / input_channels};
+            samples.resize(frames_read * 2);
+            m_downmix->apply(m_input.data(), frames_read, samples.data());
+            return num_read * sizeof(int16_t);
+        }
+
+    private:
+        cin::WavFile m_wav_file;
+        std::optional<cin::Downmix> m_downmix;
+        cin::Buffer<int16_t> m_input;
+    };
+
+    // Seed of the content hash, covers every setting that changes the
+    // samples SampleSource produces.
+    uint64_t analysis_seed(const cin::Options& options)
+    {
+        cin::ContentHash hash;
+        hash.update(options.downmix_matrix.data(), options.downmix_matrix.size() * sizeof(float));
+        return hash.value();
+    }
+
+    // Reads @p path once without encoding to measure its loudness.
+    cin::LoudnessResult analyze_file(const std::filesystem::path& path, const cin::Buffer<uint8_t>* contents,
+        const cin::Options& options, cin::Arena& arena, uint64_t& hash)
+    {
+        cin::log::info("Analyzing {}", path.string());
+
+        SampleSource source{path, contents, options, arena};
+        cin::LoudnessMeter meter{source.sample_rate(), source.num_channels()};
+        cin::ContentHash content{analysis_seed(options)};
+        const size_t num_frames{block_frames_for(options, source.num_frames())};
+        cin::Buffer<int16_t> samples{num_frames * source.num_channels(), arena};
+
+        while (true) {
+            source.read(samples, num_frames);
+
+            if (samples.empty()) {
+                break;
+            }
+
+            content.update(samples.data(), samples.size() * sizeof(int16_t));
+            meter.process(samples.data(), samples.size() / source.num_channels());
+        }
+
+        hash = content.value();
+        return meter.result();
+    }
+
+    // Where an MP3 goes: its own file, or memory until it is complete and can
+    // be appended to the bundle in one piece.
+    class Mp3Output {
+    public:
+        Mp3Output(const std::filesystem::path& path, const cin::Options& options, cin::BundleWriter* bundle, cin::Arena& arena)
+        : m_bundle{bundle}
+        {
+            if (!m_bundle) {
+                m_file.emplace(path, options.fsync, arena);
+            }
+        }
+
+        void write(const uint8_t* data, size_t size)
+        {
+            if (m_file) {
+                m_file->write(data, size);
+                return;
+            }
+
+            const size_t offset{m_data.size()};
+            m_data.resize(offset + size);
+            std::memcpy(m_data.data() + offset, data, size);
+        }
+
+        void patch(size_t offset, const uint8_t* data, size_t size)
+        {
+            if (m_file) {
+                m_file->patch(offset, data, size);
+                return;
+            }
+
+            std::memcpy(m_data.data() + offset, data, size);
+        }
+
+        void commit(const std::string& name, double duration)
+        {
+            if (m_file) {
+                m_file->commit();
+                return;
+            }
 
-        
-        
+            m_bundle->append(name, m_data.data(), m_data.size(), duration);
+        }
+
+    private:
+        cin::BundleWriter* m_bundle;
+        std::optional<cin::OutputFile> m_file;
+        // On the heap, an arena would keep every outgrown copy until the file is done.
+        cin::Buffer<uint8_t> m_data;
+    };
+
+    void encode_file(const std::filesystem::path& path, const cin::Buffer<uint8_t>* contents,
+        const std::filesystem::path& output_path, const cin::Options& options, float gain, cin::Arena& arena,
+        cin::VerifyReference* reference, cin::BundleWriter* bundle, const std::string& bundle_name, cin::PerfStages& perf)
+    {
         cin::log::info("Encoding {}", path.string());
 
-        cin::WavFile wav_file{path};
+        SampleSource source{path, contents, options, arena};
+
+        Mp3Output mp3_file{output_path, options, bundle, arena};
+
+        if (options.replaygain_tags) {
+            const auto tag{cin::id3::empty_tag()};
+            mp3_file.write(tag.data(), tag.size());
+        }
+
+        const int num_channels{source.num_channels()};
+        const int input_rate{source.sample_rate()};
+        const int output_rate{options.resample_rate > 0 ? options.resample_rate : cin::Resampler::default_output_rate(input_rate)};
+        cin::Lame lame{num_channels, output_rate};
+
+        if (reference) {
+            reference->start(num_channels, output_rate, lame.encoder_delay());
+        }
+
+        const size_t num_frames{block_frames_for(options, source.num_frames())};
+        const cin::BufferStats stats_before{cin::buffer_stats()};
+        std::optional<cin::Resampler> resampler;
 
-        if (wav_file.num_channels() > 2) {
-            throw cin::Encoder::UnsupportedFormat("More than two channels are not supported");
+        if (output_rate != input_rate) {
+            resampler.emplace(input_rate, output_rate, num_channels, options.resample_quality, num_frames, arena);
+            cin::log::debug(" resampling {} Hz to {} Hz", input_rate, output_rate);
         }
 
-        std::filesystem::path output_path{path};
-        output_path.replace_extension(".mp3");
-        std::ofstream mp3_file{output_path, std::ios::binary};
+        const size_t output_frames{resampler ? resampler->max_output_frames(num_frames) : num_frames};
+        const size_t mp3_buffer_size{cin::Lame::max_encoded_size(output_frames)};
+        cin::Buffer<uint8_t> mp3_buffer{mp3_buffer_size, arena};
+        cin::Buffer<int16_t> sample_buffer{num_frames * num_channels, arena};
+        cin::Buffer<int16_t> resampled_buffer{resampler ? output_frames * num_channels : 0, arena};
 
-        const int num_channels{wav_file.num_channels()};
-        cin::Lame lame{num_channels, wav_file.sample_rate()};
+        // Loudness is measured on the stream LAME gets, before resampling.
+        std::optional<cin::LoudnessMeter> meter;
 
-        constexpr size_t num_samples{1024};
-        constexpr size_t mp3_buffer_size{static_cast<size_t>(num_samples * 1.25) + 7200};
-        std::vector<uint8_t> mp3_buffer;
-        mp3_buffer.reserve(mp3_buffer_size);
-        std::vector<int16_t> sample_buffer;
+        if (options.loudness_json || options.replaygain_tags) {
+            meter.emplace(input_rate, num_channels);
+        }
+
+        // Peaks describe the same stream, so they line up with the MP3 timeline
+        // unless it is resampled, in which case the input rate is recorded.
+        std::optional<cin::PeakBuilder> peaks;
+
+        if (options.peak_format != cin::PeakFormat::none) {
+            peaks.emplace(num_channels, input_rate, options.peak_levels, arena);
+        }
+
+        cin::log::debug(" block size {} frames, MP3 buffer {} bytes", num_frames, mp3_buffer_size);
+
+        std::optional<cin::SilenceTrimmer> trimmer;
+
+        if (options.trim_threshold_db) {
+            trimmer.emplace(num_channels, input_rate, *options.trim_threshold_db, options.trim_min_tail, arena);
+        }
 
-        const size_t num_frames{num_samples / (num_channels == 1 ? 1 : 2)};
         size_t read_size{0};
         size_t write_size{0};
-        
-        
-        
+        size_t encoded_frames{0};
+
+        // Encodes a block and writes the result, counted as separate stages.
+        const auto encode_samples{[&](const auto& encode) {
+            {
+                const cin::PerfScope scope{perf, cin::PerfStage::encode};
+                write_size += encode();
+            }
+
+            const cin::PerfScope scope{perf, cin::PerfStage::write};
+            mp3_file.write(mp3_buffer.data(), mp3_buffer.size());
+        }};
+
+        // Runs everything after reading on up to num_frames frames.
+        const auto encode_block{[&](int16_t* samples, size_t frames) {
+            {
+                const cin::PerfScope scope{perf, cin::PerfStage::process};
+                const size_t count{frames * num_channels};
+
+                if (gain != 1.0F) {
+                    cin::apply_gain(samples, count, gain);
+                }
+
+                if (meter) {
+                    meter->process(samples, frames);
+                }
+
+                if (peaks) {
+                    peaks->process(samples, frames);
+                }
+
+                if (resampler) {
+                    resampler->process(samples, frames, resampled_buffer);
+                    samples = resampled_buffer.data();
+                    frames = resampled_buffer.size() / num_channels;
+                }
+
+                if (reference) {
+                    reference->capture(samples, frames);
+                }
+            }
+
+            encoded_frames += frames;
+            encode_samples([&]() { return lame.encode(samples, frames * num_channels, mp3_buffer); });
+        }};
 
         while (true) {
-            read_size += wav_file.read_samples(sample_buffer, num_frames) * sizeof(uint16_t);
+            size_t block_size{0};
+
+            {
+                const cin::PerfScope scope{perf, cin::PerfStage::read};
+                block_size = source.read(sample_buffer, num_frames);
+            }
+
+            const bool end_of_file{block_size == 0};
+            read_size += block_size;
+
+            int16_t* samples{sample_buffer.data()};
+            size_t frames{sample_buffer.size() / num_channels};
+
+            if (trimmer) {
+                const cin::PerfScope scope{perf, cin::PerfStage::process};
+                frames = end_of_file ? trimmer->finish() : trimmer->process(samples, frames);
+                samples = trimmer->output();
+            }
+
+            // The trimmer may release more than a block of held back silence.
+            for (size_t offset = 0; offset < frames; offset += num_frames) {
+                encode_block(samples + offset * num_channels, std::min(num_frames, frames - offset));
+            }
+
+            if (end_of_file) {
+                bool flushed{false};
+
+                {
+                    const cin::PerfScope scope{perf, cin::PerfStage::process};
+                    flushed = resampler && resampler->flush(resampled_buffer) > 0;
 
-            mp3_buffer.resize(mp3_buffer_size);
+                    if (flushed && reference) {
+                        reference->capture(resampled_buffer.data(), resampled_buffer.size() / num_channels);
+                    }
+                }
+
+                if (flushed) {
+                    encoded_frames += resampled_buffer.size() / num_channels;
+                    encode_samples([&]() { return lame.encode(resampled_buffer, mp3_buffer); });
+                }
 
-            if (sample_buffer.empty()) {
-                write_size += lame.flush(mp3_buffer);
-                mp3_file.write((char *) mp3_buffer.data(), mp3_buffer.size());
+                encode_samples([&]() { return lame.flush(mp3_buffer); });
                 break;
             }
+        }
+
+        if (trimmer && trimmer->leading_frames() + trimmer->trailing_frames() > 0) {
+            cin::log::info(" trimmed {} leading and {} trailing silent frames ({:.2f} s)",
+                trimmer->leading_frames(),
+                trimmer->trailing_frames(),
+                1.0 * (trimmer->leading_frames() + trimmer->trailing_frames()) / input_rate
+                );
+        }
+
+        std::optional<cin::LoudnessResult> loudness;
+
+        if (meter) {
+            loudness = meter->result();
+            cin::log::debug(" integrated {:.2f} LUFS, true peak {:.2f} dBTP", loudness->integrated_lufs, loudness->true_peak_dbtp);
+        }
 
-            write_size += lame.encode(sample_buffer, mp3_buffer);
-            mp3_file.write((char *) mp3_buffer.data(), mp3_buffer.size());
+        if (options.replaygain_tags && loudness->valid()) {
+            const auto tag{cin::id3::replaygain_tag(*loudness)};
+            mp3_file.patch(0, tag.data(), tag.size());
+        }
+
+        mp3_file.commit(bundle_name, 1.0 * encoded_frames / output_rate);
+
+        if (options.loudness_json) {
+            write_loudness_json(output_path, *loudness, options, arena);
+        }
+
+        if (peaks) {
+            std::filesystem::path peaks_path{output_path};
+            peaks_path.replace_extension(options.peak_format == cin::PeakFormat::json ? ".peaks.json" : ".peaks");
+            peaks->write(peaks_path, options.peak_format, options.fsync, arena);
         }
-        
 
         constexpr float bytes_per_kib{1024.0F};
+        const cin::BufferStats& stats_after{cin::buffer_stats()};
+        const float seconds{std::max(1.0F * source.num_frames() / source.sample_rate(), 1e-3F)};
 
-        // cin::log::debug(" size reduced from {:.2f} KiB to {:.2f} KiB ({:.2f}x smaller)",
-        //     read_size / bytes_per_kib,
-        //     write_size / bytes_per_kib,
-        //     1.0F * read_size / write_size
-        //     );
+        // Bytes touched are what libsndfile and LAME write into the buffers,
+        // the buffers themselves are never cleared.
+        cin::log::debug(" size reduced from {:.2f} KiB to {:.2f} KiB ({:.2f}x smaller)",
+            read_size / bytes_per_kib,
+            write_size / bytes_per_kib,
+            1.0F * read_size / std::max<size_t>(write_size, 1)
+            );
+        cin::log::debug(" {} allocations ({:.2f} KiB), {:.2f} KiB touched per encoded second",
+            stats_after.allocations - stats_before.allocations,
+            (stats_after.allocated_bytes - stats_before.allocated_bytes) / bytes_per_kib,
+            (read_size + write_size) / bytes_per_kib / seconds
+            );
+
+        if (perf.enabled()) {
+            perf.log(" hardware counters, user space only:", false);
+        }
     }
 }
 
-cin::Encoder::Encoder(cin::Paths&& paths)
+namespace
+{
+    // Outputs cannot go next to archive members, they go to a directory named
+    // after the archive instead. With an output archive they are collected in
+    // a directory next to it until finish() packs them.
+    cin::Options resolve_output(const cin::Options& options)
+    {
+        cin::Options result{options};
+
+        if (!options.output_archive.empty()) {
+            result.output = options.output_archive;
+            result.output += ".parts";
+
+            // Everything below the output root is packed, the caches and the
+            // report go next to the archive instead.
+            const auto directory{options.output_archive.parent_path()};
+
+            if (result.analysis_cache.empty()) {
+                result.analysis_cache = directory / ".loudness-cache";
+            }
+
+            if (result.probe_cache.empty()) {
+                result.probe_cache = directory / ".probe-cache";
+            }
+
+            if (result.verify_report.empty()) {
+                result.verify_report = directory / "verify-report.txt";
+            }
+        }
+        else if (options.output.empty() && cin::is_archive(options.input)) {
+            result.output = options.input;
+            result.output.replace_extension();
+        }
+
+        return result;
+    }
+
+    // Temporary files of crashed runs would otherwise pile up next to the
+    // outputs. Processes on other hosts, such as other shards or ledger
+    // users, may still be writing theirs, only those untouched for a whole
+    // lease are theirs to lose. A long running process cleans each
+    // directory once, not for every job.
+    void remove_stale_outputs(const cin::Options& options, cin::EncoderResources* resources)
+    {
+        const std::chrono::seconds min_age{static_cast<int64_t>(std::ceil(options.lease))};
+        size_t removed{0};
+
+        const auto clean{[&](const std::filesystem::path& directory, bool recursive) {
+            if (!resources || resources->first_cleanup(directory, recursive)) {
+                removed += cin::remove_stale_parts(directory, recursive, min_age);
+            }
+        }};
+
+        if (!options.output.empty()) {
+            clean(options.output, true);
+        }
+        else if (!cin::is_archive(options.input)) {
+            clean(options.input, options.recursive);
+        }
+
+        for (const auto* file : {&options.output_archive, &options.bundle}) {
+            if (!file->empty()) {
+                const auto directory{file->parent_path()};
+                clean(directory.empty() ? "." : directory, false);
+            }
+        }
+
+        if (removed > 0) {
+            cin::log::info("Removed {} temporary files left by earlier runs", removed);
+        }
+    }
+
+    // Decoding costs a fraction of encoding, a quarter of the cores keeps
+    // up without starving the encoders.
+    std::shared_ptr<cin::Verifier> make_verifier(const std::filesystem::path& report, cin::FsyncPolicy policy)
+    {
+        return std::make_shared<cin::Verifier>(report, policy, std::thread::hardware_concurrency() / 4);
+    }
+
+    // Bundle entries are named like the files they replace, relative to the
+    // output root, or just by file name for a single input.
+    std::string bundle_name(const std::filesystem::path& output_path, const cin::Options& options)
+    {
+        auto relative{output_path.lexically_relative(options.output.empty() ? options.input : options.output)};
+
+        if (relative.empty() || *relative.begin() == "..") {
+            relative = output_path.filename();
+        }
+
+        return relative.generic_string();
+    }
+}
+
+std::shared_ptr<cin::Verifier> cin::EncoderResources::verifier(const std::filesystem::path& report, FsyncPolicy policy)
+{
+    const std::lock_guard lock{m_mutex};
+    auto& verifier{m_verifiers[{report, policy}]};
+
+    if (!verifier) {
+        verifier = make_verifier(report, policy);
+    }
+
+    return verifier;
+}
+
+std::shared_ptr<cin::Ledger> cin::EncoderResources::ledger(const std::filesystem::path& directory,
+    const std::filesystem::path& input_root, double lease)
+{
+    const std::lock_guard lock{m_mutex};
+    auto& ledger{m_ledgers[{directory, input_root, lease}]};
+
+    if (!ledger) {
+        ledger = std::make_shared<cin::Ledger>(directory, input_root, lease);
+    }
+
+    return ledger;
+}
+
+bool cin::EncoderResources::first_cleanup(const std::filesystem::path& directory, bool recursive)
+{
+    const std::lock_guard lock{m_mutex};
+    return m_cleaned.emplace(directory, recursive).second;
+}
+
+cin::Encoder::Encoder(cin::Paths&& paths, const cin::Options& options, EncoderResources* resources)
 : m_paths{std::move(paths)}
-{}
+, m_options{resolve_output(options)}
+, m_layout{m_options.input, m_options.output}
+{
+    if (cin::is_archive(m_options.input)) {
+        m_archive = std::make_unique<cin::Archive>(m_options.input);
+    }
+
+    remove_stale_outputs(m_options, resources);
+
+    if (!m_options.bundle.empty()) {
+        m_bundle = std::make_unique<cin::BundleWriter>(m_options.bundle, m_options.fsync);
+    }
+
+    if (m_options.perf_counters) {
+        m_perf = std::make_unique<cin::PerfTotals>();
+    }
+
+    if (m_options.normalize_lufs) {
+        auto cache_path{m_options.analysis_cache};
+
+        if (cache_path.empty()) {
+            cache_path = (m_options.output.empty() ? m_options.input : m_options.output) / ".loudness-cache";
+        }
+
+        // The output root is only created with the first output file.
+        std::error_code error;
+        std::filesystem::create_directories(cache_path.parent_path(), error);
+
+        try {
+            m_analysis_cache = std::make_unique<cin::AnalysisCache>(cache_path, m_options.fsync);
+        }
+        catch (const cin::OutputFile::CouldNotWrite& err) {
+            cin::log::warn("{}, measuring loudness without cache", err.what());
+        }
+    }
+
+    if (m_options.verify) {
+        auto report_path{m_options.verify_report};
+
+        if (report_path.empty()) {
+            report_path = (m_options.output.empty() ? m_options.input : m_options.output) / "verify-report.txt";
+        }
+
+        m_verifier = resources ? resources->verifier(report_path, m_options.fsync) : make_verifier(report_path, m_options.fsync);
+    }
+
+    if (!m_options.ledger.empty()) {
+        m_ledger = resources ? resources->ledger(m_options.ledger, m_options.input, m_options.lease)
+            : std::make_shared<cin::Ledger>(m_options.ledger, m_options.input, m_options.lease);
+    }
+
+    if (m_options.journal.empty()) {
+        return;
+    }
+
+    m_journal = std::make_unique<cin::Journal>(m_options.journal, m_options.fsync);
+
+    const auto total{m_paths.size()};
+    m_paths.erase(std::remove_if(m_paths.begin(), m_paths.end(), [this](const auto& path) {
+        return m_journal->is_complete(path) && std::filesystem::exists(m_layout.output_path(path));
+    }), m_paths.end());
+
+    cin::log::info("Resuming: {} of {} files already complete", total - m_paths.size(), total);
+}
+
+cin::Encoder::~Encoder()
+{
+    std::unique_lock lock{m_verify_mutex};
+    m_verify_idle.wait(lock, [this]() { return m_verifying == 0; });
+}
+
+float cin::Encoder::normalization_gain(const std::filesystem::path& path, const cin::Buffer<uint8_t>* contents,
+    cin::Arena& arena) const
+{
+    if (!m_options.normalize_lufs) {
+        return 1.0F;
+    }
+
+    const uint64_t seed{analysis_seed(m_options)};
+    cin::AnalysisCache::Entry entry{};
+
+    if (!m_analysis_cache || !m_analysis_cache->find(path, seed, entry)) {
+        uint64_t hash{0};
+        const auto result{analyze_file(path, contents, m_options, arena, hash)};
+        entry = {result.integrated_lufs, result.true_peak_dbtp};
+
+        if (m_analysis_cache) {
+            m_analysis_cache->store(path, seed, hash, entry);
+        }
+    }
+
+    if (!(entry.integrated_lufs > absolute_gate_lufs)) {
+        cin::log::debug(" too quiet to normalize");
+        return 1.0F;
+    }
+
+    // Never push the true peak above the ceiling, quiet but peaky material
+    // ends up below the target instead of clipping.
+    double gain_db{*m_options.normalize_lufs - entry.integrated_lufs};
+
+    if (entry.true_peak_dbtp + gain_db > true_peak_ceiling_dbtp) {
+        gain_db = true_peak_ceiling_dbtp - entry.true_peak_dbtp;
+        cin::log::debug(" gain limited by true peak of {:.2f} dBTP", entry.true_peak_dbtp);
+    }
+
+    cin::log::debug(" normalizing {:.2f} LUFS by {:+.2f} dB", entry.integrated_lufs, gain_db);
+    return static_cast<float>(std::pow(10.0, gain_db / 20.0));
+}
+
+void cin::Encoder::estimate_jobs(std::vector<uint64_t>& costs, std::vector<uint64_t>& bytes) const
+{
+    const auto cache{cin::open_probe_cache(m_options)};
+    const auto infos{cin::probe_files(m_paths, cache.get())};
+    costs.resize(m_paths.size());
+    bytes.resize(m_paths.size());
+
+    for (size_t i = 0; i < m_paths.size(); ++i) {
+        cin::WavInfo info{infos[i]};
+
+        // Files the probe cannot parse, and archive members, are assumed to
+        // be 16 bit stereo PCM at 44.1 kHz of their size.
+        if (info.num_channels == 0) {
+            std::error_code error;
+            const auto size{m_archive ? m_archive->size(m_paths[i]) : std::filesystem::file_size(m_paths[i], error)};
+            info = {2, 44100, 16, false, error ? 0 : size / 4};
+        }
+
+        // A member is held in memory while it is encoded.
+        costs[i] = info.num_frames * info.num_channels;
+        bytes[i] = estimate_job_bytes(info, m_options) + (m_archive ? m_archive->size(m_paths[i]) : 0);
+    }
+}
+
+const cin::Paths& cin::Encoder::paths() const
+{
+    return m_paths;
+}
+
+const cin::OutputLayout& cin::Encoder::layout() const
+{
+    return m_layout;
+}
+
+size_t cin::Encoder::finish(bool keep_outputs) const
+{
+    size_t failed{0};
+
+    if (m_verifier) {
+        std::unique_lock lock{m_verify_mutex};
+        m_verify_idle.wait(lock, [this]() { return m_verifying == 0; });
+        failed = m_verify_failures;
+        lock.unlock();
+
+        m_verifier->report();
+    }
+
+    if (!m_options.output_archive.empty() && std::filesystem::is_directory(m_options.output)) {
+        const size_t packed{cin::write_tar(m_options.output_archive, m_options.output, m_options.fsync)};
+
+        if (!keep_outputs) {
+            std::filesystem::remove_all(m_options.output);
+            m_layout.forget();
+        }
+
+        cin::log::info("Packed {} files into {}", packed, m_options.output_archive.string());
+    }
+
+    if (m_bundle) {
+        m_bundle->commit();
+    }
+
+    if (m_perf) {
+        m_perf->report();
+    }
+
+    return failed;
+}
+
+size_t cin::Encoder::failures() const
+{
+    return m_failures;
+}
+
+bool cin::Encoder::encode_one(const std::filesystem::path& path, cin::Arena& arena) const
+{
+    switch (m_ledger ? m_ledger->claim(path) : cin::Ledger::Claim::claimed) {
+    case cin::Ledger::Claim::claimed:
+        break;
+    case cin::Ledger::Claim::done:
+        cin::log::debug("Skipping {}, done by another process", path.string());
+        return true;
+    case cin::Ledger::Claim::held:
+        cin::log::debug("Skipping {}, claimed by another process", path.string());
+        return false;
+    }
+
+    const ArenaScope scope{arena};
+    const auto output_path{m_layout.output_path(path)};
+    std::optional<cin::VerifyReference> reference;
+
+    // Members are loaded whole and freed right after, so a large member does
+    // not stay in the worker's arena.
+    cin::Buffer<uint8_t> contents;
+
+    // Counts of failed files are dropped, they stopped at an arbitrary stage.
+    cin::PerfStages perf{m_perf != nullptr};
+
+    try {
+        // In a bundle, only sidecars need the output directory.
+        if (!m_bundle || m_options.loudness_json || m_options.peak_format != cin::PeakFormat::none) {
+            m_layout.prepare(output_path);
+        }
+
+        if (m_archive) {
+            m_archive->read(path, contents);
+        }
+
+        const cin::Buffer<uint8_t>* member{m_archive ? &contents : nullptr};
+        const float gain{normalization_gain(path, member, arena)};
+
+        if (m_verifier) {
+            reference.emplace(path, output_path);
+        }
+
+        encode_file(path, member, output_path, m_options, gain, arena, reference ? &*reference : nullptr,
+            m_bundle.get(), m_bundle ? bundle_name(output_path, m_options) : std::string{}, perf);
+    }
+    catch (...) {
+        if (m_ledger) {
+            m_ledger->release(path);
+        }
+
+        m_failures++;
+        throw;
+    }
+
+    if (m_perf) {
+        m_perf->add(perf);
+    }
+
+    // An input only counts as done once its MP3 passed verification, so a
+    // resumed run or another process encodes a corrupt one again.
+    if (reference) {
+        {
+            const std::lock_guard lock{m_verify_mutex};
+            m_verifying++;
+        }
+
+        m_verifier->submit(std::move(*reference), [this, path](bool passed) { verified(path, passed); });
+        return true;
+    }
+
+    complete(path);
+    return true;
+}
+
+void cin::Encoder::complete(const std::filesystem::path& path) const
+{
+    if (m_ledger) {
+        m_ledger->complete(path);
+    }
+
+    if (m_journal) {
+        m_journal->record(path);
+    }
+}
+
+void cin::Encoder::verified(const std::filesystem::path& path, bool passed) const
+{
+    if (!passed) {
+        if (m_ledger) {
+            m_ledger->release(path);
+        }
+
+        m_failures++;
+    }
+    else {
+        try {
+            complete(path);
+        }
+        catch (const std::exception& err) {
+            cin::log::error("Could not record {} as complete: {}", path.c_str(), err.what());
+            m_failures++;
+        }
+    }
+
+    const std::lock_guard lock{m_verify_mutex};
+    m_verifying--;
+    m_verify_failures += passed ? 0 : 1;
+    m_verify_idle.notify_all();
+}
+
+std::chrono::milliseconds cin::Encoder::retry_interval() const
+{
+    return m_ledger ? m_ledger->retry_interval() : std::chrono::milliseconds{0};
+}
+
+void cin::Encoder::encode_held(cin::Paths&& held, cin::Arena& arena) const
+{
+    // Claims of processes that died expire, so inputs held elsewhere are
+    // retried until some process has finished them.
+    while (!held.empty()) {
+        cin::log::info("Waiting for {} files claimed by other processes", held.size());
+        std::this_thread::sleep_for(retry_interval());
+
+        cin::Paths still_held;
+
+        for (const auto& path : held) {
+            try {
+                if (!encode_one(path, arena)) {
+                    still_held.push_back(path);
+                }
+            }
+            catch (const std::exception& err) {
+                cin::log::error("Error processing {}: {}", path.c_str(), err.what());
+            }
+        }
+
+        held.swap(still_held);
+    }
+}
 
 void cin::Encoder::encodemulti() const {
+    m_failures = 0;
     const unsigned int numCores = std::thread::hardware_concurrency();
+    cin::Paths held;
     // std::cout<<"number of cores\n"<<numCores<<std::flush;
     if (numCores <= 1 || m_paths.size() <= 1) {
         // Single-threaded encoding
-        
+        cin::Arena arena;
+
         for (const auto& path : m_paths) {
             try {
-                encode_file(path);
+                if (!encode_one(path, arena)) {
+                    held.push_back(path);
+                }
             } catch (const cin::WavFile::CouldNotRead& err) {
                 cin::log::error("Could not read {}: {}", path.c_str(), err.what());
             } catch (const cin::Encoder::UnsupportedFormat& err) {
@@ -91,40 +1001,72 @@ void cin::Encoder::encodemulti() const {
                 cin::log::error("Could not configure LAME: {}", err.what());
             } catch (const cin::Lame::EncodeError& err) {
                 cin::log::error("Failed to encode samples: {}", err.what());
+            } catch (const cin::OutputFile::CouldNotWrite& err) {
+                cin::log::error("Could not write output: {}", err.what());
+            } catch (const std::filesystem::filesystem_error& err) {
+                cin::log::error("Could not create output directory: {}", err.what());
+            } catch (const std::exception& err) {
+                cin::log::error("Error processing {}: {}", path.c_str(), err.what());
             }
         }
+
+        log_arena_stats(arena);
     } else {
-        // Parallel encoding
-        const size_t filesPerThread = m_paths.size() / numCores;
+        // Parallel encoding, largest files first to whichever worker is free
+        // so one long file does not leave the other cores idle at the end.
+        std::vector<uint64_t> costs;
+        std::vector<uint64_t> bytes;
+        estimate_jobs(costs, bytes);
+
+        cin::BatchScheduler scheduler{costs, std::move(bytes), m_options.memory_budget};
         std::vector<std::thread> threads;
+        std::mutex held_mutex;
 
         for (unsigned int i = 0; i < numCores; ++i) {
-            auto start = m_paths.begin() + i * filesPerThread;
-            auto end = (i == numCores - 1) ? m_paths.end() : start + filesPerThread;
-            std::vector<std::filesystem::path> chunk(start, end);
+            threads.emplace_back([this, &scheduler, &held, &held_mutex]() {
+                cin::Arena arena;
+                size_t index{0};
 
-            threads.emplace_back([this, chunk]() {
-                for (const auto& path : chunk) {
+                while (scheduler.next(index)) {
                     try {
-                        encode_file(path);
+                        if (!encode_one(m_paths[index], arena)) {
+                            const std::lock_guard lock{held_mutex};
+                            held.push_back(m_paths[index]);
+                        }
                     } catch (const std::exception& err) {
-                        cin::log::error("Error processing {}: {}", path.c_str(), err.what());
+                        cin::log::error("Error processing {}: {}", m_paths[index].c_str(), err.what());
                     }
+
+                    scheduler.done(index);
                 }
+
+                log_arena_stats(arena);
             });
         }
 
         for (std::thread& thread : threads) {
             thread.join();
         }
+
+        log_memory_use(scheduler, m_options.memory_budget);
     }
+
+    cin::Arena arena;
+    encode_held(std::move(held), arena);
+    finish();
 }
 
 void cin::Encoder::encode() const
 {
+    m_failures = 0;
+    cin::Arena arena;
+    cin::Paths held;
+
     for (const auto& path: m_paths) {
         try {
-            encode_file(path);
+            if (!encode_one(path, arena)) {
+                held.push_back(path);
+            }
         }
         catch (const cin::WavFile::CouldNotRead& err) {
             cin::log::error("Could not read {}: {}", path.c_str(), err.what());
@@ -138,5 +1080,19 @@ void cin::Encoder::encode() const
         catch (const cin::Lame::EncodeError& err) {
             cin::log::error("Failed to encode samples: {}", err.what());
         }
+        catch (const cin::OutputFile::CouldNotWrite& err) {
+            cin::log::error("Could not write output: {}", err.what());
+        }
+        catch (const std::filesystem::filesystem_error& err) {
+            cin::log::error("Could not create output directory: {}", err.what());
+        }
+        catch (const std::exception& err) {
+            cin::log::error("Error processing {}: {}", path.c_str(), err.what());
+        }
     }
-}
\ No newline at end of file
+
+    encode_held(std::move(held), arena);
+    log_arena_stats(arena);
+
+    finish();
+}
@@ -1,18 +1,132 @@
+#include <cerrno>
+#include <sys/stat.h>
+#include "archive.h"
 #include "fs.h"
 
-cin::Paths cin::get_valid_wav_files(const std::filesystem::path& path)
+namespace
+{
+    template <typename Iterator>
+    void collect_wav_files(Iterator iterator, cin::Paths& result)
+    {
+        for (const auto& entry: iterator) {
+            if (entry.is_regular_file()) {
+                const auto path{entry.path()};
+
+                if (path.has_extension() && path.extension() == ".wav") {
+                    result.push_back(path);
+                }
+            }
+        }
+    }
+}
+
+cin::Paths cin::get_valid_wav_files(const std::filesystem::path& path, bool recursive)
 {
     cin::Paths result;
 
-    for (const auto& entry: std::filesystem::directory_iterator{path}) {
-        if (entry.is_regular_file()) {
-            const auto path{entry.path()};
+    if (cin::is_archive(path)) {
+        return cin::Archive{path}.paths();
+    }
 
-            if (path.has_extension() && path.extension() == ".wav") {
-                result.push_back(path);
-            }
+    if (recursive) {
+        collect_wav_files(std::filesystem::recursive_directory_iterator{path}, result);
+    }
+    else {
+        collect_wav_files(std::filesystem::directory_iterator{path}, result);
+    }
+
+    return result;
+}
+
+uint64_t cin::stable_hash(const std::filesystem::path& path, const std::filesystem::path& root)
+{
+    uint64_t hash{14695981039346656037ULL};
+
+    for (const char c : path.lexically_proximate(root).generic_string()) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+bool cin::stamp_file(const std::filesystem::path& path, FileStamp& result)
+{
+    struct stat st{};
+
+    if (::stat(path.c_str(), &st) < 0) {
+        if (errno != ENOTDIR) {
+            return false;
+        }
+
+        // An archive member, <archive>/<member>, changes with its archive.
+        auto archive{path.parent_path()};
+
+        while (archive.has_relative_path() && ::stat(archive.c_str(), &st) < 0) {
+            archive = archive.parent_path();
+        }
+
+        if (!archive.has_relative_path() || !S_ISREG(st.st_mode) || !is_archive(archive)) {
+            return false;
         }
     }
 
+    result.size = static_cast<uint64_t>(st.st_size);
+    result.mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    return true;
+}
+
+cin::OutputLayout::OutputLayout(const std::filesystem::path& input_root, const std::filesystem::path& output_root)
+: m_input_root{input_root}
+, m_output_root{output_root}
+{}
+
+std::filesystem::path cin::OutputLayout::output_path(const std::filesystem::path& input) const
+{
+    std::filesystem::path result;
+
+    if (m_output_root.empty()) {
+        result = input;
+    }
+    else {
+        auto relative{input.lexically_relative(m_input_root)};
+
+        if (relative.empty() || *relative.begin() == "..") {
+            relative = input.filename();
+        }
+
+        result = m_output_root / relative;
+    }
+
+    result.replace_extension(".mp3");
     return result;
 }
+
+void cin::OutputLayout::prepare(const std::filesystem::path& output) const
+{
+    if (m_output_root.empty()) {
+        return;
+    }
+
+    const auto directory{output.parent_path()};
+
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+
+        if (m_created.count(directory.string()) > 0) {
+            return;
+        }
+    }
+
+    // Created outside the lock so workers in different subtrees do not wait on
+    // each other, create_directories() tolerates concurrent creation.
+    std::filesystem::create_directories(directory);
+
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_created.insert(directory.string());
+}
+
+void cin::OutputLayout::forget() const
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_created.clear();
+}
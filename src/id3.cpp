@@ -0,0 +1,51 @@
+#include <cstring>
+#include "id3.h"
+#include "log.h"
+
+namespace
+{
+    constexpr size_t header_size{10};
+
+    void put_be32(uint8_t* p, uint32_t value, int bits_per_byte)
+    {
+        const uint32_t mask{(1U << bits_per_byte) - 1};
+
+        for (int i = 3; i >= 0; --i) {
+            p[i] = static_cast<uint8_t>(value & mask);
+            value >>= bits_per_byte;
+        }
+    }
+
+    size_t put_txxx(uint8_t* p, const char* description, const std::string& value)
+    {
+        const size_t description_size{std::strlen(description) + 1};
+        const size_t payload_size{1 + description_size + value.size()};
+
+        std::memcpy(p, "TXXX", 4);
+        put_be32(p + 4, static_cast<uint32_t>(payload_size), 8);
+        p[8] = 0;
+        p[9] = 0;
+        p[10] = 0;  // ISO-8859-1
+        std::memcpy(p + 11, description, description_size);
+        std::memcpy(p + 11 + description_size, value.data(), value.size());
+        return header_size + payload_size;
+    }
+}
+
+cin::id3::Tag cin::id3::empty_tag()
+{
+    Tag tag{};
+    std::memcpy(tag.data(), "ID3\x03\x00\x00", 6);
+    put_be32(tag.data() + 6, reserved_size - header_size, 7);
+    return tag;
+}
+
+cin::id3::Tag cin::id3::replaygain_tag(const LoudnessResult& result)
+{
+    Tag tag{empty_tag()};
+    size_t offset{header_size};
+
+    offset += put_txxx(tag.data() + offset, "REPLAYGAIN_TRACK_GAIN", fmt::format("{:+.2f} dB", result.replaygain_db));
+    put_txxx(tag.data() + offset, "REPLAYGAIN_TRACK_PEAK", fmt::format("{:.6f}", result.replaygain_peak));
+    return tag;
+}
@@ -0,0 +1,74 @@
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include "journal.h"
+#include "log.h"
+#include "output.h"
+
+cin::Journal::Journal(const std::filesystem::path& path, FsyncPolicy policy)
+: m_path{path}
+, m_policy{policy}
+, m_fd{-1}
+{
+    std::ifstream existing{path};
+    std::string line;
+
+    while (std::getline(existing, line)) {
+        std::istringstream fields{line};
+        FileStamp entry{};
+        std::string input;
+
+        // A torn last line from a crash is simply not a valid entry.
+        if (fields >> entry.size >> entry.mtime && fields.get() == ' ' && std::getline(fields, input)) {
+            m_entries[input] = entry;
+        }
+    }
+
+    m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+    if (m_fd < 0) {
+        throw OutputFile::CouldNotWrite{fmt::format("Could not open journal {}: {}", path.string(), std::strerror(errno))};
+    }
+
+    cin::log::debug("Loaded {} journal entries from {}", m_entries.size(), path.string());
+}
+
+cin::Journal::~Journal()
+{
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+}
+
+bool cin::Journal::is_complete(const std::filesystem::path& input) const
+{
+    const auto entry{m_entries.find(input.string())};
+    FileStamp current{};
+
+    return entry != m_entries.end() && stamp_file(input, current) && entry->second == current;
+}
+
+void cin::Journal::record(const std::filesystem::path& input)
+{
+    FileStamp current{};
+
+    if (!stamp_file(input, current)) {
+        return;
+    }
+
+    // One write() per entry, O_APPEND keeps lines intact across processes.
+    const auto line{fmt::format("{} {} {}\n", current.size, current.mtime, input.string())};
+
+    std::lock_guard<std::mutex> lock{m_mutex};
+
+    if (::write(m_fd, line.data(), line.size()) != static_cast<ssize_t>(line.size())) {
+        throw OutputFile::CouldNotWrite{fmt::format("Could not append to journal {}: {}", m_path.string(), std::strerror(errno))};
+    }
+
+    if (m_policy != FsyncPolicy::none && ::fdatasync(m_fd) < 0) {
+        throw OutputFile::CouldNotWrite{fmt::format("Could not sync journal {}: {}", m_path.string(), std::strerror(errno))};
+    }
+}
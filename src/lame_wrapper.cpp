@@ -63,12 +63,22 @@ cin::Lame::Lame(int num_channels, int sample_rate)
     }
 }
 
-size_t cin::Lame::encode(const std::vector<int16_t>& samples, std::vector<uint8_t>& data) const
+size_t cin::Lame::max_encoded_size(size_t num_frames)
 {
-    const auto sample_data{const_cast<int16_t *>(samples.data())};
+    return num_frames + (num_frames + 3) / 4 + 7200;
+}
+
+size_t cin::Lame::encode(const Buffer<int16_t>& samples, Buffer<uint8_t>& data) const
+{
+    return encode(samples.data(), samples.size(), data);
+}
+
+size_t cin::Lame::encode(const int16_t* samples, size_t num_samples, Buffer<uint8_t>& data) const
+{
+    const auto sample_data{const_cast<int16_t *>(samples)};
     const ssize_t size{m_mono
-        ? lame_encode_buffer(m_lame.get(), sample_data, nullptr, samples.size(), data.data(), data.size())
-        : lame_encode_buffer_interleaved(m_lame.get(), sample_data, samples.size() / 2, data.data(), data.size())
+        ? lame_encode_buffer(m_lame.get(), sample_data, nullptr, num_samples, data.data(), data.capacity())
+        : lame_encode_buffer_interleaved(m_lame.get(), sample_data, num_samples / 2, data.data(), data.capacity())
     };
 
     throw_on_error(size);
@@ -76,10 +86,15 @@ size_t cin::Lame::encode(const std::vector<int16_t>& samples, std::vector<uint8_
     return size;
 }
 
-size_t cin::Lame::flush(std::vector<uint8_t>& data) const
+size_t cin::Lame::flush(Buffer<uint8_t>& data) const
 {
-    const ssize_t size{lame_encode_flush(m_lame.get(), data.data(), data.size())};
+    const ssize_t size{lame_encode_flush(m_lame.get(), data.data(), data.capacity())};
     throw_on_error(size);
     data.resize(size);
     return size;
 }
+
+int cin::Lame::encoder_delay() const
+{
+    return lame_get_encoder_delay(m_lame.get());
+}
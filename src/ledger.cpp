@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "ledger.h"
+#include "log.h"
+#include "output.h"
+
+namespace
+{
+    std::string owner_name()
+    {
+        char host[256]{};
+
+        if (::gethostname(host, sizeof(host) - 1) < 0) {
+            std::strcpy(host, "unknown");
+        }
+
+        return fmt::format("{}.{}", host, ::getpid());
+    }
+
+    bool write_file(const std::filesystem::path& path, const std::string& content, int flags)
+    {
+        const int fd{::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | flags, 0644)};
+
+        if (fd < 0) {
+            return false;
+        }
+
+        const bool ok{::write(fd, content.data(), content.size()) == static_cast<ssize_t>(content.size())};
+        ::close(fd);
+        return ok;
+    }
+}
+
+cin::Ledger::Ledger(const std::filesystem::path& directory, const std::filesystem::path& input_root, double lease)
+: m_directory{directory}
+, m_input_root{input_root}
+, m_lease{lease}
+, m_owner{owner_name()}
+{
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+
+    if (error) {
+        throw OutputFile::CouldNotWrite{fmt::format("Could not create ledger {}: {}", directory.string(), error.message())};
+    }
+
+    m_renewer = std::thread{[this]() { renew(); }};
+    cin::log::info("Sharing work through ledger {} as {}", directory.string(), m_owner);
+}
+
+cin::Ledger::~Ledger()
+{
+    {
+        const std::lock_guard lock{m_mutex};
+        m_stop = true;
+
+        for (const auto& claim : m_claims) {
+            ::unlink(claim.c_str());
+        }
+    }
+
+    m_stopping.notify_all();
+    m_renewer.join();
+
+    cin::log::info("Ledger: {} files encoded here, {} already done elsewhere", m_completed, m_done_elsewhere);
+}
+
+std::filesystem::path cin::Ledger::entry_path(const std::filesystem::path& input, const char* suffix) const
+{
+    return m_directory / fmt::format("{:016x}{}", stable_hash(input, m_input_root), suffix);
+}
+
+bool cin::Ledger::is_done(const std::filesystem::path& input, const std::filesystem::path& marker) const
+{
+    std::ifstream file{marker};
+    FileStamp recorded{};
+    FileStamp current{};
+
+    return file >> recorded.size >> recorded.mtime && stamp_file(input, current) && recorded == current;
+}
+
+bool cin::Ledger::expire(const std::filesystem::path& claim) const
+{
+    struct stat st{};
+
+    if (::stat(claim.c_str(), &st) < 0) {
+        return errno == ENOENT;
+    }
+
+    const auto touched{std::chrono::system_clock::time_point{std::chrono::duration_cast<std::chrono::system_clock::duration>(
+        std::chrono::seconds{st.st_mtim.tv_sec} + std::chrono::nanoseconds{st.st_mtim.tv_nsec})}};
+
+    if (std::chrono::system_clock::now() - touched < m_lease) {
+        return false;
+    }
+
+    // Only one contender gets to rename the stale claim aside. If it was
+    // renewed or replaced since the stat, it is put back.
+    const std::filesystem::path aside{claim.string() + ".expired." + m_owner};
+
+    if (::rename(claim.c_str(), aside.c_str()) < 0) {
+        return errno == ENOENT;
+    }
+
+    struct stat renamed{};
+
+    if (::stat(aside.c_str(), &renamed) == 0 && (renamed.st_ino != st.st_ino
+            || renamed.st_mtim.tv_sec != st.st_mtim.tv_sec || renamed.st_mtim.tv_nsec != st.st_mtim.tv_nsec)) {
+        ::link(aside.c_str(), claim.c_str());
+        ::unlink(aside.c_str());
+        return false;
+    }
+
+    ::unlink(aside.c_str());
+    cin::log::warn("Taking over {} from an expired lease", claim.filename().string());
+    return true;
+}
+
+cin::Ledger::Claim cin::Ledger::claim(const std::filesystem::path& input)
+{
+    const auto marker{entry_path(input, ".done")};
+    const auto claim{entry_path(input, ".claim")};
+
+    if (is_done(input, marker)) {
+        const std::lock_guard lock{m_mutex};
+        m_done_elsewhere++;
+        return Claim::done;
+    }
+
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        if (write_file(claim, fmt::format("{}\n{}\n", m_owner, input.lexically_proximate(m_input_root).string()), O_EXCL)) {
+            // The previous owner may have finished between the check and the
+            // create.
+            if (is_done(input, marker)) {
+                ::unlink(claim.c_str());
+                const std::lock_guard lock{m_mutex};
+                m_done_elsewhere++;
+                return Claim::done;
+            }
+
+            const std::lock_guard lock{m_mutex};
+            m_claims.insert(claim);
+            return Claim::claimed;
+        }
+
+        if (errno != EEXIST) {
+            throw OutputFile::CouldNotWrite{fmt::format("Could not claim {}: {}", input.string(), std::strerror(errno))};
+        }
+
+        if (!expire(claim)) {
+            break;
+        }
+    }
+
+    return Claim::held;
+}
+
+void cin::Ledger::complete(const std::filesystem::path& input)
+{
+    FileStamp current{};
+
+    if (!stamp_file(input, current)) {
+        release(input);
+        return;
+    }
+
+    const auto marker{entry_path(input, ".done")};
+    const std::filesystem::path temp{marker.string() + "." + m_owner};
+
+    if (!write_file(temp, fmt::format("{} {}\n", current.size, current.mtime), O_TRUNC)
+            || ::rename(temp.c_str(), marker.c_str()) < 0) {
+        const int error{errno};
+        ::unlink(temp.c_str());
+        release(input);
+        throw OutputFile::CouldNotWrite{fmt::format("Could not mark {} done: {}", input.string(), std::strerror(error))};
+    }
+
+    release(input);
+
+    const std::lock_guard lock{m_mutex};
+    m_completed++;
+}
+
+void cin::Ledger::release(const std::filesystem::path& input)
+{
+    const auto claim{entry_path(input, ".claim")};
+    const std::lock_guard lock{m_mutex};
+
+    if (m_claims.erase(claim) > 0) {
+        ::unlink(claim.c_str());
+    }
+}
+
+std::chrono::milliseconds cin::Ledger::retry_interval() const
+{
+    return std::max(std::chrono::milliseconds{1000}, std::chrono::duration_cast<std::chrono::milliseconds>(m_lease / 4));
+}
+
+void cin::Ledger::renew()
+{
+    std::unique_lock lock{m_mutex};
+
+    while (!m_stopping.wait_for(lock, retry_interval(), [this]() { return m_stop; })) {
+        for (const auto& claim : m_claims) {
+            if (::utimensat(AT_FDCWD, claim.c_str(), nullptr, 0) < 0) {
+                cin::log::warn("Lost claim {}: {}", claim.filename().string(), std::strerror(errno));
+            }
+        }
+    }
+}
@@ -0,0 +1,197 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "loudness.h"
+#include "simd.h"
+
+namespace
+{
+    constexpr double pi{3.14159265358979323846};
+    constexpr double absolute_gate{-70.0};
+    constexpr double relative_gate{-10.0};
+    constexpr double bin_width{0.1};
+    constexpr double replaygain_reference{-18.0};
+    constexpr int oversampling{4};
+    constexpr int taps{12};
+
+    // Interpolation filter for the true peak, coefficients[tap][phase] so one
+    // tap of all four phases is a single vector.
+    struct TruePeakFilter {
+        alignas(16) float coefficients[taps][oversampling];
+
+        TruePeakFilter()
+        {
+            constexpr int length{taps * oversampling};
+            constexpr double cutoff{0.5 / oversampling * 0.9};
+            const double center{(length - 1) / 2.0};
+
+            for (int k = 0; k < length; ++k) {
+                const double x{2.0 * cutoff * (k - center)};
+                const double sinc{x == 0.0 ? 1.0 : std::sin(pi * x) / (pi * x)};
+                const double window{0.5 - 0.5 * std::cos(2.0 * pi * (k + 0.5) / length)};
+                coefficients[k / oversampling][k % oversampling] = static_cast<float>(2.0 * cutoff * oversampling * sinc * window);
+            }
+        }
+    };
+
+    const TruePeakFilter& true_peak_filter()
+    {
+        static const TruePeakFilter filter;
+        return filter;
+    }
+
+    double to_db(double value)
+    {
+        return value > 0.0 ? 20.0 * std::log10(value) : -std::numeric_limits<double>::infinity();
+    }
+}
+
+void cin::apply_gain(int16_t* samples, size_t count, float gain)
+{
+    cin::simd().apply_gain(samples, count, gain);
+}
+
+bool cin::LoudnessResult::valid() const
+{
+    return std::isfinite(integrated_lufs);
+}
+
+cin::LoudnessMeter::LoudnessMeter(int sample_rate, int num_channels)
+: m_rate{sample_rate}
+, m_channels{std::clamp(num_channels, 1, max_channels)}
+, m_hop_frames{static_cast<size_t>(std::max(sample_rate / 10, 1))}
+, m_oversample{sample_rate < 96000}
+{
+    // K-weighting pre-filter and RLB high-pass of BS.1770, derived for the
+    // actual sample rate from their analog prototypes.
+    double k{std::tan(pi * 1681.974450955533 / sample_rate)};
+    double q{0.7071752369554196};
+    const double vh{std::pow(10.0, 3.999843853973347 / 20.0)};
+    const double vb{std::pow(vh, 0.4996667741545416)};
+    double a0{1.0 + k / q + k * k};
+
+    m_shelf = {
+        (vh + vb * k / q + k * k) / a0,
+        2.0 * (k * k - vh) / a0,
+        (vh - vb * k / q + k * k) / a0,
+        2.0 * (k * k - 1.0) / a0,
+        (1.0 - k / q + k * k) / a0,
+    };
+
+    k = std::tan(pi * 38.13547087602444 / sample_rate);
+    q = 0.5003270373238773;
+    a0 = 1.0 + k / q + k * k;
+
+    m_highpass = {
+        1.0,
+        -2.0,
+        1.0,
+        2.0 * (k * k - 1.0) / a0,
+        (1.0 - k / q + k * k) / a0,
+    };
+}
+
+void cin::LoudnessMeter::process(const int16_t* samples, size_t num_frames)
+{
+    const cin::Kernels& kernels{cin::simd()};
+    const float* coefficients{&true_peak_filter().coefficients[0][0]};
+    m_sample_peak = std::max(m_sample_peak, kernels.sample_peak(samples, num_frames * m_channels));
+    m_frames += num_frames;
+
+    for (size_t frame = 0; frame < num_frames; ++frame) {
+        for (int channel = 0; channel < m_channels; ++channel) {
+            const double x{samples[frame * m_channels + channel] / 32768.0};
+            double* z{m_state[channel]};
+
+            // Direct form II transposed, shelf then high-pass.
+            const double y1{m_shelf.b0 * x + z[0]};
+            z[0] = m_shelf.b1 * x - m_shelf.a1 * y1 + z[1];
+            z[1] = m_shelf.b2 * x - m_shelf.a2 * y1;
+
+            const double y2{m_highpass.b0 * y1 + z[2]};
+            z[2] = m_highpass.b1 * y1 - m_highpass.a1 * y2 + z[3];
+            z[3] = m_highpass.b2 * y1 - m_highpass.a2 * y2;
+
+            m_hop_energy += y2 * y2;
+
+            if (m_oversample) {
+                float* history{m_history[channel]};
+                const float value{static_cast<float>(x)};
+                history[m_history_position] = value;
+                history[m_history_position + true_peak_taps] = value;
+                m_true_peak = std::max(m_true_peak, kernels.interpolated_peak(history + m_history_position + 1, coefficients));
+            }
+        }
+
+        m_history_position = (m_history_position + 1) % true_peak_taps;
+
+        if (++m_hop_position == m_hop_frames) {
+            finish_hop();
+        }
+    }
+}
+
+void cin::LoudnessMeter::finish_hop()
+{
+    m_hops[m_num_hops % m_hops.size()] = m_hop_energy;
+    m_num_hops++;
+    m_hop_energy = 0.0;
+    m_hop_position = 0;
+
+    if (m_num_hops < m_hops.size()) {
+        return;
+    }
+
+    const double energy{(m_hops[0] + m_hops[1] + m_hops[2] + m_hops[3]) / (m_hops.size() * m_hop_frames)};
+    const double loudness{-0.691 + 10.0 * std::log10(energy)};
+
+    if (!(loudness > absolute_gate)) {
+        return;
+    }
+
+    const int bin{std::min(static_cast<int>((loudness - absolute_gate) / bin_width), histogram_bins - 1)};
+    m_bin_energy[bin] += energy;
+    m_bin_count[bin]++;
+}
+
+cin::LoudnessResult cin::LoudnessMeter::result() const
+{
+    double energy{0.0};
+    uint64_t count{0};
+
+    for (int bin = 0; bin < histogram_bins; ++bin) {
+        energy += m_bin_energy[bin];
+        count += m_bin_count[bin];
+    }
+
+    double integrated{-std::numeric_limits<double>::infinity()};
+
+    if (count > 0) {
+        const double gate{-0.691 + 10.0 * std::log10(energy / count) + relative_gate};
+        const int first{std::max(0, static_cast<int>(std::ceil((gate - absolute_gate) / bin_width)))};
+
+        energy = 0.0;
+        count = 0;
+
+        for (int bin = first; bin < histogram_bins; ++bin) {
+            energy += m_bin_energy[bin];
+            count += m_bin_count[bin];
+        }
+
+        if (count > 0) {
+            integrated = -0.691 + 10.0 * std::log10(energy / count);
+        }
+    }
+
+    const double sample_peak{m_sample_peak / 32768.0};
+    const double true_peak{std::max(sample_peak, static_cast<double>(m_true_peak))};
+
+    return {
+        integrated,
+        to_db(true_peak),
+        to_db(sample_peak),
+        replaygain_reference - integrated,
+        true_peak,
+        static_cast<double>(m_frames) / m_rate,
+    };
+}
@@ -1,7 +1,14 @@
 #include <filesystem>
 #include "log.h"
 #include "fs.h"
+#include "benchmark.h"
+#include "daemon.h"
 #include "encoder.h"
+#include "options.h"
+#include "plan.h"
+#include "shard.h"
+#include "simd.h"
+#include "watch.h"
 #include <chrono>
 #include <thread>
 #include <iostream>
@@ -9,49 +16,93 @@
 int main(int argc, const char* argv[])
 {
     using std::chrono::high_resolution_clock;
-    using std::chrono::duration_cast;
     using std::chrono::duration;
-    using std::chrono::milliseconds;
 
     cin::log::init();
 
-    if (argc == 1) {
-        cin::log::warn("Not enough arguments. Usage: {} <path-to-files>", argv[0]);
-        return EXIT_FAILURE;
-    }
+    cin::Options options;
 
-    if (argc > 2) {
-        cin::log::warn("More than one argument given, ignoring everything after {}", argv[1]);
+    try {
+        options = cin::parse_options(argc, argv);
+    }
+    catch (const cin::Options::InvalidArgument& error) {
+        cin::log::warn("{}. {}", error.what(), cin::usage(argv[0]));
+        return EXIT_FAILURE;
     }
 
     try {
-        const cin::Encoder encoder{cin::get_valid_wav_files({argv[1]})};
+        if (options.simd) {
+            cin::select_simd(*options.simd);
+        }
 
-        auto t1 = high_resolution_clock::now();
-        encoder.encode();
-        auto t2 = high_resolution_clock::now();
+        if (!options.submit_socket.empty()) {
+            return cin::submit_job(options.submit_socket, argc, argv);
+        }
 
-        auto t3 = high_resolution_clock::now();
-        encoder.encodemulti();
-        auto t4 = high_resolution_clock::now();
+        if (!options.merge_shards.empty()) {
+            return cin::merge_shard_summaries(options.merge_shards);
+        }
+
+        if (!options.daemon_socket.empty()) {
+            cin::Daemon daemon{options.daemon_socket};
+            daemon.run();
+            return EXIT_SUCCESS;
+        }
+
+        if (options.watch) {
+            cin::Watcher watcher{options};
+            watcher.run();
+            return EXIT_SUCCESS;
+        }
+
+        if (options.benchmark) {
+            cin::benchmark_block_sizes(cin::get_valid_wav_files(options.input, options.recursive), options);
+            return EXIT_SUCCESS;
+        }
 
-        /* Getting number of milliseconds as an integer. */
-        auto ms_int = duration_cast<milliseconds>(t2 - t1);
-        auto ms_int2 = duration_cast<milliseconds>(t4 - t3);
+        if (options.simd_check) {
+            return cin::check_simd(cin::get_valid_wav_files(options.input, options.recursive));
+        }
+
+        if (options.plan) {
+            cin::plan_batch(cin::get_valid_wav_files(options.input, options.recursive), options);
+            return EXIT_SUCCESS;
+        }
+
+        auto paths{cin::get_valid_wav_files(options.input, options.recursive)};
+        cin::Shard shard;
+
+        if (options.shard_count > 1) {
+            shard = cin::select_shard(paths, options);
+            paths = shard.paths;
+        }
+
+        const cin::Encoder encoder{std::move(paths), options};
+
+        // One pass: it packs the output archive and publishes the bundle when
+        // it finishes.
+        auto t1 = high_resolution_clock::now();
+        encoder.encodemulti();
+        auto t2 = high_resolution_clock::now();
 
         /* Getting number of milliseconds as a double. */
         duration<double, std::milli> ms_double = t2 - t1;
-        duration<double, std::milli> ms_double2 = t4 - t3;
+
+        if (options.shard_count > 1) {
+            cin::write_shard_summary(shard, encoder.failures(), ms_double.count() / 1000.0, options);
+        }
 
         const unsigned int numCores = std::thread::hardware_concurrency();
-        // std::cout<<"number of cores\n"<<numCores<<std::flush;
 
-         cin::log::debug(" Single thread: {:.2f} ms, Multi thread: {:.2f} ms, number of cores: {}",
+        cin::log::debug(" Encoded in {:.2f} ms, number of cores: {}",
             ms_double.count(),
-            ms_double2.count(),
             numCores
             );
 
+        if (encoder.failures() > 0) {
+            return EXIT_FAILURE;
+        }
+
         return EXIT_SUCCESS;
     }
     catch (const std::runtime_error& error) {
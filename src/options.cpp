@@ -0,0 +1,490 @@
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include "log.h"
+#include "options.h"
+#include "resampler.h"
+
+namespace
+{
+    const char* next_value(int argc, const char* argv[], int& i)
+    {
+        if (i + 1 >= argc) {
+            throw cin::Options::InvalidArgument{fmt::format("{} requires a value", argv[i])};
+        }
+
+        return argv[++i];
+    }
+
+    size_t parse_block_size(const char* value)
+    {
+        if (std::strcmp(value, "auto") == 0) {
+            return 0;
+        }
+
+        char* end{nullptr};
+        const unsigned long frames{std::strtoul(value, &end, 10)};
+
+        if (end == value || *end != '\0' || frames == 0 || frames > (1 << 20)) {
+            throw cin::Options::InvalidArgument{fmt::format("invalid block size '{}'", value)};
+        }
+
+        return frames;
+    }
+
+    std::vector<float> parse_matrix(const char* value)
+    {
+        std::vector<float> result;
+        size_t columns{0};
+        size_t rows{1};
+        const char* p{value};
+
+        while (*p != '\0') {
+            char* end{nullptr};
+            result.push_back(std::strtof(p, &end));
+
+            if (end == p) {
+                throw cin::Options::InvalidArgument{fmt::format("invalid downmix matrix '{}'", value)};
+            }
+
+            p = end;
+
+            if (*p == ';') {
+                columns = columns == 0 ? result.size() : columns;
+                rows++;
+            }
+
+            if (*p == ',' || *p == ';') {
+                p++;
+            }
+        }
+
+        if (rows != 2 || result.size() != 2 * columns) {
+            throw cin::Options::InvalidArgument{fmt::format("downmix matrix '{}' needs two rows of equal length", value)};
+        }
+
+        return result;
+    }
+
+    int parse_rate(const char* value)
+    {
+        const int rate{std::atoi(value)};
+
+        if (!cin::Resampler::is_mp3_rate(rate)) {
+            throw cin::Options::InvalidArgument{fmt::format("'{}' is not an MP3 sample rate", value)};
+        }
+
+        return rate;
+    }
+
+    cin::ResampleQuality parse_quality(const char* value)
+    {
+        if (std::strcmp(value, "fast") == 0) {
+            return cin::ResampleQuality::fast;
+        }
+        else if (std::strcmp(value, "medium") == 0) {
+            return cin::ResampleQuality::medium;
+        }
+        else if (std::strcmp(value, "best") == 0) {
+            return cin::ResampleQuality::best;
+        }
+
+        throw cin::Options::InvalidArgument{fmt::format("unknown resample quality '{}'", value)};
+    }
+
+    std::optional<cin::SimdLevel> parse_simd(const char* value)
+    {
+        if (std::strcmp(value, "auto") == 0) {
+            return std::nullopt;
+        }
+        else if (std::strcmp(value, "scalar") == 0) {
+            return cin::SimdLevel::scalar;
+        }
+        else if (std::strcmp(value, "sse2") == 0) {
+            return cin::SimdLevel::sse2;
+        }
+        else if (std::strcmp(value, "avx2") == 0) {
+            return cin::SimdLevel::avx2;
+        }
+        else if (std::strcmp(value, "avx512") == 0) {
+            return cin::SimdLevel::avx512;
+        }
+
+        throw cin::Options::InvalidArgument{fmt::format("unknown instruction set '{}'", value)};
+    }
+
+    double parse_number(const char* value, const char* what)
+    {
+        char* end{nullptr};
+        const double result{std::strtod(value, &end)};
+
+        if (end == value || *end != '\0' || !std::isfinite(result)) {
+            throw cin::Options::InvalidArgument{fmt::format("invalid {} '{}'", what, value)};
+        }
+
+        return result;
+    }
+
+    cin::PeakFormat parse_peak_format(const char* value)
+    {
+        if (std::strcmp(value, "json") == 0) {
+            return cin::PeakFormat::json;
+        }
+        else if (std::strcmp(value, "binary") == 0) {
+            return cin::PeakFormat::binary;
+        }
+
+        throw cin::Options::InvalidArgument{fmt::format("unknown peak format '{}'", value)};
+    }
+
+    size_t parse_count(const char* value, const char* what)
+    {
+        char* end{nullptr};
+        const unsigned long count{std::strtoul(value, &end, 10)};
+
+        if (end == value || *end != '\0' || value[0] == '-') {
+            throw cin::Options::InvalidArgument{fmt::format("invalid {} '{}'", what, value)};
+        }
+
+        return count;
+    }
+
+    cin::Priority parse_priority(const char* value)
+    {
+        if (std::strcmp(value, "interactive") == 0) {
+            return cin::Priority::interactive;
+        }
+        else if (std::strcmp(value, "normal") == 0) {
+            return cin::Priority::normal;
+        }
+        else if (std::strcmp(value, "bulk") == 0) {
+            return cin::Priority::bulk;
+        }
+
+        throw cin::Options::InvalidArgument{fmt::format("unknown priority '{}'", value)};
+    }
+
+    std::vector<size_t> parse_peak_levels(const char* value)
+    {
+        std::vector<size_t> result;
+        const char* p{value};
+
+        while (*p != '\0') {
+            char* end{nullptr};
+            const unsigned long frames{std::strtoul(p, &end, 10)};
+
+            if (end == p || (*end != ',' && *end != '\0') || frames == 0 || frames > (1 << 24)) {
+                throw cin::Options::InvalidArgument{fmt::format("invalid peak levels '{}'", value)};
+            }
+
+            if (!result.empty() && (frames <= result.back() || frames % result.front() != 0)) {
+                throw cin::Options::InvalidArgument{fmt::format("peak levels '{}' must ascend in multiples of the first", value)};
+            }
+
+            result.push_back(frames);
+            p = *end == ',' ? end + 1 : end;
+        }
+
+        if (result.empty()) {
+            throw cin::Options::InvalidArgument{"no peak levels given"};
+        }
+
+        return result;
+    }
+
+    uint64_t parse_size(const char* value)
+    {
+        char* end{nullptr};
+        const double number{std::strtod(value, &end)};
+        double scale{1.0};
+
+        if (*end == 'K' || *end == 'k') {
+            scale = 1024.0;
+        }
+        else if (*end == 'M' || *end == 'm') {
+            scale = 1024.0 * 1024.0;
+        }
+        else if (*end == 'G' || *end == 'g') {
+            scale = 1024.0 * 1024.0 * 1024.0;
+        }
+
+        if (scale > 1.0) {
+            end++;
+        }
+
+        if (end == value || *end != '\0' || !(number > 0.0) || !std::isfinite(number)) {
+            throw cin::Options::InvalidArgument{fmt::format("invalid size '{}'", value)};
+        }
+
+        return static_cast<uint64_t>(number * scale);
+    }
+
+    cin::FsyncPolicy parse_fsync(const char* value)
+    {
+        if (std::strcmp(value, "none") == 0) {
+            return cin::FsyncPolicy::none;
+        }
+        else if (std::strcmp(value, "file") == 0) {
+            return cin::FsyncPolicy::file;
+        }
+        else if (std::strcmp(value, "full") == 0) {
+            return cin::FsyncPolicy::full;
+        }
+
+        throw cin::Options::InvalidArgument{fmt::format("unknown fsync policy '{}'", value)};
+    }
+}
+
+cin::Options cin::parse_options(int argc, const char* argv[])
+{
+    Options options;
+    bool have_input{false};
+
+    for (int i = 1; i < argc; ++i) {
+        const char* arg{argv[i]};
+
+        if (std::strcmp(arg, "--output-dir") == 0) {
+            options.output = next_value(argc, argv, i);
+        }
+        else if (std::strcmp(arg, "--output-archive") == 0) {
+            options.output_archive = next_value(argc, argv, i);
+        }
+        else if (std::strcmp(arg, "--bundle") == 0) {
+            options.bundle = next_value(argc, argv, i);
+        }
+        else if (std::strcmp(arg, "--recursive") == 0) {
+            options.recursive = true;
+        }
+        else if (std::strcmp(arg, "--block-size") == 0) {
+            options.block_frames = parse_block_size(next_value(argc, argv, i));
+        }
+        else if (std::strcmp(arg, "--streaming") == 0) {
+            options.workload = Workload::streaming;
+        }
+        else if (std::strcmp(arg, "--benchmark") == 0) {
+            options.benchmark = true;
+        }
+        else if (std::strcmp(arg, "--plan") == 0) {
+            options.plan = true;
+        }
+        else if (std::strcmp(arg, "--simd") == 0) {
+            options.simd = parse_simd(next_value(argc, argv, i));
+        }
+        else if (std::strcmp(arg, "--simd-check") == 0) {
+            options.simd_check = true;
+        }
+        else if (std::strcmp(arg, "--perf-counters") == 0) {
+            options.perf_counters = true;
+        }
+        else if (std::strcmp(arg, "--daemon") == 0) {
+            options.daemon_socket = next_value(argc, argv, i);
+        }
+        else if (std::strcmp(arg, "--watch") == 0) {
+            options.watch = true;
+            options.input = next_value(argc, argv, i);
+            have_input = true;
+        }
+        else if (std::strcmp(arg, "--watch-settle") == 0) {
+            const double ms{parse_number(next_value(argc, argv, i), "settle time")};
+
+            if (ms < 0.0) {
+                throw Options::InvalidArgument{"settle time must not be negative"};
+            }
+
+            options.watch_settle = ms / 1000.0;
+        }
+        else if (std::strcmp(arg, "--submit") == 0) {
+            options.submit_socket = next_value(argc, argv, i);
+        }
+        else if (std::strcmp(arg, "--priority") == 0) {
+            options.priority = parse_priority(next_value(argc, argv, i));
+        }
+        else if (std::strcmp(arg, "--deadline") == 0) {
+            const double ms{parse_number(next_value(argc, argv, i), "deadline")};
+
+            if (ms < 0.0) {
+                throw Options::InvalidArgument{"deadline must not be negative"};
+            }
+
+            options.deadline = ms / 1000.0;
+        }
+        else if (std::strcmp(arg, "--downmix-matrix") == 0) {
+            options.downmix_matrix = parse_matrix(next_value(argc, argv, i));
+        }
+        else if (std::strcmp(arg, "--resample") == 0) {
+            options.resample_rate = parse_rate(next_value(argc, argv, i));
+        }
+        else if (std::strcmp(arg, "--resample-quality") == 0) {
+            options.resample_quality = parse_quality(next_value(argc, argv, i));
+        }
+        else if (std::strcmp(arg, "--loudness") == 0) {
+            const char* value{next_value(argc, argv, i)};
+            const bool both{std::strcmp(value, "both") == 0};
+
+            if (!both && std::strcmp(value, "json") != 0 && std::strcmp(value, "tags") != 0) {
+                throw Options::InvalidArgument{fmt::format("unknown loudness output '{}'", value)};
+            }
+
+            options.loudness_json = both || std::strcmp(value, "json") == 0;
+            options.replaygain_tags = both || std::strcmp(value, "tags") == 0;
+        }
+        else if (std::strcmp(arg, "--normalize") == 0) {
+            const double lufs{parse_number(next_value(argc, argv, i), "loudness target")};
+
+            if (lufs >= 0.0 || lufs < -70.0) {
+                throw Options::InvalidArgument{"loudness target must be between -70 and 0 LUFS"};
+            }
+
+            options.normalize_lufs = lufs;
+        }
+        else if (std::strcmp(arg, "--analysis-cache") == 0) {
+            options.analysis_cache = next_value(argc, argv, i);
+        }
+        else if (std::strcmp(arg, "--trim") == 0) {
+            const double db{parse_number(next_value(argc, argv, i), "trim threshold")};
+
+            if (db >= 0.0) {
+                throw Options::InvalidArgument{"trim threshold must be below 0 dBFS"};
+            }
+
+            options.trim_threshold_db = db;
+        }
+        else if (std::strcmp(arg, "--trim-tail") == 0) {
+            const double ms{parse_number(next_value(argc, argv, i), "trim tail")};
+
+            if (ms < 0.0) {
+                throw Options::InvalidArgument{"trim tail must not be negative"};
+            }
+
+            options.trim_min_tail = ms / 1000.0;
+        }
+        else if (std::strcmp(arg, "--peaks") == 0) {
+            options.peak_format = parse_peak_format(next_value(argc, argv, i));
+        }
+        else if (std::strcmp(arg, "--peak-levels") == 0) {
+            options.peak_levels = parse_peak_levels(next_value(argc, argv, i));
+        }
+        else if (std::strcmp(arg, "--probe-cache") == 0) {
+            options.probe_cache = next_value(argc, argv, i);
+        }
+        else if (std::strcmp(arg, "--no-probe-cache") == 0) {
+            options.no_probe_cache = true;
+        }
+        else if (std::strcmp(arg, "--memory-budget") == 0) {
+            options.memory_budget = parse_size(next_value(argc, argv, i));
+        }
+        else if (std::strcmp(arg, "--verify") == 0) {
+            options.verify = true;
+        }
+        else if (std::strcmp(arg, "--verify-report") == 0) {
+            options.verify = true;
+            options.verify_report = next_value(argc, argv, i);
+        }
+        else if (std::strcmp(arg, "--journal") == 0) {
+            options.journal = next_value(argc, argv, i);
+        }
+        else if (std::strcmp(arg, "--ledger") == 0) {
+            options.ledger = next_value(argc, argv, i);
+        }
+        else if (std::strcmp(arg, "--lease") == 0) {
+            options.lease = parse_number(next_value(argc, argv, i), "lease");
+
+            if (!(options.lease > 0.0)) {
+                throw Options::InvalidArgument{"lease must be positive"};
+            }
+        }
+        else if (std::strcmp(arg, "--shard-index") == 0) {
+            options.shard_index = parse_count(next_value(argc, argv, i), "shard index");
+        }
+        else if (std::strcmp(arg, "--shard-count") == 0) {
+            options.shard_count = parse_count(next_value(argc, argv, i), "shard count");
+        }
+        else if (std::strcmp(arg, "--shard-summary") == 0) {
+            options.shard_summary = next_value(argc, argv, i);
+        }
+        else if (std::strcmp(arg, "--merge-shards") == 0) {
+            options.merge_shards = next_value(argc, argv, i);
+        }
+        else if (std::strcmp(arg, "--fsync") == 0) {
+            options.fsync = parse_fsync(next_value(argc, argv, i));
+        }
+        else if (std::strncmp(arg, "--", 2) == 0) {
+            throw Options::InvalidArgument{fmt::format("unknown option {}", arg)};
+        }
+        else if (have_input) {
+            cin::log::warn("More than one path given, ignoring {}", arg);
+        }
+        else {
+            options.input = arg;
+            have_input = true;
+        }
+    }
+
+    // A daemon gets its inputs with each job.
+    if (!have_input && options.daemon_socket.empty() && options.merge_shards.empty()) {
+        throw Options::InvalidArgument{"Not enough arguments"};
+    }
+
+    if (options.shard_count == 0 || options.shard_index >= options.shard_count) {
+        throw Options::InvalidArgument{fmt::format("shard index {} is not below shard count {}", options.shard_index, options.shard_count)};
+    }
+
+    // These rely on each MP3 being its own file once it is encoded, a bundle
+    // only exists after the whole run.
+    if (!options.bundle.empty() && (options.verify || !options.journal.empty() || !options.ledger.empty()
+            || !options.output_archive.empty() || options.watch)) {
+        throw Options::InvalidArgument{"--bundle cannot be combined with --verify, --journal, --ledger, --output-archive or --watch"};
+    }
+
+    return options;
+}
+
+std::string cin::usage(const char* program)
+{
+    return fmt::format(
+        "Usage: {0} [options] <path-to-files|archive.tar|archive.zip>\n"
+        "       {0} --daemon <socket> [options]\n"
+        "       {0} --watch <dir> [options]\n"
+        "       {0} --merge-shards <dir>\n"
+        "  --output-dir <dir>       mirror the input tree below <dir>\n"
+        "  --output-archive <tar>   pack the outputs into a new tar archive\n"
+        "  --bundle <file>          write all MP3s into one indexed bundle file\n"
+        "  --recursive              include WAV files in subdirectories\n"
+        "  --block-size <n>|auto    frames per encode call (default: auto, up to 18432)\n"
+        "  --streaming              tune automatic block size for latency\n"
+        "  --benchmark              report throughput across block sizes\n"
+        "  --plan                   print corpus statistics and a wall time estimate\n"
+        "  --simd <isa>             auto, scalar, sse2, avx2 or avx512 kernels (default: auto)\n"
+        "  --simd-check             check that all kernel variants agree on the inputs\n"
+        "  --perf-counters          log hardware counters per encode stage, file and run\n"
+        "  --daemon <socket>        keep workers warm and serve jobs on a Unix socket\n"
+        "  --submit <socket>        run this command line as a job on a daemon\n"
+        "  --watch <dir>            encode WAV files as they are written to <dir>\n"
+        "  --watch-settle <ms>      quiet time before a new file is encoded (default: 1000)\n"
+        "  --priority <class>       interactive, normal or bulk queueing on a daemon (default: normal)\n"
+        "  --deadline <ms>          start each file of a daemon job within <ms> of queueing\n"
+        "  --downmix-matrix <m>     custom downmix, e.g. '1,0,.7,0,.7,0;0,1,.7,0,0,.7'\n"
+        "  --resample <rate>        convert to 44100, 48000, 32000, 22050, ... Hz\n"
+        "  --resample-quality <q>   fast, medium or best (default: medium)\n"
+        "  --loudness <out>         json, tags or both: EBU R128 loudness and peaks\n"
+        "  --normalize <lufs>       normalize to an integrated loudness, e.g. -14\n"
+        "  --analysis-cache <file>  loudness measurements reused across runs\n"
+        "  --trim <dBFS>            cut leading and trailing audio below this level\n"
+        "  --trim-tail <ms>         silence kept at the end when trimming (default: 100)\n"
+        "  --peaks json|binary      write a waveform peak file next to each MP3\n"
+        "  --peak-levels <n,...>    frames per peak of each zoom level (default: 256,2048,16384)\n"
+        "  --probe-cache <file>     WAV header probes reused across runs\n"
+        "  --no-probe-cache         do not keep WAV header probes\n"
+        "  --memory-budget <size>   cap buffer memory of parallel encodes, e.g. 512M\n"
+        "  --verify                 decode each MP3 and compare it to the source\n"
+        "  --verify-report <file>   where to list failed verifications (implies --verify)\n"
+        "  --journal <file>         record completed files and skip them on restart\n"
+        "  --ledger <dir>           share the inputs with other processes claiming from <dir>\n"
+        "  --lease <s>              seconds before claims and temp files of crashed processes expire (default: 300)\n"
+        "  --shard-index <i>        encode part <i> (from 0) of the inputs split by --shard-count\n"
+        "  --shard-count <n>        split the inputs into <n> parts of similar encode time\n"
+        "  --shard-summary <file>   where to write the shard summary (default: shard-<i>-of-<n>.summary)\n"
+        "  --merge-shards <dir>     combine the shard summaries in <dir> into one report\n"
+        "  --fsync none|file|full   durability of published outputs (default: file)",
+        program);
+}
@@ -0,0 +1,280 @@
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <string_view>
+#include <fcntl.h>
+#include <unistd.h>
+#include "log.h"
+#include "output.h"
+
+namespace
+{
+    constexpr size_t write_buffer_size{64 * 1024};
+
+    std::string error_message(const char* what, const char* path)
+    {
+        return fmt::format("{} {}: {}", what, path, std::strerror(errno));
+    }
+
+    void write_all(int fd, const uint8_t* data, size_t size, const char* path)
+    {
+        while (size > 0) {
+            const ssize_t written{::write(fd, data, size)};
+
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+
+                throw cin::OutputFile::CouldNotWrite{error_message("Could not write", path)};
+            }
+
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+    }
+
+    // Name of this host in temporary file names, which tells temporary files
+    // of processes on this host apart from those of other hosts sharing the
+    // volume.
+    const std::string& host_name()
+    {
+        static const std::string name{[] {
+            char host[256]{};
+
+            if (::gethostname(host, sizeof(host) - 1) < 0 || host[0] == '\0') {
+                return std::string{"unknown"};
+            }
+
+            return std::string{host};
+        }()};
+
+        return name;
+    }
+
+    void format_temp_path(const std::filesystem::path& path, fmt::memory_buffer& result)
+    {
+        const auto& native{path.native()};
+        const auto slash{native.rfind('/')};
+        const auto split{slash == std::string::npos ? 0 : slash + 1};
+
+        fmt::format_to(std::back_inserter(result), "{}.{}.{}.{}.part",
+            fmt::string_view{native.data(), split},
+            fmt::string_view{native.data() + split, native.size() - split},
+            host_name(), getpid());
+    }
+
+    const char* temp_path_for(const std::filesystem::path& path, cin::Arena& arena)
+    {
+        fmt::memory_buffer result;
+        format_temp_path(path, result);
+        return arena.copy_string({result.data(), result.size()});
+    }
+
+    // Process id in a name made by temp_path_for(), 0 if it is not one.
+    // @p local is set if the process ran on this host.
+    pid_t temp_path_owner(const std::string& name, bool& local)
+    {
+        constexpr std::string_view suffix{".part"};
+
+        if (name.size() <= suffix.size() + 2 || name[0] != '.' || name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0) {
+            return 0;
+        }
+
+        const size_t end{name.size() - suffix.size()};
+        const size_t dot{name.rfind('.', end - 1)};
+
+        if (dot == 0 || dot == std::string::npos || dot + 1 == end) {
+            return 0;
+        }
+
+        pid_t pid{0};
+
+        for (size_t i = dot + 1; i < end; ++i) {
+            if (name[i] < '0' || name[i] > '9' || pid > 100000000) {
+                return 0;
+            }
+
+            pid = pid * 10 + (name[i] - '0');
+        }
+
+        const auto& host{host_name()};
+        local = dot > host.size() + 1 && name[dot - host.size() - 1] == '.'
+            && name.compare(dot - host.size(), host.size(), host) == 0;
+        return pid;
+    }
+
+    bool is_stale(const std::filesystem::directory_entry& entry, std::chrono::seconds min_age)
+    {
+        std::error_code error;
+        bool local{false};
+        const pid_t owner{temp_path_owner(entry.path().filename().string(), local)};
+
+        if (owner <= 0 || !entry.is_regular_file(error)) {
+            return false;
+        }
+
+        // EPERM means the process exists but belongs to someone else.
+        if (local) {
+            return owner != ::getpid() && ::kill(owner, 0) < 0 && errno == ESRCH;
+        }
+
+        // Processes on other hosts cannot be asked, their files are only
+        // abandoned once nobody wrote to them for a while.
+        const auto modified{entry.last_write_time(error)};
+        return !error && std::filesystem::file_time_type::clock::now() - modified >= min_age;
+    }
+
+    // Directories that vanish or cannot be read while iterating end the
+    // walk instead of failing the run.
+    template <typename Iterator>
+    size_t remove_stale(Iterator iterator, std::chrono::seconds min_age)
+    {
+        size_t removed{0};
+        std::error_code error;
+
+        for (; !error && iterator != Iterator{}; iterator.increment(error)) {
+            std::error_code remove_error;
+
+            if (is_stale(*iterator, min_age) && std::filesystem::remove(iterator->path(), remove_error)) {
+                cin::log::debug("Removed {} left by an earlier run", iterator->path().string());
+                removed++;
+            }
+        }
+
+        return removed;
+    }
+}
+
+cin::OutputFile::OutputFile(const std::filesystem::path& path, FsyncPolicy policy, Arena& arena)
+: m_path{arena.copy_string(path.native())}
+, m_temp_path{temp_path_for(path, arena)}
+, m_policy{policy}
+, m_fd{::open(m_temp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)}
+, m_buffer{write_buffer_size, arena}
+{
+    if (m_fd < 0) {
+        throw CouldNotWrite{error_message("Could not create", m_temp_path)};
+    }
+}
+
+cin::OutputFile::~OutputFile()
+{
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+
+    if (!m_committed) {
+        ::unlink(m_temp_path);
+    }
+}
+
+void cin::OutputFile::write(const uint8_t* data, size_t size)
+{
+    if (m_buffer.size() + size > write_buffer_size) {
+        flush();
+    }
+
+    if (size >= write_buffer_size) {
+        write_all(m_fd, data, size, m_temp_path);
+        return;
+    }
+
+    const size_t offset{m_buffer.size()};
+    m_buffer.resize(offset + size);
+    std::memcpy(m_buffer.data() + offset, data, size);
+}
+
+void cin::OutputFile::patch(size_t offset, const uint8_t* data, size_t size)
+{
+    flush();
+
+    while (size > 0) {
+        const ssize_t written{::pwrite(m_fd, data, size, static_cast<off_t>(offset))};
+
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            throw CouldNotWrite{error_message("Could not write", m_temp_path)};
+        }
+
+        data += written;
+        offset += static_cast<size_t>(written);
+        size -= static_cast<size_t>(written);
+    }
+}
+
+void cin::OutputFile::flush()
+{
+    write_all(m_fd, m_buffer.data(), m_buffer.size(), m_temp_path);
+    m_buffer.clear();
+}
+
+void cin::OutputFile::commit()
+{
+    flush();
+
+    if (m_policy != FsyncPolicy::none && ::fsync(m_fd) < 0) {
+        throw CouldNotWrite{error_message("Could not sync", m_temp_path)};
+    }
+
+    const int fd{m_fd};
+    m_fd = -1;
+
+    if (::close(fd) < 0) {
+        throw CouldNotWrite{error_message("Could not close", m_temp_path)};
+    }
+
+    if (::rename(m_temp_path, m_path) < 0) {
+        throw CouldNotWrite{error_message("Could not rename to", m_path)};
+    }
+
+    m_committed = true;
+
+    if (m_policy == FsyncPolicy::full) {
+        sync_parent_directory(m_path);
+    }
+}
+
+std::string cin::temp_path(const std::filesystem::path& path)
+{
+    fmt::memory_buffer result;
+    format_temp_path(path, result);
+    return {result.data(), result.size()};
+}
+
+void cin::sync_parent_directory(const std::filesystem::path& path)
+{
+    const auto directory{path.has_parent_path() ? path.parent_path() : std::filesystem::path{"."}};
+    const int fd{::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)};
+
+    if (fd < 0) {
+        throw OutputFile::CouldNotWrite{error_message("Could not open", directory.c_str())};
+    }
+
+    const int result{::fsync(fd)};
+    ::close(fd);
+
+    if (result < 0) {
+        throw OutputFile::CouldNotWrite{error_message("Could not sync", directory.c_str())};
+    }
+}
+
+size_t cin::remove_stale_parts(const std::filesystem::path& directory, bool recursive, std::chrono::seconds min_age)
+{
+    std::error_code error;
+
+    if (!std::filesystem::is_directory(directory, error)) {
+        return 0;
+    }
+
+    constexpr auto options{std::filesystem::directory_options::skip_permission_denied};
+
+    if (recursive) {
+        return remove_stale(std::filesystem::recursive_directory_iterator{directory, options, error}, min_age);
+    }
+
+    return remove_stale(std::filesystem::directory_iterator{directory, options, error}, min_age);
+}
@@ -0,0 +1,149 @@
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <iterator>
+#include "log.h"
+#include "output.h"
+#include "peaks.h"
+#include "simd.h"
+
+namespace
+{
+    // Binary layout, all little endian:
+    //   char[4] "PEAK", u32 version, u32 channels, u32 sample rate, u32 levels
+    //   per level: u32 frames per peak, u32 number of peaks,
+    //              then peaks * channels pairs of i16 min, i16 max
+    constexpr char binary_magic[4]{'P', 'E', 'A', 'K'};
+    constexpr uint32_t binary_version{1};
+
+    void put_u32(fmt::memory_buffer& out, uint32_t value)
+    {
+        const char bytes[4]{
+            static_cast<char>(value & 0xff),
+            static_cast<char>((value >> 8) & 0xff),
+            static_cast<char>((value >> 16) & 0xff),
+            static_cast<char>((value >> 24) & 0xff),
+        };
+        out.append(bytes, bytes + 4);
+    }
+
+    void put_i16(fmt::memory_buffer& out, int16_t value)
+    {
+        const auto bits{static_cast<uint16_t>(value)};
+        const char bytes[2]{static_cast<char>(bits & 0xff), static_cast<char>(bits >> 8)};
+        out.append(bytes, bytes + 2);
+    }
+}
+
+cin::PeakBuilder::PeakBuilder(int num_channels, int sample_rate, const std::vector<size_t>& levels, Arena& arena)
+: m_channels{std::clamp(num_channels, 1, max_channels)}
+, m_rate{sample_rate}
+, m_levels{levels}
+, m_finest{0, arena}
+{
+    std::fill(std::begin(m_min), std::end(m_min), std::numeric_limits<int16_t>::max());
+    std::fill(std::begin(m_max), std::end(m_max), std::numeric_limits<int16_t>::min());
+}
+
+void cin::PeakBuilder::finish_peak()
+{
+    const size_t offset{m_finest.size()};
+    m_finest.resize(offset + 2 * m_channels);
+
+    for (int channel = 0; channel < m_channels; ++channel) {
+        m_finest[offset + 2 * channel] = m_min[channel];
+        m_finest[offset + 2 * channel + 1] = m_max[channel];
+        m_min[channel] = std::numeric_limits<int16_t>::max();
+        m_max[channel] = std::numeric_limits<int16_t>::min();
+    }
+
+    m_count = 0;
+}
+
+void cin::PeakBuilder::process(const int16_t* samples, size_t num_frames)
+{
+    const size_t frames_per_peak{m_levels.front()};
+
+    while (num_frames > 0) {
+        const size_t frames{std::min(num_frames, frames_per_peak - m_count)};
+        cin::simd().min_max(samples, frames, m_channels, m_min, m_max);
+
+        samples += frames * m_channels;
+        num_frames -= frames;
+        m_count += frames;
+
+        if (m_count == frames_per_peak) {
+            finish_peak();
+        }
+    }
+}
+
+void cin::PeakBuilder::write(const std::filesystem::path& path, PeakFormat format, FsyncPolicy policy, Arena& arena)
+{
+    if (m_count > 0) {
+        finish_peak();
+    }
+
+    const size_t stride{2 * static_cast<size_t>(m_channels)};
+    const size_t num_finest{m_finest.size() / stride};
+    fmt::memory_buffer out;
+
+    if (format == PeakFormat::binary) {
+        out.append(std::begin(binary_magic), std::end(binary_magic));
+        put_u32(out, binary_version);
+        put_u32(out, m_channels);
+        put_u32(out, m_rate);
+        put_u32(out, m_levels.size());
+    }
+    else {
+        fmt::format_to(std::back_inserter(out), "{{\"sample_rate\": {}, \"channels\": {}, \"levels\": [", m_rate, m_channels);
+    }
+
+    for (size_t level = 0; level < m_levels.size(); ++level) {
+        const size_t factor{m_levels[level] / m_levels.front()};
+        const size_t num_peaks{(num_finest + factor - 1) / factor};
+
+        if (format == PeakFormat::binary) {
+            put_u32(out, m_levels[level]);
+            put_u32(out, num_peaks);
+        }
+        else {
+            fmt::format_to(std::back_inserter(out), "{}{{\"frames_per_peak\": {}, \"data\": [", level == 0 ? "" : ", ", m_levels[level]);
+        }
+
+        for (size_t peak = 0; peak < num_peaks; ++peak) {
+            const size_t first{peak * factor};
+            const size_t last{std::min(first + factor, num_finest)};
+
+            for (int channel = 0; channel < m_channels; ++channel) {
+                int16_t low{std::numeric_limits<int16_t>::max()};
+                int16_t high{std::numeric_limits<int16_t>::min()};
+
+                for (size_t i = first; i < last; ++i) {
+                    low = std::min(low, m_finest[i * stride + 2 * channel]);
+                    high = std::max(high, m_finest[i * stride + 2 * channel + 1]);
+                }
+
+                if (format == PeakFormat::binary) {
+                    put_i16(out, low);
+                    put_i16(out, high);
+                }
+                else {
+                    fmt::format_to(std::back_inserter(out), "{}{},{}", peak == 0 && channel == 0 ? "" : ",", low, high);
+                }
+            }
+        }
+
+        if (format == PeakFormat::json) {
+            fmt::format_to(std::back_inserter(out), "]}}");
+        }
+    }
+
+    if (format == PeakFormat::json) {
+        fmt::format_to(std::back_inserter(out), "]}}\n");
+    }
+
+    OutputFile file{path, policy, arena};
+    file.write(reinterpret_cast<const uint8_t*>(out.data()), out.size());
+    file.commit();
+}
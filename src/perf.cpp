@@ -0,0 +1,343 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "log.h"
+#include "perf.h"
+
+namespace
+{
+    constexpr const char* stage_names[cin::num_perf_stages]{"read", "process", "encode", "write"};
+
+    // In the order of the PerfCounts members.
+    constexpr uint64_t counter_configs[]{
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES,
+    };
+    constexpr size_t num_counters{sizeof(counter_configs) / sizeof(counter_configs[0])};
+    constexpr const char* counter_names[num_counters]{"cycles", "instructions", "cache misses", "branch misses"};
+
+    // Set once opening fails in a way every other thread runs into as well:
+    // perf_event_paranoid, a seccomp filter in a container, or no PMU in a VM.
+    std::atomic<bool> unavailable{false};
+    std::atomic<bool> warned_unavailable{false};
+    std::atomic<bool> warned_missing{false};
+
+    // Bit per counter the PMU lacks, those are left out of the logs.
+    std::atomic<unsigned> missing{0};
+
+    uint64_t& member(cin::PerfCounts& counts, size_t counter)
+    {
+        uint64_t* const members[num_counters]{&counts.cycles, &counts.instructions, &counts.cache_misses, &counts.branch_misses};
+        return *members[counter];
+    }
+
+    uint64_t member(const cin::PerfCounts& counts, size_t counter)
+    {
+        const uint64_t values[num_counters]{counts.cycles, counts.instructions, counts.cache_misses, counts.branch_misses};
+        return values[counter];
+    }
+
+    bool has(size_t counter)
+    {
+        return (missing & (1U << counter)) == 0;
+    }
+
+    int open_counter(uint64_t config, int group)
+    {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        // User space only, which unprivileged processes may count by default.
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        // The calling thread on whichever CPU it runs.
+        return static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, group, PERF_FLAG_FD_CLOEXEC));
+    }
+
+    // The counters of one thread as a single group, so they are scheduled
+    // onto the PMU together and read with one system call.
+    class CounterGroup {
+    public:
+        CounterGroup()
+        {
+            m_fds.fill(-1);
+            m_slots.fill(-1);
+
+            if (unavailable) {
+                return;
+            }
+
+            int error{0};
+            std::string failed;
+
+            for (size_t counter = 0; counter < num_counters; ++counter) {
+                const int fd{open_counter(counter_configs[counter], m_leader)};
+
+                if (fd < 0) {
+                    error = error ? error : errno;
+                    failed += failed.empty() ? counter_names[counter] : fmt::format(", {}", counter_names[counter]);
+                    missing |= 1U << counter;
+                    continue;
+                }
+
+                if (m_leader < 0) {
+                    m_leader = fd;
+                }
+
+                m_fds[counter] = fd;
+                m_slots[counter] = static_cast<int>(m_num_open);
+                m_num_open++;
+            }
+
+            if (m_num_open == 0) {
+                // Out of descriptors or memory only affects this thread.
+                if (error != EMFILE && error != ENFILE && error != ENOMEM) {
+                    unavailable = true;
+                }
+
+                if (!warned_unavailable.exchange(true)) {
+                    cin::log::warn("Hardware counters unavailable ({}){}, encoding without them", std::strerror(error),
+                        error == EACCES || error == EPERM ? ", see /proc/sys/kernel/perf_event_paranoid" : "");
+                }
+            }
+            else if (!failed.empty() && !warned_missing.exchange(true)) {
+                cin::log::warn("Hardware counters for {} unavailable ({}), counting the others", failed, std::strerror(error));
+            }
+        }
+
+        CounterGroup(const CounterGroup&) = delete;
+        CounterGroup& operator=(const CounterGroup&) = delete;
+
+        ~CounterGroup()
+        {
+            for (const int fd : m_fds) {
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+            }
+        }
+
+        bool ok() const
+        {
+            return m_num_open > 0;
+        }
+
+        // Values since the group was opened, scaled up if the kernel had to
+        // share the PMU with other groups for part of the time.
+        void read(cin::PerfCounts& counts) const
+        {
+            uint64_t values[3 + num_counters]{};
+
+            if (::read(m_leader, values, sizeof(values)) < static_cast<ssize_t>(3 * sizeof(uint64_t))) {
+                return;
+            }
+
+            const uint64_t enabled{values[1]};
+            const uint64_t running{values[2]};
+
+            for (size_t counter = 0; counter < num_counters; ++counter) {
+                const int slot{m_slots[counter]};
+
+                if (slot < 0 || static_cast<uint64_t>(slot) >= values[0]) {
+                    continue;
+                }
+
+                uint64_t value{values[3 + slot]};
+
+                if (running > 0 && running < enabled) {
+                    value = static_cast<uint64_t>(static_cast<double>(value) * enabled / running);
+                }
+
+                member(counts, counter) = value;
+            }
+        }
+
+    private:
+        std::array<int, num_counters> m_fds;
+        std::array<int, num_counters> m_slots;
+        int m_leader{-1};
+        size_t m_num_open{0};
+    };
+
+    // Opened on the first file a worker counts, closed when it exits.
+    const CounterGroup& thread_counters()
+    {
+        thread_local const CounterGroup group;
+        return group;
+    }
+
+    std::string describe(const cin::PerfCounts& counts, uint64_t total_cycles)
+    {
+        constexpr double million{1e6};
+        const double kilo_instructions{counts.instructions / 1e3};
+        std::vector<std::string> parts;
+
+        if (has(0)) {
+            parts.push_back(fmt::format("{:.1f} M cycles ({:.0f}%)", counts.cycles / million,
+                100.0 * counts.cycles / std::max<uint64_t>(total_cycles, 1)));
+        }
+
+        if (has(1)) {
+            parts.push_back(fmt::format("{:.1f} M instructions", counts.instructions / million));
+        }
+
+        if (has(0) && has(1)) {
+            parts.push_back(fmt::format("IPC {:.2f}", 1.0 * counts.instructions / std::max<uint64_t>(counts.cycles, 1)));
+        }
+
+        // Misses per thousand instructions compare across stages of
+        // different length.
+        for (size_t counter = 2; counter < num_counters; ++counter) {
+            if (!has(counter)) {
+                continue;
+            }
+
+            if (has(1) && counts.instructions > 0) {
+                parts.push_back(fmt::format("{:.2f} {} per 1k instructions", member(counts, counter) / kilo_instructions,
+                    counter_names[counter]));
+            }
+            else {
+                parts.push_back(fmt::format("{} {}", member(counts, counter), counter_names[counter]));
+            }
+        }
+
+        std::string result;
+
+        for (const auto& part : parts) {
+            result += result.empty() ? part : ", " + part;
+        }
+
+        return result;
+    }
+}
+
+cin::PerfCounts& cin::PerfCounts::operator+=(const cin::PerfCounts& other)
+{
+    cycles += other.cycles;
+    instructions += other.instructions;
+    cache_misses += other.cache_misses;
+    branch_misses += other.branch_misses;
+    return *this;
+}
+
+cin::PerfStages::PerfStages(bool enabled)
+: m_enabled{enabled && thread_counters().ok()}
+{
+}
+
+bool cin::PerfStages::enabled() const
+{
+    return m_enabled;
+}
+
+const cin::PerfCounts& cin::PerfStages::operator[](cin::PerfStage stage) const
+{
+    return m_stages[static_cast<size_t>(stage)];
+}
+
+void cin::PerfStages::add(cin::PerfStage stage, const cin::PerfCounts& counts)
+{
+    m_stages[static_cast<size_t>(stage)] += counts;
+}
+
+cin::PerfStages& cin::PerfStages::operator+=(const cin::PerfStages& other)
+{
+    for (size_t stage = 0; stage < num_perf_stages; ++stage) {
+        m_stages[stage] += other.m_stages[stage];
+    }
+
+    return *this;
+}
+
+void cin::PerfStages::log(const std::string& title, bool summary) const
+{
+    uint64_t total_cycles{0};
+
+    for (const auto& counts : m_stages) {
+        total_cycles += counts.cycles;
+    }
+
+    if (summary) {
+        cin::log::info("{}", title);
+    }
+    else {
+        cin::log::debug("{}", title);
+    }
+
+    for (size_t stage = 0; stage < num_perf_stages; ++stage) {
+        const PerfCounts& counts{m_stages[stage]};
+
+        if (counts.cycles + counts.instructions + counts.cache_misses + counts.branch_misses == 0) {
+            continue;
+        }
+
+        if (summary) {
+            cin::log::info(" {}: {}", stage_names[stage], describe(counts, total_cycles));
+        }
+        else {
+            cin::log::debug("  {}: {}", stage_names[stage], describe(counts, total_cycles));
+        }
+    }
+}
+
+cin::PerfScope::PerfScope(cin::PerfStages& stages, cin::PerfStage stage)
+: m_stages{stages}
+, m_stage{stage}
+{
+    if (m_stages.enabled()) {
+        thread_counters().read(m_start);
+    }
+}
+
+cin::PerfScope::~PerfScope()
+{
+    if (!m_stages.enabled()) {
+        return;
+    }
+
+    PerfCounts end;
+    thread_counters().read(end);
+
+    // Scaling for multiplexing can make a later estimate smaller.
+    for (size_t counter = 0; counter < num_counters; ++counter) {
+        uint64_t& value{member(end, counter)};
+        const uint64_t start{member(m_start, counter)};
+        value = value > start ? value - start : 0;
+    }
+
+    m_stages.add(m_stage, end);
+}
+
+void cin::PerfTotals::add(const cin::PerfStages& stages)
+{
+    if (!stages.enabled()) {
+        return;
+    }
+
+    const std::lock_guard<std::mutex> lock{m_mutex};
+    m_stages += stages;
+    m_files++;
+}
+
+void cin::PerfTotals::report()
+{
+    const std::lock_guard<std::mutex> lock{m_mutex};
+
+    if (m_files == 0) {
+        return;
+    }
+
+    m_stages.log(fmt::format("Hardware counters of {} files, user space only:", m_files), true);
+    m_stages = PerfStages{};
+    m_files = 0;
+}
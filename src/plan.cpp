@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <numeric>
+#include <queue>
+#include <system_error>
+#include <thread>
+#include <tuple>
+#include "buffer.h"
+#include "lame_wrapper.h"
+#include "log.h"
+#include "plan.h"
+#include "probe.h"
+#include "resampler.h"
+
+namespace
+{
+    constexpr double calibration_seconds{0.25};
+    constexpr size_t calibration_frames{16 * 1152};
+    constexpr double seconds_per_hour{3600.0};
+
+    // Histogram buckets start at 64 KiB and grow by 4x.
+    constexpr uint64_t first_bucket{64 * 1024};
+    constexpr size_t num_buckets{8};
+
+    std::string format_size(uint64_t bytes)
+    {
+        constexpr const char* units[]{"B", "KiB", "MiB", "GiB", "TiB"};
+        double value{static_cast<double>(bytes)};
+        size_t unit{0};
+
+        while (value >= 1024.0 && unit + 1 < std::size(units)) {
+            value /= 1024.0;
+            unit++;
+        }
+
+        return fmt::format("{:.4g} {}", value, units[unit]);
+    }
+
+    std::string format_duration(double seconds)
+    {
+        if (seconds < 60.0) {
+            return fmt::format("{:.1f} s", seconds);
+        }
+
+        const auto total{static_cast<uint64_t>(seconds + 0.5)};
+        return fmt::format("{}:{:02}:{:02}", total / 3600, total / 60 % 60, total % 60);
+    }
+
+    /**
+     * Return the frames per second one core encodes with the current LAME
+     * settings.
+     */
+    double calibrate(int num_channels, int sample_rate)
+    {
+        using clock = std::chrono::steady_clock;
+
+        const cin::Lame lame{num_channels, sample_rate};
+        cin::Buffer<int16_t> samples{calibration_frames * num_channels};
+        cin::Buffer<uint8_t> mp3_buffer{cin::Lame::max_encoded_size(calibration_frames)};
+        samples.resize(calibration_frames * num_channels);
+
+        // Noise under a tone, digital silence would encode unrealistically fast.
+        uint32_t state{0x12345678};
+
+        for (size_t i = 0; i < samples.size(); ++i) {
+            state = state * 1664525 + 1013904223;
+            const int noise{static_cast<int>(state >> 21) - 1024};
+            const int tone{(i / num_channels) % 100 < 50 ? 4000 : -4000};
+            samples[i] = static_cast<int16_t>(noise + tone);
+        }
+
+        const auto start{clock::now()};
+        std::chrono::duration<double> elapsed{0.0};
+        uint64_t frames{0};
+
+        while (elapsed.count() < calibration_seconds) {
+            lame.encode(samples, mp3_buffer);
+            frames += calibration_frames;
+            elapsed = clock::now() - start;
+        }
+
+        return frames / elapsed.count();
+    }
+
+    /**
+     * Return the time @p num_workers workers take for @p jobs, handing the
+     * longest remaining job to whichever worker is free first.
+     */
+    double makespan(std::vector<double> jobs, unsigned int num_workers)
+    {
+        std::sort(jobs.begin(), jobs.end(), std::greater<>{});
+        std::priority_queue<double, std::vector<double>, std::greater<>> workers;
+
+        for (unsigned int i = 0; i < num_workers; ++i) {
+            workers.push(0.0);
+        }
+
+        double result{0.0};
+
+        for (const double job : jobs) {
+            const double finish{workers.top() + job};
+            workers.pop();
+            workers.push(finish);
+            result = std::max(result, finish);
+        }
+
+        return result;
+    }
+}
+
+void cin::plan_batch(const Paths& paths, const Options& options)
+{
+    const auto cache{open_probe_cache(options)};
+    const auto infos{probe_files(paths, cache.get())};
+    const unsigned int num_cores{std::max(std::thread::hardware_concurrency(), 1U)};
+
+    uint64_t total_bytes{0};
+    double total_seconds{0.0};
+    size_t unprobed{0};
+    uint64_t histogram[num_buckets]{};
+
+    // channels, sample rate, bits per sample, float -> files, seconds
+    std::map<std::tuple<int, int, int, bool>, std::pair<size_t, double>> formats;
+
+    // Frames LAME gets per output layout, with downmix and resampling applied.
+    std::map<std::pair<int, int>, double> throughput;
+    std::vector<std::pair<std::pair<int, int>, double>> jobs;
+
+    for (size_t i = 0; i < paths.size(); ++i) {
+        std::error_code error;
+        const uint64_t size{std::filesystem::file_size(paths[i], error)};
+        const WavInfo& info{infos[i]};
+
+        if (!error) {
+            total_bytes += size;
+            size_t bucket{0};
+
+            for (uint64_t limit{first_bucket}; size >= limit && bucket + 1 < num_buckets; limit *= 4) {
+                bucket++;
+            }
+
+            histogram[bucket]++;
+        }
+
+        if (info.num_channels == 0) {
+            unprobed++;
+            continue;
+        }
+
+        total_seconds += info.duration();
+        auto& format{formats[{info.num_channels, info.sample_rate, info.bits_per_sample, info.float_samples}]};
+        format.first++;
+        format.second += info.duration();
+
+        const int output_rate{options.resample_rate > 0 ? options.resample_rate : Resampler::default_output_rate(info.sample_rate)};
+        const std::pair<int, int> layout{std::min(info.num_channels, 2), output_rate};
+        throughput[layout] = 0.0;
+        jobs.emplace_back(layout, info.duration() * output_rate);
+    }
+
+    cin::log::info("{} files, {}, {:.2f} hours of audio", paths.size(), format_size(total_bytes), total_seconds / seconds_per_hour);
+
+    if (unprobed > 0) {
+        cin::log::warn("{} files have no readable WAV header and are not counted below", unprobed);
+    }
+
+    cin::log::info("File sizes:");
+
+    for (size_t bucket = 0; bucket < num_buckets; ++bucket) {
+        const uint64_t low{bucket == 0 ? 0 : first_bucket << (2 * (bucket - 1))};
+        const auto label{bucket + 1 < num_buckets
+            ? fmt::format("{} - {}", format_size(low), format_size(first_bucket << (2 * bucket)))
+            : fmt::format(">= {}", format_size(low))};
+        const size_t width{paths.empty() ? 0 : histogram[bucket] * 40 / paths.size()};
+        cin::log::info("  {:>22} {:>8} {}", label, histogram[bucket], std::string(width, '#'));
+    }
+
+    cin::log::info("Formats:");
+    cin::log::info("  {:>8} {:>8} {:>8} {:>8} {:>10}", "channels", "rate", "bits", "files", "hours");
+
+    for (const auto& [format, stats] : formats) {
+        const auto& [channels, rate, bits, is_float] = format;
+        cin::log::info("  {:>8} {:>8} {:>8} {:>8} {:>10.2f}",
+            channels, rate, fmt::format("{}{}", bits, is_float ? "f" : ""), stats.first, stats.second / seconds_per_hour);
+    }
+
+    if (jobs.empty()) {
+        return;
+    }
+
+    cin::log::info("Calibrating LAME throughput per core:");
+
+    for (auto& [layout, frames_per_second] : throughput) {
+        frames_per_second = calibrate(layout.first, layout.second);
+        cin::log::info("  {} ch {} Hz: {:.1f}x realtime", layout.first, layout.second, frames_per_second / layout.second);
+    }
+
+    std::vector<double> seconds;
+    seconds.reserve(jobs.size());
+
+    for (const auto& [layout, frames] : jobs) {
+        seconds.push_back(frames / throughput[layout]);
+    }
+
+    const double cpu_seconds{std::accumulate(seconds.begin(), seconds.end(), 0.0)};
+    const double wall_seconds{makespan(std::move(seconds), num_cores)};
+
+    // Reading, resampling and analysis add to this, so it is a lower bound
+    // for CPU bound runs and optimistic when storage is the bottleneck.
+    cin::log::info("Predicted encode time: {} CPU, {} wall on {} cores",
+        format_duration(cpu_seconds), format_duration(wall_seconds), num_cores);
+}
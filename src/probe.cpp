@@ -0,0 +1,322 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "log.h"
+#include "output.h"
+#include "probe.h"
+
+namespace
+{
+    constexpr size_t head_size{4096};
+    constexpr size_t max_fmt_size{40};
+    constexpr int max_chunks{64};
+    constexpr size_t flush_size{64 * 1024};
+
+    constexpr uint16_t format_pcm{1};
+    constexpr uint16_t format_float{3};
+    constexpr uint16_t format_extensible{0xfffe};
+
+    uint16_t get_u16(const uint8_t* p)
+    {
+        return static_cast<uint16_t>(p[0] | (p[1] << 8));
+    }
+
+    uint32_t get_u32(const uint8_t* p)
+    {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    }
+
+    /**
+     * Serves reads from the first head_size bytes, which hold the whole
+     * header of almost every file, and falls back to pread() beyond them.
+     */
+    class HeaderReader {
+    public:
+        explicit HeaderReader(int fd)
+        : m_fd{fd}
+        {
+            const ssize_t size{::pread(fd, m_head, head_size, 0)};
+            m_size = size > 0 ? static_cast<size_t>(size) : 0;
+        }
+
+        bool read(uint64_t offset, size_t size, uint8_t* out) const
+        {
+            if (offset + size <= m_size) {
+                std::memcpy(out, m_head + offset, size);
+                return true;
+            }
+
+            return ::pread(m_fd, out, size, static_cast<off_t>(offset)) == static_cast<ssize_t>(size);
+        }
+
+    private:
+        int m_fd;
+        uint8_t m_head[head_size];
+        size_t m_size;
+    };
+
+    bool parse_header(const HeaderReader& reader, uint64_t file_size, cin::WavInfo& info)
+    {
+        uint8_t riff[12];
+
+        if (!reader.read(0, sizeof(riff), riff) || std::memcmp(riff, "RIFF", 4) != 0 || std::memcmp(riff + 8, "WAVE", 4) != 0) {
+            return false;
+        }
+
+        uint64_t offset{sizeof(riff)};
+        uint16_t block_align{0};
+        bool have_format{false};
+
+        for (int chunk = 0; chunk < max_chunks && offset + 8 <= file_size; ++chunk) {
+            uint8_t header[8];
+
+            if (!reader.read(offset, sizeof(header), header)) {
+                return false;
+            }
+
+            const uint64_t size{get_u32(header + 4)};
+
+            if (std::memcmp(header, "fmt ", 4) == 0) {
+                uint8_t fmt[max_fmt_size]{};
+
+                if (size < 16 || !reader.read(offset + 8, std::min<uint64_t>(size, max_fmt_size), fmt)) {
+                    return false;
+                }
+
+                uint16_t format{get_u16(fmt)};
+
+                // The first two bytes of the sub format GUID are the format tag.
+                if (format == format_extensible && size >= max_fmt_size) {
+                    format = get_u16(fmt + 24);
+                }
+
+                info.num_channels = get_u16(fmt + 2);
+                info.sample_rate = static_cast<int>(get_u32(fmt + 4));
+                block_align = get_u16(fmt + 12);
+                info.bits_per_sample = get_u16(fmt + 14);
+                info.float_samples = format == format_float;
+                have_format = format == format_pcm || format == format_float;
+            }
+            else if (std::memcmp(header, "data", 4) == 0) {
+                if (!have_format || info.num_channels == 0 || block_align == 0 || info.sample_rate <= 0) {
+                    return false;
+                }
+
+                // Writers that never finalized the header leave 0 or ~0 here,
+                // libsndfile then takes the rest of the file as well.
+                const uint64_t data_offset{offset + 8};
+                uint64_t data_size{size};
+
+                if (data_size == 0 || data_size == 0xffffffff || data_offset + data_size > file_size) {
+                    data_size = file_size - data_offset;
+                }
+
+                info.num_frames = data_size / block_align;
+                return true;
+            }
+
+            offset += 8 + size + (size & 1);
+        }
+
+        return false;
+    }
+}
+
+bool cin::probe_wav(const std::filesystem::path& path, WavInfo& info)
+{
+    info = {};
+    const int fd{::open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st{};
+    bool result{false};
+
+    if (::fstat(fd, &st) == 0) {
+        const HeaderReader reader{fd};
+        result = parse_header(reader, static_cast<uint64_t>(st.st_size), info);
+    }
+
+    ::close(fd);
+
+    if (!result) {
+        info = {};
+    }
+
+    return result;
+}
+
+cin::ProbeCache::ProbeCache(const std::filesystem::path& path)
+: m_path{path}
+{
+    std::ifstream existing{path};
+    std::string line;
+
+    // "W <device> <inode> <size> <mtime> <channels> <rate> <bits> <float>
+    // <frames>", later lines for the same inode replace earlier ones.
+    while (std::getline(existing, line)) {
+        std::istringstream fields{line};
+        std::string type;
+        Key key{};
+        Entry entry{};
+
+        if (fields >> type >> key.device >> key.inode >> entry.stamp.size >> entry.stamp.mtime
+            >> entry.info.num_channels >> entry.info.sample_rate >> entry.info.bits_per_sample
+            >> entry.info.float_samples >> entry.info.num_frames && type == "W") {
+            m_entries[key] = entry;
+        }
+    }
+
+    m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+    if (m_fd < 0) {
+        throw OutputFile::CouldNotWrite{fmt::format("Could not open probe cache {}: {}", path.string(), std::strerror(errno))};
+    }
+
+    cin::log::debug("Loaded {} probe results from {}", m_entries.size(), path.string());
+}
+
+cin::ProbeCache::~ProbeCache()
+{
+    try {
+        flush();
+    }
+    catch (const OutputFile::CouldNotWrite& err) {
+        cin::log::warn("{}", err.what());
+    }
+
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+
+    cin::log::debug("Probe cache: {} hits, {} misses", m_hits, m_misses);
+}
+
+bool cin::ProbeCache::probe(const std::filesystem::path& input, WavInfo& info)
+{
+    struct stat st{};
+
+    if (::stat(input.c_str(), &st) < 0) {
+        info = {};
+        return false;
+    }
+
+    const Key key{static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino)};
+    const FileStamp stamp{
+        static_cast<uint64_t>(st.st_size),
+        static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec
+    };
+
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        const auto entry{m_entries.find(key)};
+
+        if (entry != m_entries.end() && entry->second.stamp == stamp) {
+            m_hits++;
+            info = entry->second.info;
+            return info.num_channels > 0;
+        }
+    }
+
+    // Probed outside the lock, a race between two threads on the same file
+    // only appends the same line twice.
+    const bool result{probe_wav(input, info)};
+
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_misses++;
+    m_entries[key] = {stamp, info};
+    m_pending += fmt::format("W {} {} {} {} {} {} {} {:d} {}\n",
+        key.device, key.inode, stamp.size, stamp.mtime,
+        info.num_channels, info.sample_rate, info.bits_per_sample, info.float_samples, info.num_frames);
+
+    if (m_pending.size() >= flush_size) {
+        try {
+            flush_locked();
+        }
+        catch (const OutputFile::CouldNotWrite& err) {
+            // The cache is an optimization, probing works without it.
+            cin::log::warn("{}", err.what());
+            m_pending.clear();
+        }
+    }
+
+    return result;
+}
+
+void cin::ProbeCache::flush()
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    flush_locked();
+}
+
+void cin::ProbeCache::flush_locked()
+{
+    if (m_pending.empty()) {
+        return;
+    }
+
+    // Appended with a single write so concurrent runs sharing the cache never
+    // interleave within a line.
+    const ssize_t written{::write(m_fd, m_pending.data(), m_pending.size())};
+    m_pending.clear();
+
+    if (written < 0) {
+        throw OutputFile::CouldNotWrite{fmt::format("Could not append to probe cache {}: {}", m_path.string(), std::strerror(errno))};
+    }
+}
+
+std::unique_ptr<cin::ProbeCache> cin::open_probe_cache(const Options& options)
+{
+    if (options.no_probe_cache) {
+        return nullptr;
+    }
+
+    auto path{options.probe_cache};
+
+    if (path.empty()) {
+        path = (options.output.empty() ? options.input : options.output) / ".probe-cache";
+    }
+
+    try {
+        return std::make_unique<ProbeCache>(path);
+    }
+    catch (const OutputFile::CouldNotWrite& err) {
+        cin::log::warn("{}, probing without cache", err.what());
+        return nullptr;
+    }
+}
+
+std::vector<cin::WavInfo> cin::probe_files(const Paths& paths, ProbeCache* cache)
+{
+    std::vector<WavInfo> result(paths.size());
+    const size_t num_threads{std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1U), paths.size())};
+    std::vector<std::thread> threads;
+
+    // Interleaved so that one slow directory is shared by all threads.
+    for (size_t i = 0; i < num_threads; ++i) {
+        threads.emplace_back([&, i]() {
+            for (size_t index = i; index < paths.size(); index += num_threads) {
+                if (cache) {
+                    cache->probe(paths[index], result[index]);
+                }
+                else {
+                    probe_wav(paths[index], result[index]);
+                }
+            }
+        });
+    }
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    return result;
+}
@@ -0,0 +1,248 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <tuple>
+#include "encoder.h"
+#include "resampler.h"
+#include "simd.h"
+
+struct cin::Resampler::FilterBank {
+    size_t up;
+    size_t down;
+    size_t taps;
+    // up phases of taps coefficients each, reversed so that they line up with
+    // the history oldest sample first.
+    std::vector<float> coefficients;
+};
+
+namespace
+{
+    constexpr size_t max_phases{4096};
+    constexpr double pi{3.14159265358979323846};
+
+    struct QualitySettings {
+        size_t taps;
+        double beta;
+        double rolloff;
+    };
+
+    QualitySettings settings_for(cin::ResampleQuality quality)
+    {
+        switch (quality) {
+            case cin::ResampleQuality::fast:
+                return {16, 6.0, 0.85};
+            case cin::ResampleQuality::medium:
+                return {32, 8.0, 0.90};
+            case cin::ResampleQuality::best:
+                return {64, 10.0, 0.95};
+        }
+
+        return {32, 8.0, 0.90};
+    }
+
+    // Zeroth order modified Bessel function of the first kind.
+    double bessel_i0(double x)
+    {
+        double sum{1.0};
+        double term{1.0};
+
+        for (int k = 1; k < 50; ++k) {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+
+            if (term < sum * 1e-12) {
+                break;
+            }
+        }
+
+        return sum;
+    }
+
+    std::shared_ptr<const cin::Resampler::FilterBank> design(size_t up, size_t down, cin::ResampleQuality quality)
+    {
+        const auto settings{settings_for(quality)};
+        const size_t length{up * settings.taps};
+        const double cutoff{0.5 / std::max(up, down) * settings.rolloff};
+        // Centred on a whole sample of the upsampled signal so the delay of
+        // taps / 2 input frames can be compensated exactly, the window is zero
+        // at the first tap and the tap one past the end.
+        const double center{length / 2.0};
+        const double i0_beta{bessel_i0(settings.beta)};
+
+        auto bank{std::make_shared<cin::Resampler::FilterBank>()};
+        bank->up = up;
+        bank->down = down;
+        bank->taps = settings.taps;
+        bank->coefficients.resize(length);
+
+        for (size_t phase = 0; phase < up; ++phase) {
+            float* coefficients{bank->coefficients.data() + phase * settings.taps};
+            double sum{0.0};
+
+            for (size_t j = 0; j < settings.taps; ++j) {
+                const double k{static_cast<double>(phase + j * up)};
+                const double x{2.0 * cutoff * (k - center)};
+                const double sinc{x == 0.0 ? 1.0 : std::sin(pi * x) / (pi * x)};
+                const double r{(k - center) / center};
+                const double window{bessel_i0(settings.beta * std::sqrt(std::max(0.0, 1.0 - r * r))) / i0_beta};
+                const double h{sinc * window};
+
+                coefficients[settings.taps - 1 - j] = static_cast<float>(h);
+                sum += h;
+            }
+
+            // Unity DC gain for every phase avoids a ripple at the phase rate.
+            for (size_t j = 0; j < settings.taps; ++j) {
+                coefficients[j] = static_cast<float>(coefficients[j] / sum);
+            }
+        }
+
+        return bank;
+    }
+
+    std::shared_ptr<const cin::Resampler::FilterBank> filter_bank(int input_rate, int output_rate, cin::ResampleQuality quality)
+    {
+        if (input_rate <= 0 || output_rate <= 0) {
+            throw cin::Encoder::UnsupportedFormat{"Cannot resample between these sample rates"};
+        }
+
+        const auto divisor{std::gcd(input_rate, output_rate)};
+        const size_t up{static_cast<size_t>(output_rate / divisor)};
+        const size_t down{static_cast<size_t>(input_rate / divisor)};
+
+        if (up > max_phases) {
+            throw cin::Encoder::UnsupportedFormat{"Cannot resample between these sample rates"};
+        }
+
+        static std::mutex mutex;
+        static std::map<std::tuple<size_t, size_t, cin::ResampleQuality>, std::shared_ptr<const cin::Resampler::FilterBank>> banks;
+
+        std::lock_guard<std::mutex> lock{mutex};
+        auto& bank{banks[{up, down, quality}]};
+
+        if (!bank) {
+            bank = design(up, down, quality);
+        }
+
+        return bank;
+    }
+
+    int16_t to_int16(float value)
+    {
+        return static_cast<int16_t>(std::lrint(std::clamp(value, -32768.0F, 32767.0F)));
+    }
+}
+
+cin::Resampler::Resampler(int input_rate, int output_rate, int num_channels, ResampleQuality quality,
+    size_t max_block_frames, Arena& arena)
+: m_filter{filter_bank(input_rate, output_rate, quality)}
+, m_channels{num_channels}
+, m_max_block_frames{max_block_frames}
+// History holds taps - 1 samples of context, one block and the zeros
+// appended by flush().
+, m_stride{3 * m_filter->taps + max_block_frames}
+, m_history{m_stride * num_channels, arena}
+{
+    const size_t taps{m_filter->taps};
+    m_history.resize(m_stride * num_channels);
+    std::fill(m_history.begin(), m_history.end(), 0.0F);
+
+    // Start with taps - 1 zeros and skip half a filter length of output so
+    // the output is not delayed with respect to the input.
+    m_length = taps - 1;
+    m_index = taps - 1 + taps / 2;
+}
+
+size_t cin::Resampler::max_output_frames(size_t input_frames) const
+{
+    return (input_frames + m_filter->taps) * m_filter->up / m_filter->down + 2;
+}
+
+size_t cin::Resampler::run(size_t limit, Buffer<int16_t>& output)
+{
+    const size_t taps{m_filter->taps};
+    const size_t up{m_filter->up};
+    const size_t down{m_filter->down};
+    const auto dot{cin::simd().dot};
+    size_t produced{0};
+
+    output.resize(max_output_frames(m_max_block_frames) * m_channels);
+
+    while (m_index < m_length && produced < limit) {
+        const float* coefficients{m_filter->coefficients.data() + m_phase * taps};
+        const size_t first{m_index + 1 - taps};
+
+        for (int channel = 0; channel < m_channels; ++channel) {
+            const float* history{m_history.data() + channel * m_stride + first};
+            output[produced * m_channels + channel] = to_int16(dot(coefficients, history, taps));
+        }
+
+        produced++;
+        m_phase += down;
+        m_index += m_phase / up;
+        m_phase %= up;
+    }
+
+    // Keep taps - 1 samples of context before the next output position.
+    const size_t drop{std::min(m_index + 1 - taps, m_length)};
+
+    for (int channel = 0; channel < m_channels; ++channel) {
+        float* history{m_history.data() + channel * m_stride};
+        std::memmove(history, history + drop, (m_length - drop) * sizeof(float));
+    }
+
+    m_length -= drop;
+    m_index -= drop;
+    m_frames_out += produced;
+    output.resize(produced * m_channels);
+    return produced;
+}
+
+size_t cin::Resampler::process(const int16_t* input, size_t num_frames, Buffer<int16_t>& output)
+{
+    for (int channel = 0; channel < m_channels; ++channel) {
+        float* history{m_history.data() + channel * m_stride + m_length};
+
+        for (size_t frame = 0; frame < num_frames; ++frame) {
+            history[frame] = input[frame * m_channels + channel];
+        }
+    }
+
+    m_length += num_frames;
+    m_frames_in += num_frames;
+    return run(SIZE_MAX, output);
+}
+
+size_t cin::Resampler::flush(Buffer<int16_t>& output)
+{
+    const size_t taps{m_filter->taps};
+
+    for (int channel = 0; channel < m_channels; ++channel) {
+        float* history{m_history.data() + channel * m_stride + m_length};
+        std::fill(history, history + taps, 0.0F);
+    }
+
+    m_length += taps;
+
+    const uint64_t expected{(m_frames_in * m_filter->up + m_filter->down - 1) / m_filter->down};
+    return run(expected > m_frames_out ? expected - m_frames_out : 0, output);
+}
+
+bool cin::Resampler::is_mp3_rate(int rate)
+{
+    constexpr int rates[]{8000, 11025, 12000, 16000, 22050, 24000, 32000, 44100, 48000};
+    return std::find(std::begin(rates), std::end(rates), rate) != std::end(rates);
+}
+
+int cin::Resampler::default_output_rate(int rate)
+{
+    if (is_mp3_rate(rate)) {
+        return rate;
+    }
+
+    return rate % 11025 == 0 ? 44100 : 48000;
+}
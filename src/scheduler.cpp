@@ -0,0 +1,84 @@
+#include <algorithm>
+#include <numeric>
+#include "scheduler.h"
+
+namespace
+{
+    // How far past the largest waiting job a worker looks for a smaller one
+    // that fits, bounded so a huge queue does not turn into a linear scan.
+    constexpr size_t lookahead{64};
+}
+
+cin::BatchScheduler::BatchScheduler(const std::vector<uint64_t>& costs, std::vector<uint64_t> bytes, uint64_t budget)
+: m_bytes{std::move(bytes)}
+, m_budget{budget}
+, m_order(m_bytes.size())
+, m_taken(m_bytes.size(), false)
+{
+    std::iota(m_order.begin(), m_order.end(), 0);
+    std::stable_sort(m_order.begin(), m_order.end(), [&costs](size_t a, size_t b) { return costs[a] > costs[b]; });
+}
+
+bool cin::BatchScheduler::fits(size_t index) const
+{
+    return m_budget == 0 || m_in_flight == 0 || m_in_flight + m_bytes[index] <= m_budget;
+}
+
+bool cin::BatchScheduler::next(size_t& index)
+{
+    std::unique_lock lock{m_mutex};
+    bool waited{false};
+
+    while (true) {
+        while (m_head < m_order.size() && m_taken[m_order[m_head]]) {
+            m_head++;
+        }
+
+        if (m_head == m_order.size()) {
+            return false;
+        }
+
+        const size_t end{std::min(m_head + lookahead, m_order.size())};
+
+        for (size_t i = m_head; i < end; ++i) {
+            const size_t candidate{m_order[i]};
+
+            if (!m_taken[candidate] && fits(candidate)) {
+                m_taken[candidate] = true;
+                m_in_flight += m_bytes[candidate];
+                m_peak = std::max(m_peak, m_in_flight);
+                index = candidate;
+                return true;
+            }
+        }
+
+        if (!waited) {
+            m_waits++;
+            waited = true;
+        }
+
+        m_released.wait(lock);
+    }
+}
+
+void cin::BatchScheduler::done(size_t index)
+{
+    {
+        const std::lock_guard lock{m_mutex};
+        m_in_flight -= m_bytes[index];
+    }
+
+    m_released.notify_all();
+}
+
+uint64_t cin::BatchScheduler::peak_bytes() const
+{
+    const std::lock_guard lock{m_mutex};
+    return m_peak;
+}
+
+size_t cin::BatchScheduler::num_waits() const
+{
+    const std::lock_guard lock{m_mutex};
+    return m_waits;
+}
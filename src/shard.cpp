@@ -0,0 +1,255 @@
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include "analysis_cache.h"
+#include "arena.h"
+#include "log.h"
+#include "output.h"
+#include "probe.h"
+#include "shard.h"
+
+namespace
+{
+    struct Input {
+        size_t index;
+        uint64_t hash;
+        uint64_t cost;
+        uint64_t bytes;
+        double seconds;
+        std::string relative;
+    };
+
+    struct Summary {
+        size_t shard_count{0};
+        size_t files{0};
+        size_t failed{0};
+        uint64_t cost{0};
+        uint64_t total_cost{0};
+        double audio_seconds{0.0};
+        uint64_t input_bytes{0};
+        double wall_seconds{0.0};
+        size_t total_files{0};
+        uint64_t corpus_hash{0};
+    };
+
+    bool read_summary(const std::filesystem::path& path, size_t& index, Summary& summary)
+    {
+        std::ifstream file{path};
+        std::string line;
+        bool has_index{false};
+
+        while (std::getline(file, line)) {
+            std::istringstream fields{line};
+            std::string key;
+            fields >> key;
+
+            if (key == "shard") {
+                has_index = static_cast<bool>(fields >> index);
+            }
+            else if (key == "shard_count") {
+                fields >> summary.shard_count;
+            }
+            else if (key == "files") {
+                fields >> summary.files;
+            }
+            else if (key == "failed") {
+                fields >> summary.failed;
+            }
+            else if (key == "cost") {
+                fields >> summary.cost;
+            }
+            else if (key == "total_cost") {
+                fields >> summary.total_cost;
+            }
+            else if (key == "audio_seconds") {
+                fields >> summary.audio_seconds;
+            }
+            else if (key == "input_bytes") {
+                fields >> summary.input_bytes;
+            }
+            else if (key == "wall_seconds") {
+                fields >> summary.wall_seconds;
+            }
+            else if (key == "total_files") {
+                fields >> summary.total_files;
+            }
+            else if (key == "corpus") {
+                fields >> std::hex >> summary.corpus_hash;
+            }
+        }
+
+        return has_index && summary.shard_count > index;
+    }
+}
+
+cin::Shard cin::select_shard(const Paths& paths, const Options& options)
+{
+    const auto cache{open_probe_cache(options)};
+    const auto infos{probe_files(paths, cache.get())};
+    std::vector<Input> inputs;
+    inputs.reserve(paths.size());
+
+    for (size_t i = 0; i < paths.size(); ++i) {
+        std::error_code error;
+        const auto size{std::filesystem::file_size(paths[i], error)};
+        WavInfo info{infos[i]};
+
+        // Same assumption as the encoder's scheduler for files the probe
+        // cannot parse: 16 bit stereo PCM at 44.1 kHz of their size.
+        if (info.num_channels == 0) {
+            info = {2, 44100, 16, false, error ? 0 : size / 4};
+        }
+
+        inputs.push_back({i, stable_hash(paths[i], options.input), info.num_frames * info.num_channels,
+            error ? 0 : size, info.duration(), paths[i].lexically_proximate(options.input).generic_string()});
+    }
+
+    // Enumeration order differs between hosts, the assignment must not.
+    std::sort(inputs.begin(), inputs.end(), [](const Input& a, const Input& b) {
+        if (a.cost != b.cost) {
+            return a.cost > b.cost;
+        }
+
+        return a.hash != b.hash ? a.hash < b.hash : a.relative < b.relative;
+    });
+
+    Shard shard;
+    std::vector<uint64_t> loads(options.shard_count, 0);
+    ContentHash corpus;
+
+    for (const Input& input : inputs) {
+        corpus.update(input.relative.c_str(), input.relative.size() + 1);
+        corpus.update(&input.cost, sizeof(input.cost));
+    }
+
+    shard.total_files = inputs.size();
+    shard.corpus_hash = corpus.value();
+
+    for (const Input& input : inputs) {
+        size_t target{input.hash % options.shard_count};
+        const auto least{std::min_element(loads.begin(), loads.end())};
+
+        if (loads[target] > *least + input.cost) {
+            target = static_cast<size_t>(least - loads.begin());
+        }
+
+        loads[target] += input.cost;
+        shard.total_cost += input.cost;
+
+        if (target == options.shard_index) {
+            shard.paths.push_back(paths[input.index]);
+            shard.cost += input.cost;
+            shard.audio_seconds += input.seconds;
+            shard.input_bytes += input.bytes;
+        }
+    }
+
+    cin::log::info("Shard {} of {}: {} of {} files, {:.1f}% of the estimated work",
+        options.shard_index, options.shard_count, shard.paths.size(), paths.size(),
+        100.0 * shard.cost / std::max<uint64_t>(shard.total_cost, 1));
+
+    return shard;
+}
+
+void cin::write_shard_summary(const Shard& shard, size_t failed, double wall_seconds, const Options& options)
+{
+    auto path{options.shard_summary};
+
+    if (path.empty()) {
+        path = (options.output.empty() ? options.input : options.output)
+            / fmt::format("shard-{}-of-{}.summary", options.shard_index, options.shard_count);
+    }
+
+    const std::string summary{fmt::format(
+        "shard {}\nshard_count {}\nfiles {}\nfailed {}\ncost {}\ntotal_cost {}\n"
+        "audio_seconds {:.3f}\ninput_bytes {}\nwall_seconds {:.3f}\ntotal_files {}\ncorpus {:016x}\n",
+        options.shard_index, options.shard_count, shard.paths.size(), failed, shard.cost, shard.total_cost,
+        shard.audio_seconds, shard.input_bytes, wall_seconds, shard.total_files, shard.corpus_hash)};
+
+    cin::Arena arena;
+    cin::OutputFile file{path, options.fsync, arena};
+    file.write(reinterpret_cast<const uint8_t*>(summary.data()), summary.size());
+    file.commit();
+}
+
+int cin::merge_shard_summaries(const std::filesystem::path& directory)
+{
+    std::map<size_t, Summary> shards;
+    size_t shard_count{0};
+    bool same_corpus{true};
+
+    for (const auto& entry : std::filesystem::directory_iterator{directory}) {
+        if (entry.path().extension() != ".summary") {
+            continue;
+        }
+
+        size_t index{0};
+        Summary summary;
+
+        if (!read_summary(entry.path(), index, summary)) {
+            cin::log::warn("Ignoring malformed shard summary {}", entry.path().string());
+            continue;
+        }
+
+        if (shard_count != 0 && summary.shard_count != shard_count) {
+            cin::log::warn("Ignoring {}, it belongs to a split into {} shards, not {}",
+                entry.path().string(), summary.shard_count, shard_count);
+            continue;
+        }
+
+        // Shards that saw different corpora may each have left out inputs
+        // the others took, which the counts alone do not show.
+        if (!shards.empty() && (summary.total_files != shards.begin()->second.total_files
+                || summary.corpus_hash != shards.begin()->second.corpus_hash)) {
+            cin::log::error("{} was split from a different corpus than shard {}, inputs may be missing",
+                entry.path().string(), shards.begin()->first);
+            same_corpus = false;
+        }
+
+        shard_count = summary.shard_count;
+        shards[index] = summary;
+    }
+
+    Summary total;
+    std::string missing;
+    std::string lines;
+    double fastest{0.0};
+
+    for (size_t i = 0; i < shard_count; ++i) {
+        const auto shard{shards.find(i)};
+
+        if (shard == shards.end()) {
+            missing += fmt::format("{}{}", missing.empty() ? "" : ",", i);
+            continue;
+        }
+
+        const Summary& s{shard->second};
+        total.files += s.files;
+        total.failed += s.failed;
+        total.cost += s.cost;
+        total.total_cost = s.total_cost;
+        total.audio_seconds += s.audio_seconds;
+        total.input_bytes += s.input_bytes;
+        total.wall_seconds = std::max(total.wall_seconds, s.wall_seconds);
+        fastest = fastest == 0.0 ? s.wall_seconds : std::min(fastest, s.wall_seconds);
+        lines += fmt::format("shard {} {} {} {:.3f} {:.1f}\n",
+            i, s.files, s.failed, s.wall_seconds, 100.0 * s.cost / std::max<uint64_t>(s.total_cost, 1));
+    }
+
+    const size_t corpus_files{shards.empty() ? 0 : shards.begin()->second.total_files};
+    const bool complete{shard_count > 0 && missing.empty() && same_corpus && total.files == corpus_files};
+
+    // The spread shows how well the cost estimate balanced the shards.
+    std::cout << fmt::format(
+        "status {}\nshards {} of {}\nmissing {}\ncorpus {}\ncorpus_files {}\nfiles {}\nfailed {}\n"
+        "audio_seconds {:.3f}\ninput_bytes {}\nwall_seconds {:.3f}\nspread {:.2f}\n{}",
+        complete && total.failed == 0 ? "ok" : "failed",
+        shards.size(), shard_count, missing.empty() ? "none" : missing, same_corpus ? "same" : "differs",
+        corpus_files, total.files, total.failed, total.audio_seconds, total.input_bytes,
+        total.wall_seconds, fastest > 0.0 ? total.wall_seconds / fastest : 1.0, lines) << std::flush;
+
+    return complete && total.failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,834 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <vector>
+#include "log.h"
+#include "simd.h"
+#include "wav.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CIN_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    constexpr int true_peak_taps{12};
+    constexpr int true_peak_phases{4};
+
+    int16_t saturate(float value)
+    {
+        return static_cast<int16_t>(std::lrint(std::clamp(value, -32768.0F, 32767.0F)));
+    }
+
+    // The scalar kernels are the reference: they spell out the summation
+    // order of the vector kernels, lanes first and then across lanes.
+
+    float mix_scalar(const float* coefficients, const int16_t* input, int channels)
+    {
+        float lanes[4];
+
+        for (int k = 0; k < 4; ++k) {
+            const float low{k < channels ? coefficients[k] * input[k] : 0.0F};
+            const float high{k + 4 < channels ? coefficients[k + 4] * input[k + 4] : 0.0F};
+            lanes[k] = low + high;
+        }
+
+        return (lanes[0] + lanes[2]) + (lanes[1] + lanes[3]);
+    }
+
+    void downmix_scalar(const float* left, const float* right, int channels,
+        const int16_t* input, size_t num_frames, int16_t* output)
+    {
+        for (size_t frame = 0; frame < num_frames; ++frame) {
+            output[0] = saturate(mix_scalar(left, input, channels));
+            output[1] = saturate(mix_scalar(right, input, channels));
+            input += channels;
+            output += 2;
+        }
+    }
+
+    void apply_gain_scalar(int16_t* samples, size_t count, float gain)
+    {
+        for (size_t i = 0; i < count; ++i) {
+            samples[i] = saturate(samples[i] * gain);
+        }
+    }
+
+    int sample_peak_scalar(const int16_t* samples, size_t count)
+    {
+        int peak{0};
+
+        for (size_t i = 0; i < count; ++i) {
+            peak = std::max(peak, std::abs(static_cast<int>(samples[i])));
+        }
+
+        return peak;
+    }
+
+    void min_max_scalar(const int16_t* samples, size_t num_frames, int channels, int16_t* mins, int16_t* maxs)
+    {
+        const size_t count{num_frames * channels};
+
+        for (size_t i = 0; i < count; ++i) {
+            const size_t channel{i % channels};
+            mins[channel] = std::min(mins[channel], samples[i]);
+            maxs[channel] = std::max(maxs[channel], samples[i]);
+        }
+    }
+
+    float dot_tail(const float* a, const float* b, size_t i, size_t n, const float* lanes)
+    {
+        float result{(lanes[0] + lanes[1]) + (lanes[2] + lanes[3])};
+
+        for (; i < n; ++i) {
+            result += a[i] * b[i];
+        }
+
+        return result;
+    }
+
+    float dot_scalar(const float* a, const float* b, size_t n)
+    {
+        size_t i{0};
+        float lanes[4]{};
+
+        for (; i + 4 <= n; i += 4) {
+            for (size_t k = 0; k < 4; ++k) {
+                lanes[k] += a[i + k] * b[i + k];
+            }
+        }
+
+        return dot_tail(a, b, i, n, lanes);
+    }
+
+    float interpolated_peak_scalar(const float* window, const float* coefficients)
+    {
+        float peak{0.0F};
+
+        for (int phase = 0; phase < true_peak_phases; ++phase) {
+            float sum{0.0F};
+
+            for (int tap = 0; tap < true_peak_taps; ++tap) {
+                sum += window[true_peak_taps - 1 - tap] * coefficients[tap * true_peak_phases + phase];
+            }
+
+            peak = std::max(peak, std::abs(sum));
+        }
+
+        return peak;
+    }
+
+    bool is_loud(int16_t sample, int16_t threshold)
+    {
+        return sample > threshold || sample < -threshold;
+    }
+
+    size_t find_first_loud_scalar(const int16_t* samples, size_t count, int16_t threshold)
+    {
+        for (size_t i = 0; i < count; ++i) {
+            if (is_loud(samples[i], threshold)) {
+                return i;
+            }
+        }
+
+        return count;
+    }
+
+    size_t find_last_loud_scalar(const int16_t* samples, size_t count, int16_t threshold)
+    {
+        for (size_t i = count; i > 0; --i) {
+            if (is_loud(samples[i - 1], threshold)) {
+                return i;
+            }
+        }
+
+        return 0;
+    }
+
+#if defined(CIN_SIMD_X86)
+#define CIN_SSE2 __attribute__((target("sse2")))
+#define CIN_AVX2 __attribute__((target("avx2")))
+#define CIN_AVX512 __attribute__((target("avx512f,avx512bw")))
+
+    // Lanes 0 and 1 of the result hold the horizontal sums of l and r.
+    CIN_SSE2 __m128 horizontal_pair(__m128 l, __m128 r)
+    {
+        const __m128 pairs{_mm_add_ps(_mm_unpacklo_ps(l, r), _mm_unpackhi_ps(l, r))};
+        return _mm_add_ps(pairs, _mm_movehl_ps(pairs, pairs));
+    }
+
+    CIN_SSE2 __m128 clamp_sse2(__m128 v)
+    {
+        return _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-32768.0F)), _mm_set1_ps(32767.0F));
+    }
+
+    CIN_SSE2 void store_stereo(int16_t* output, __m128 sums)
+    {
+        const __m128i packed{_mm_packs_epi32(_mm_cvtps_epi32(clamp_sse2(sums)), _mm_setzero_si128())};
+        const int32_t stereo{_mm_cvtsi128_si32(packed)};
+        std::memcpy(output, &stereo, sizeof(stereo));
+    }
+
+    CIN_SSE2 void downmix_sse2(const float* left, const float* right, int channels,
+        const int16_t* input, size_t num_frames, int16_t* output)
+    {
+        // One frame fits into a single 128 bit load of eight samples, unused
+        // lanes have zero coefficients. The last frames are left to the scalar
+        // loop so the load never reads past the input.
+        const size_t num_samples{num_frames * channels};
+        const __m128 left_lo{_mm_load_ps(left)};
+        const __m128 left_hi{_mm_load_ps(left + 4)};
+        const __m128 right_lo{_mm_load_ps(right)};
+        const __m128 right_hi{_mm_load_ps(right + 4)};
+        size_t frame{0};
+
+        for (; frame * channels + 8 <= num_samples; ++frame) {
+            const __m128i samples{_mm_loadu_si128(reinterpret_cast<const __m128i*>(input + frame * channels))};
+            const __m128 lo{_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16))};
+            const __m128 hi{_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16))};
+
+            const __m128 l{_mm_add_ps(_mm_mul_ps(lo, left_lo), _mm_mul_ps(hi, left_hi))};
+            const __m128 r{_mm_add_ps(_mm_mul_ps(lo, right_lo), _mm_mul_ps(hi, right_hi))};
+            store_stereo(output + frame * 2, horizontal_pair(l, r));
+        }
+
+        downmix_scalar(left, right, channels, input + frame * channels, num_frames - frame, output + frame * 2);
+    }
+
+    CIN_SSE2 void apply_gain_sse2(int16_t* samples, size_t count, float gain)
+    {
+        const __m128 factor{_mm_set1_ps(gain)};
+        size_t i{0};
+
+        for (; i + 8 <= count; i += 8) {
+            const __m128i v{_mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i))};
+            const __m128 lo{_mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)), factor)};
+            const __m128 hi{_mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16)), factor)};
+            const __m128i packed{_mm_packs_epi32(_mm_cvtps_epi32(clamp_sse2(lo)), _mm_cvtps_epi32(clamp_sse2(hi)))};
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(samples + i), packed);
+        }
+
+        apply_gain_scalar(samples + i, count - i, gain);
+    }
+
+    CIN_SSE2 int sample_peak_sse2(const int16_t* samples, size_t count)
+    {
+        __m128i high{_mm_setzero_si128()};
+        __m128i low{_mm_setzero_si128()};
+        size_t i{0};
+
+        for (; i + 8 <= count; i += 8) {
+            const __m128i v{_mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i))};
+            high = _mm_max_epi16(high, v);
+            low = _mm_min_epi16(low, v);
+        }
+
+        alignas(16) int16_t highs[8];
+        alignas(16) int16_t lows[8];
+        _mm_store_si128(reinterpret_cast<__m128i*>(highs), high);
+        _mm_store_si128(reinterpret_cast<__m128i*>(lows), low);
+        int peak{sample_peak_scalar(samples + i, count - i)};
+
+        for (int lane = 0; lane < 8; ++lane) {
+            peak = std::max({peak, static_cast<int>(highs[lane]), -static_cast<int>(lows[lane])});
+        }
+
+        return peak;
+    }
+
+    // Folds lane minima and maxima into channels. With interleaved stereo
+    // even lanes hold the left and odd lanes the right channel, with mono all
+    // lanes belong to the one channel.
+    void fold_lanes(const int16_t* lows, const int16_t* highs, int lanes, int channels, int16_t* mins, int16_t* maxs)
+    {
+        for (int lane = 0; lane < lanes; ++lane) {
+            const int channel{lane % channels};
+            mins[channel] = std::min(mins[channel], lows[lane]);
+            maxs[channel] = std::max(maxs[channel], highs[lane]);
+        }
+    }
+
+    CIN_SSE2 void min_max_sse2(const int16_t* samples, size_t num_frames, int channels, int16_t* mins, int16_t* maxs)
+    {
+        const size_t count{num_frames * channels};
+        size_t i{0};
+
+        if (count >= 8) {
+            __m128i low{_mm_set1_epi16(std::numeric_limits<int16_t>::max())};
+            __m128i high{_mm_set1_epi16(std::numeric_limits<int16_t>::min())};
+
+            for (; i + 8 <= count; i += 8) {
+                const __m128i v{_mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i))};
+                low = _mm_min_epi16(low, v);
+                high = _mm_max_epi16(high, v);
+            }
+
+            alignas(16) int16_t lows[8];
+            alignas(16) int16_t highs[8];
+            _mm_store_si128(reinterpret_cast<__m128i*>(lows), low);
+            _mm_store_si128(reinterpret_cast<__m128i*>(highs), high);
+            fold_lanes(lows, highs, 8, channels, mins, maxs);
+        }
+
+        min_max_scalar(samples + i, (count - i) / channels, channels, mins, maxs);
+    }
+
+    CIN_SSE2 float dot_sse2(const float* a, const float* b, size_t n)
+    {
+        __m128 sum{_mm_setzero_ps()};
+        size_t i{0};
+
+        for (; i + 4 <= n; i += 4) {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        }
+
+        alignas(16) float lanes[4];
+        _mm_store_ps(lanes, sum);
+        return dot_tail(a, b, i, n, lanes);
+    }
+
+    CIN_SSE2 float interpolated_peak_sse2(const float* window, const float* coefficients)
+    {
+        // One tap of all four phases is a single vector.
+        __m128 sum{_mm_setzero_ps()};
+
+        for (int tap = 0; tap < true_peak_taps; ++tap) {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(window[true_peak_taps - 1 - tap]),
+                _mm_load_ps(coefficients + tap * true_peak_phases)));
+        }
+
+        const __m128 magnitude{_mm_andnot_ps(_mm_set1_ps(-0.0F), sum)};
+        const __m128 pairs{_mm_max_ps(magnitude, _mm_movehl_ps(magnitude, magnitude))};
+        return _mm_cvtss_f32(_mm_max_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+    }
+
+    CIN_SSE2 int loud_mask_sse2(const int16_t* samples, __m128i high, __m128i low)
+    {
+        const __m128i v{_mm_loadu_si128(reinterpret_cast<const __m128i*>(samples))};
+        return _mm_movemask_epi8(_mm_or_si128(_mm_cmpgt_epi16(v, high), _mm_cmplt_epi16(v, low)));
+    }
+
+    CIN_SSE2 size_t find_first_loud_sse2(const int16_t* samples, size_t count, int16_t threshold)
+    {
+        const __m128i high{_mm_set1_epi16(threshold)};
+        const __m128i low{_mm_set1_epi16(static_cast<int16_t>(-threshold))};
+        size_t i{0};
+
+        for (; i + 8 <= count; i += 8) {
+            const int mask{loud_mask_sse2(samples + i, high, low)};
+
+            if (mask != 0) {
+                return i + __builtin_ctz(static_cast<unsigned>(mask)) / 2;
+            }
+        }
+
+        return i + find_first_loud_scalar(samples + i, count - i, threshold);
+    }
+
+    CIN_SSE2 size_t find_last_loud_sse2(const int16_t* samples, size_t count, int16_t threshold)
+    {
+        const __m128i high{_mm_set1_epi16(threshold)};
+        const __m128i low{_mm_set1_epi16(static_cast<int16_t>(-threshold))};
+        size_t i{count};
+
+        for (; i >= 8; i -= 8) {
+            const int mask{loud_mask_sse2(samples + i - 8, high, low)};
+
+            if (mask != 0) {
+                return i - 8 + (31 - __builtin_clz(static_cast<unsigned>(mask))) / 2 + 1;
+            }
+        }
+
+        return find_last_loud_scalar(samples, i, threshold);
+    }
+
+    CIN_AVX2 __m256 clamp_avx2(__m256 v)
+    {
+        return _mm256_min_ps(_mm256_max_ps(v, _mm256_set1_ps(-32768.0F)), _mm256_set1_ps(32767.0F));
+    }
+
+    CIN_AVX2 __m256 load_widened(const int16_t* samples)
+    {
+        return _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(samples))));
+    }
+
+    CIN_AVX2 void downmix_avx2(const float* left, const float* right, int channels,
+        const int16_t* input, size_t num_frames, int16_t* output)
+    {
+        // A frame is widened and weighted in one step, the low and high halves
+        // are then added like the two halves of the SSE2 kernel.
+        const size_t num_samples{num_frames * channels};
+        const __m256 left_all{_mm256_loadu_ps(left)};
+        const __m256 right_all{_mm256_loadu_ps(right)};
+        size_t frame{0};
+
+        for (; frame * channels + 8 <= num_samples; ++frame) {
+            const __m256 samples{load_widened(input + frame * channels)};
+            const __m256 lw{_mm256_mul_ps(samples, left_all)};
+            const __m256 rw{_mm256_mul_ps(samples, right_all)};
+            const __m128 l{_mm_add_ps(_mm256_castps256_ps128(lw), _mm256_extractf128_ps(lw, 1))};
+            const __m128 r{_mm_add_ps(_mm256_castps256_ps128(rw), _mm256_extractf128_ps(rw, 1))};
+            store_stereo(output + frame * 2, horizontal_pair(l, r));
+        }
+
+        downmix_scalar(left, right, channels, input + frame * channels, num_frames - frame, output + frame * 2);
+    }
+
+    CIN_AVX2 void apply_gain_avx2(int16_t* samples, size_t count, float gain)
+    {
+        const __m256 factor{_mm256_set1_ps(gain)};
+        size_t i{0};
+
+        for (; i + 16 <= count; i += 16) {
+            const __m256 lo{clamp_avx2(_mm256_mul_ps(load_widened(samples + i), factor))};
+            const __m256 hi{clamp_avx2(_mm256_mul_ps(load_widened(samples + i + 8), factor))};
+            // packs works within 128 bit lanes, the permute restores the order.
+            const __m256i packed{_mm256_packs_epi32(_mm256_cvtps_epi32(lo), _mm256_cvtps_epi32(hi))};
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(samples + i), _mm256_permute4x64_epi64(packed, 0xd8));
+        }
+
+        apply_gain_sse2(samples + i, count - i, gain);
+    }
+
+    CIN_AVX2 int sample_peak_avx2(const int16_t* samples, size_t count)
+    {
+        __m256i high{_mm256_setzero_si256()};
+        __m256i low{_mm256_setzero_si256()};
+        size_t i{0};
+
+        for (; i + 16 <= count; i += 16) {
+            const __m256i v{_mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + i))};
+            high = _mm256_max_epi16(high, v);
+            low = _mm256_min_epi16(low, v);
+        }
+
+        alignas(32) int16_t highs[16];
+        alignas(32) int16_t lows[16];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(highs), high);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lows), low);
+        int peak{sample_peak_sse2(samples + i, count - i)};
+
+        for (int lane = 0; lane < 16; ++lane) {
+            peak = std::max({peak, static_cast<int>(highs[lane]), -static_cast<int>(lows[lane])});
+        }
+
+        return peak;
+    }
+
+    CIN_AVX2 void min_max_avx2(const int16_t* samples, size_t num_frames, int channels, int16_t* mins, int16_t* maxs)
+    {
+        const size_t count{num_frames * channels};
+        size_t i{0};
+
+        if (count >= 16) {
+            __m256i low{_mm256_set1_epi16(std::numeric_limits<int16_t>::max())};
+            __m256i high{_mm256_set1_epi16(std::numeric_limits<int16_t>::min())};
+
+            for (; i + 16 <= count; i += 16) {
+                const __m256i v{_mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + i))};
+                low = _mm256_min_epi16(low, v);
+                high = _mm256_max_epi16(high, v);
+            }
+
+            alignas(32) int16_t lows[16];
+            alignas(32) int16_t highs[16];
+            _mm256_store_si256(reinterpret_cast<__m256i*>(lows), low);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(highs), high);
+            fold_lanes(lows, highs, 16, channels, mins, maxs);
+        }
+
+        min_max_sse2(samples + i, (count - i) / channels, channels, mins, maxs);
+    }
+
+    CIN_AVX2 float dot_avx2(const float* a, const float* b, size_t n)
+    {
+        // Products are formed eight at a time but added four at a time, in
+        // the order of the SSE2 kernel.
+        __m128 sum{_mm_setzero_ps()};
+        size_t i{0};
+
+        for (; i + 8 <= n; i += 8) {
+            const __m256 products{_mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i))};
+            sum = _mm_add_ps(sum, _mm256_castps256_ps128(products));
+            sum = _mm_add_ps(sum, _mm256_extractf128_ps(products, 1));
+        }
+
+        for (; i + 4 <= n; i += 4) {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        }
+
+        alignas(16) float lanes[4];
+        _mm_store_ps(lanes, sum);
+        return dot_tail(a, b, i, n, lanes);
+    }
+
+    CIN_AVX2 unsigned loud_mask_avx2(const int16_t* samples, __m256i high, __m256i low)
+    {
+        const __m256i v{_mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples))};
+        return static_cast<unsigned>(_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpgt_epi16(v, high), _mm256_cmpgt_epi16(low, v))));
+    }
+
+    CIN_AVX2 size_t find_first_loud_avx2(const int16_t* samples, size_t count, int16_t threshold)
+    {
+        const __m256i high{_mm256_set1_epi16(threshold)};
+        const __m256i low{_mm256_set1_epi16(static_cast<int16_t>(-threshold))};
+        size_t i{0};
+
+        for (; i + 16 <= count; i += 16) {
+            const unsigned mask{loud_mask_avx2(samples + i, high, low)};
+
+            if (mask != 0) {
+                return i + __builtin_ctz(mask) / 2;
+            }
+        }
+
+        return i + find_first_loud_sse2(samples + i, count - i, threshold);
+    }
+
+    CIN_AVX2 size_t find_last_loud_avx2(const int16_t* samples, size_t count, int16_t threshold)
+    {
+        const __m256i high{_mm256_set1_epi16(threshold)};
+        const __m256i low{_mm256_set1_epi16(static_cast<int16_t>(-threshold))};
+        size_t i{count};
+
+        for (; i >= 16; i -= 16) {
+            const unsigned mask{loud_mask_avx2(samples + i - 16, high, low)};
+
+            if (mask != 0) {
+                return i - 16 + (31 - __builtin_clz(mask)) / 2 + 1;
+            }
+        }
+
+        return find_last_loud_sse2(samples, i, threshold);
+    }
+
+    CIN_AVX512 void apply_gain_avx512(int16_t* samples, size_t count, float gain)
+    {
+        const __m512 factor{_mm512_set1_ps(gain)};
+        const __m512 lowest{_mm512_set1_ps(-32768.0F)};
+        const __m512 highest{_mm512_set1_ps(32767.0F)};
+        size_t i{0};
+
+        for (; i + 16 <= count; i += 16) {
+            const __m256i v{_mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + i))};
+            const __m512 scaled{_mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_cvtepi16_epi32(v)), factor)};
+            const __m512i rounded{_mm512_cvtps_epi32(_mm512_min_ps(_mm512_max_ps(scaled, lowest), highest))};
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(samples + i), _mm512_cvtsepi32_epi16(rounded));
+        }
+
+        apply_gain_avx2(samples + i, count - i, gain);
+    }
+
+    CIN_AVX512 int sample_peak_avx512(const int16_t* samples, size_t count)
+    {
+        __m512i high{_mm512_setzero_si512()};
+        __m512i low{_mm512_setzero_si512()};
+        size_t i{0};
+
+        for (; i + 32 <= count; i += 32) {
+            const __m512i v{_mm512_loadu_si512(samples + i)};
+            high = _mm512_max_epi16(high, v);
+            low = _mm512_min_epi16(low, v);
+        }
+
+        alignas(64) int16_t highs[32];
+        alignas(64) int16_t lows[32];
+        _mm512_store_si512(highs, high);
+        _mm512_store_si512(lows, low);
+        int peak{sample_peak_avx2(samples + i, count - i)};
+
+        for (int lane = 0; lane < 32; ++lane) {
+            peak = std::max({peak, static_cast<int>(highs[lane]), -static_cast<int>(lows[lane])});
+        }
+
+        return peak;
+    }
+
+    CIN_AVX512 void min_max_avx512(const int16_t* samples, size_t num_frames, int channels, int16_t* mins, int16_t* maxs)
+    {
+        const size_t count{num_frames * channels};
+        size_t i{0};
+
+        if (count >= 32) {
+            __m512i low{_mm512_set1_epi16(std::numeric_limits<int16_t>::max())};
+            __m512i high{_mm512_set1_epi16(std::numeric_limits<int16_t>::min())};
+
+            for (; i + 32 <= count; i += 32) {
+                const __m512i v{_mm512_loadu_si512(samples + i)};
+                low = _mm512_min_epi16(low, v);
+                high = _mm512_max_epi16(high, v);
+            }
+
+            alignas(64) int16_t lows[32];
+            alignas(64) int16_t highs[32];
+            _mm512_store_si512(lows, low);
+            _mm512_store_si512(highs, high);
+            fold_lanes(lows, highs, 32, channels, mins, maxs);
+        }
+
+        min_max_avx2(samples + i, (count - i) / channels, channels, mins, maxs);
+    }
+
+    CIN_AVX512 size_t find_first_loud_avx512(const int16_t* samples, size_t count, int16_t threshold)
+    {
+        const __m512i high{_mm512_set1_epi16(threshold)};
+        const __m512i low{_mm512_set1_epi16(static_cast<int16_t>(-threshold))};
+        size_t i{0};
+
+        for (; i + 32 <= count; i += 32) {
+            const __m512i v{_mm512_loadu_si512(samples + i)};
+            const __mmask32 mask{_mm512_cmpgt_epi16_mask(v, high) | _mm512_cmplt_epi16_mask(v, low)};
+
+            if (mask != 0) {
+                return i + __builtin_ctz(mask);
+            }
+        }
+
+        return i + find_first_loud_avx2(samples + i, count - i, threshold);
+    }
+
+    CIN_AVX512 size_t find_last_loud_avx512(const int16_t* samples, size_t count, int16_t threshold)
+    {
+        const __m512i high{_mm512_set1_epi16(threshold)};
+        const __m512i low{_mm512_set1_epi16(static_cast<int16_t>(-threshold))};
+        size_t i{count};
+
+        for (; i >= 32; i -= 32) {
+            const __m512i v{_mm512_loadu_si512(samples + i - 32)};
+            const __mmask32 mask{_mm512_cmpgt_epi16_mask(v, high) | _mm512_cmplt_epi16_mask(v, low)};
+
+            if (mask != 0) {
+                return i - 32 + (31 - __builtin_clz(mask)) + 1;
+            }
+        }
+
+        return find_last_loud_avx2(samples, i, threshold);
+    }
+#endif
+
+    // Downmix, dot product and the true peak filter sum in a fixed order,
+    // wider registers would only add shuffles on AVX-512, so those reuse the
+    // narrower kernels.
+    const cin::Kernels kernel_tables[]{
+        {cin::SimdLevel::scalar, downmix_scalar, apply_gain_scalar, sample_peak_scalar, min_max_scalar,
+            dot_scalar, interpolated_peak_scalar, find_first_loud_scalar, find_last_loud_scalar},
+#if defined(CIN_SIMD_X86)
+        {cin::SimdLevel::sse2, downmix_sse2, apply_gain_sse2, sample_peak_sse2, min_max_sse2,
+            dot_sse2, interpolated_peak_sse2, find_first_loud_sse2, find_last_loud_sse2},
+        {cin::SimdLevel::avx2, downmix_avx2, apply_gain_avx2, sample_peak_avx2, min_max_avx2,
+            dot_avx2, interpolated_peak_sse2, find_first_loud_avx2, find_last_loud_avx2},
+        {cin::SimdLevel::avx512, downmix_avx2, apply_gain_avx512, sample_peak_avx512, min_max_avx512,
+            dot_avx2, interpolated_peak_sse2, find_first_loud_avx512, find_last_loud_avx512},
+#endif
+    };
+
+    const cin::Kernels* active_kernels{&cin::kernels_for(cin::detect_simd())};
+
+    constexpr const char* kernel_names[]{
+        "downmix", "gain", "sample_peak", "min_max", "dot", "true_peak", "trim_scan",
+    };
+
+    template <typename T>
+    void append(std::string& out, const T* values, size_t count)
+    {
+        out.append(reinterpret_cast<const char*>(values), count * sizeof(T));
+    }
+
+    // Runs every kernel over @p samples with a spread of parameters that hits
+    // saturation, tails of every length and mono as well as multichannel
+    // layouts. Returns the raw results, one string per kernel_names entry.
+    std::vector<std::string> run_kernels(const cin::Kernels& kernels, const int16_t* samples, size_t count)
+    {
+        std::vector<std::string> results(std::size(kernel_names));
+        std::vector<int16_t> output(2 * count);
+
+        for (int channels = 1; channels <= 8; ++channels) {
+            alignas(16) float left[8]{};
+            alignas(16) float right[8]{};
+
+            for (int channel = 0; channel < channels; ++channel) {
+                left[channel] = 0.9F / (channel + 1);
+                right[channel] = channel % 2 == 0 ? 0.35F : 1.6F;
+            }
+
+            const size_t frames{count / channels};
+            kernels.downmix(left, right, channels, samples, frames, output.data());
+            append(results[0], output.data(), 2 * frames);
+        }
+
+        for (const float gain : {0.3F, 1.0F, 1.7F, 12.0F}) {
+            std::copy(samples, samples + count, output.begin());
+            kernels.apply_gain(output.data(), count, gain);
+            append(results[1], output.data(), count);
+        }
+
+        for (size_t offset = 0; offset < std::min<size_t>(count, 40); offset += 3) {
+            const int peak{kernels.sample_peak(samples + offset, count - offset)};
+            append(results[2], &peak, 1);
+        }
+
+        for (int channels = 1; channels <= 2; ++channels) {
+            for (size_t frames = 0; frames <= count / channels; frames += 1 + frames / 3) {
+                int16_t mins[2]{INT16_MAX, INT16_MAX};
+                int16_t maxs[2]{INT16_MIN, INT16_MIN};
+                kernels.min_max(samples, frames, channels, mins, maxs);
+                append(results[3], mins, 2);
+                append(results[3], maxs, 2);
+            }
+        }
+
+        std::vector<float> floats(count);
+        std::transform(samples, samples + count, floats.begin(), [](int16_t s) { return s / 32768.0F; });
+        alignas(16) float coefficients[64];
+
+        for (size_t i = 0; i < std::size(coefficients); ++i) {
+            coefficients[i] = (i % 2 == 0 ? 1.0F : -1.0F) / (1.0F + i) + 0.01F * i;
+        }
+
+        for (size_t start = 0; start + 64 <= count; start += 17) {
+            for (const size_t taps : {5, 16, 29, 32, 64}) {
+                const float sum{kernels.dot(coefficients, floats.data() + start, taps)};
+                append(results[4], &sum, 1);
+            }
+        }
+
+        for (size_t start = 0; start + true_peak_taps <= count; ++start) {
+            const float peak{kernels.interpolated_peak(floats.data() + start, coefficients)};
+            append(results[5], &peak, 1);
+        }
+
+        for (const int16_t threshold : {0, 30, 1000, 20000, 32767}) {
+            for (size_t length = count; length > 0; length /= 2) {
+                const size_t positions[]{
+                    kernels.find_first_loud(samples, length, threshold),
+                    kernels.find_last_loud(samples, length, threshold),
+                    kernels.find_first_loud(samples + count - length, length, threshold),
+                };
+                append(results[6], positions, std::size(positions));
+            }
+        }
+
+        return results;
+    }
+}
+
+cin::SimdLevel cin::detect_simd()
+{
+    static const SimdLevel level{[] {
+#if defined(CIN_SIMD_X86)
+        // These also check that the operating system saves the wide registers.
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+            return SimdLevel::avx512;
+        }
+
+        if (__builtin_cpu_supports("avx2")) {
+            return SimdLevel::avx2;
+        }
+
+        if (__builtin_cpu_supports("sse2")) {
+            return SimdLevel::sse2;
+        }
+#endif
+        return SimdLevel::scalar;
+    }()};
+
+    return level;
+}
+
+const cin::Kernels& cin::kernels_for(SimdLevel level)
+{
+    if (level > detect_simd()) {
+        throw UnsupportedSimd{fmt::format("This CPU does not support {}, the best it supports is {}",
+            simd_name(level), simd_name(detect_simd()))};
+    }
+
+    return kernel_tables[static_cast<size_t>(level)];
+}
+
+const cin::Kernels& cin::simd()
+{
+    return *active_kernels;
+}
+
+void cin::select_simd(SimdLevel level)
+{
+    active_kernels = &kernels_for(level);
+    cin::log::info("Using {} kernels", simd_name(level));
+}
+
+const char* cin::simd_name(SimdLevel level)
+{
+    switch (level) {
+        case SimdLevel::scalar:
+            return "scalar";
+        case SimdLevel::sse2:
+            return "sse2";
+        case SimdLevel::avx2:
+            return "avx2";
+        case SimdLevel::avx512:
+            return "avx512";
+    }
+
+    return "unknown";
+}
+
+int cin::check_simd(const Paths& paths)
+{
+    const auto best{static_cast<size_t>(detect_simd())};
+    std::vector<std::vector<bool>> mismatches(best + 1, std::vector<bool>(std::size(kernel_names), false));
+    size_t files{0};
+
+    for (const auto& path : paths) {
+        Buffer<int16_t> samples;
+
+        try {
+            const WavFile wav{path};
+            wav.read_samples(samples, wav.num_samples());
+        }
+        catch (const std::runtime_error& error) {
+            cin::log::warn("Skipping {}: {}", path.string(), error.what());
+            continue;
+        }
+
+        files++;
+        const auto reference{run_kernels(kernel_tables[0], samples.data(), samples.size())};
+
+        for (size_t level = 1; level <= best; ++level) {
+            const auto results{run_kernels(kernel_tables[level], samples.data(), samples.size())};
+
+            for (size_t kernel = 0; kernel < results.size(); ++kernel) {
+                if (results[kernel] != reference[kernel]) {
+                    cin::log::error("{} {} differs from scalar on {}",
+                        simd_name(static_cast<SimdLevel>(level)), kernel_names[kernel], path.string());
+                    mismatches[level][kernel] = true;
+                }
+            }
+        }
+    }
+
+    bool ok{true};
+    std::string lines;
+
+    for (size_t level = 1; level <= best; ++level) {
+        std::string failed;
+
+        for (size_t kernel = 0; kernel < std::size(kernel_names); ++kernel) {
+            if (mismatches[level][kernel]) {
+                failed += fmt::format("{}{}", failed.empty() ? "" : ",", kernel_names[kernel]);
+            }
+        }
+
+        ok = ok && failed.empty();
+        lines += fmt::format("{} {}\n", simd_name(static_cast<SimdLevel>(level)), failed.empty() ? "ok" : failed);
+    }
+
+    std::cout << fmt::format("status {}\nfiles {}\ndetected {}\n{}",
+        ok && files > 0 ? "ok" : "failed", files, simd_name(detect_simd()), lines) << std::flush;
+
+    return ok && files > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "simd.h"
+#include "trim.h"
+
+namespace
+{
+    // Silence held back beyond this is released as an internal pause, which
+    // bounds the memory a long quiet passage can take.
+    constexpr double max_pending_seconds{10.0};
+}
+
+cin::SilenceTrimmer::SilenceTrimmer(int num_channels, int sample_rate, double threshold_db, double min_tail, Arena& arena)
+: m_channels{num_channels}
+, m_threshold{static_cast<int16_t>(std::clamp(std::lrint(32768.0 * std::pow(10.0, threshold_db / 20.0)), 0L, 32767L))}
+, m_min_tail{static_cast<size_t>(std::max(min_tail, 0.0) * sample_rate)}
+, m_max_pending{std::max(m_min_tail, static_cast<size_t>(max_pending_seconds * sample_rate))}
+, m_pending{0, arena}
+, m_output{0, arena}
+{}
+
+void cin::SilenceTrimmer::append(Buffer<int16_t>& buffer, const int16_t* samples, size_t num_frames)
+{
+    if (num_frames == 0) {
+        return;
+    }
+
+    const size_t offset{buffer.size()};
+    buffer.resize(offset + num_frames * m_channels);
+    std::memcpy(buffer.data() + offset, samples, num_frames * m_channels * sizeof(int16_t));
+}
+
+size_t cin::SilenceTrimmer::process(const int16_t* samples, size_t num_frames)
+{
+    const size_t count{num_frames * m_channels};
+    const size_t first{cin::simd().find_first_loud(samples, count, m_threshold) / m_channels};
+    m_output.clear();
+
+    if (first == num_frames) {
+        if (!m_started) {
+            m_leading += num_frames;
+            return 0;
+        }
+
+        append(m_pending, samples, num_frames);
+
+        if (m_pending.size() / m_channels > m_max_pending) {
+            append(m_output, m_pending.data(), m_pending.size() / m_channels);
+            m_pending.clear();
+        }
+
+        return m_output.size() / m_channels;
+    }
+
+    const size_t last{(cin::simd().find_last_loud(samples, count, m_threshold) + m_channels - 1) / m_channels};
+    const size_t start{m_started ? 0 : first};
+
+    if (!m_started) {
+        m_leading += first;
+        m_started = true;
+    }
+
+    append(m_output, m_pending.data(), m_pending.size() / m_channels);
+    append(m_output, samples + start * m_channels, last - start);
+    m_pending.clear();
+    append(m_pending, samples + last * m_channels, num_frames - last);
+    return m_output.size() / m_channels;
+}
+
+size_t cin::SilenceTrimmer::finish()
+{
+    const size_t pending{m_pending.size() / m_channels};
+    const size_t kept{std::min(pending, m_min_tail)};
+
+    m_output.clear();
+    append(m_output, m_pending.data(), kept);
+    m_pending.clear();
+    m_trailing = pending - kept;
+    return kept;
+}
+
+int16_t* cin::SilenceTrimmer::output()
+{
+    return m_output.data();
+}
+
+uint64_t cin::SilenceTrimmer::leading_frames() const
+{
+    return m_leading;
+}
+
+uint64_t cin::SilenceTrimmer::trailing_frames() const
+{
+    return m_trailing;
+}
@@ -0,0 +1,411 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <lame/lame.h>
+#include "arena.h"
+#include "log.h"
+#include "output.h"
+#include "verify.h"
+
+namespace
+{
+    // mpglib output lags the encoder input by its own 528 + 1 samples on
+    // top of the encoder delay. The search below also covers a decoded
+    // Xing/Info frame and padding variations between LAME versions.
+    constexpr size_t decoder_delay{529};
+    constexpr size_t mp3_frame_size{1152};
+
+    // Windows quieter than this RMS take no part in alignment and SNR.
+    constexpr double min_window_rms{64.0};
+
+    constexpr int mpeg1_bitrates[16]{0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0};
+    constexpr int mpeg2_bitrates[16]{0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0};
+    constexpr int mpeg1_rates[4]{44100, 48000, 32000, 0};
+
+    struct FrameHeader {
+        size_t length;
+        int sample_rate;
+    };
+
+    bool parse_header(const uint8_t* p, FrameHeader& header)
+    {
+        if (p[0] != 0xff || (p[1] & 0xe0) != 0xe0) {
+            return false;
+        }
+
+        const int version{(p[1] >> 3) & 3};
+        const int layer{(p[1] >> 1) & 3};
+        const int bitrate_index{p[2] >> 4};
+        const int rate_index{(p[2] >> 2) & 3};
+        const int padding{(p[2] >> 1) & 1};
+
+        if (version == 1 || layer != 1 || mpeg1_rates[rate_index] == 0) {
+            return false;
+        }
+
+        const bool mpeg1{version == 3};
+        const int bitrate{(mpeg1 ? mpeg1_bitrates : mpeg2_bitrates)[bitrate_index]};
+
+        if (bitrate == 0) {
+            return false;
+        }
+
+        // MPEG-2 halves and MPEG-2.5 quarters the MPEG-1 rates.
+        header.sample_rate = mpeg1_rates[rate_index] >> (mpeg1 ? 0 : version == 2 ? 1 : 2);
+        header.length = (mpeg1 ? 144000 : 72000) * bitrate / header.sample_rate + padding;
+        return true;
+    }
+
+    size_t skip_id3v2(const std::vector<uint8_t>& data)
+    {
+        if (data.size() < 10 || data[0] != 'I' || data[1] != 'D' || data[2] != '3') {
+            return 0;
+        }
+
+        const size_t size{(size_t{data[6]} << 21) | (size_t{data[7]} << 14) | (size_t{data[8]} << 7) | data[9]};
+        const bool footer{(data[5] & 0x10) != 0};
+        return 10 + size + (footer ? 10 : 0);
+    }
+
+    std::vector<uint8_t> read_file(const std::filesystem::path& path)
+    {
+        std::ifstream file{path, std::ios::binary};
+
+        if (!file) {
+            throw std::runtime_error{"could not open"};
+        }
+
+        return {std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+    }
+
+    /**
+     * Keeps the decoded samples around each reference window, wide enough
+     * to search for the offset between both streams.
+     */
+    class DecodedWindows {
+    public:
+        DecodedWindows(const cin::VerifyReference& reference, size_t max_lag)
+        : m_channels{static_cast<size_t>(reference.num_channels)}
+        , m_span{cin::VerifyReference::window_frames + max_lag}
+        , m_samples((reference.windows.size() / m_channels + cin::VerifyReference::window_frames - 1)
+            / cin::VerifyReference::window_frames * m_span * m_channels)
+        {}
+
+        void append(const short* left, const short* right, size_t frames)
+        {
+            for (size_t i = 0; i < frames; ++i, ++m_position) {
+                const size_t window{m_position / cin::VerifyReference::stride_frames};
+                const size_t offset{m_position % cin::VerifyReference::stride_frames};
+                const size_t index{(window * m_span + offset) * m_channels};
+
+                if (offset >= m_span || index >= m_samples.size()) {
+                    continue;
+                }
+
+                m_samples[index] = left[i];
+
+                if (m_channels == 2) {
+                    m_samples[index + 1] = right[i];
+                }
+            }
+        }
+
+        /** Return the decoded samples of @p window, shifted by @p lag frames. */
+        const int16_t* at(size_t window, size_t lag) const
+        {
+            return m_samples.data() + (window * m_span + lag) * m_channels;
+        }
+
+        uint64_t frames() const
+        {
+            return m_position;
+        }
+
+    private:
+        size_t m_channels;
+        size_t m_span;
+        std::vector<int16_t> m_samples;
+        uint64_t m_position{0};
+    };
+
+    double squared_error(const int16_t* a, const int16_t* b, size_t count)
+    {
+        double sum{0.0};
+
+        for (size_t i = 0; i < count; ++i) {
+            const double difference{1.0 * a[i] - b[i]};
+            sum += difference * difference;
+        }
+
+        return sum;
+    }
+
+    double energy(const int16_t* samples, size_t count)
+    {
+        double sum{0.0};
+
+        for (size_t i = 0; i < count; ++i) {
+            sum += 1.0 * samples[i] * samples[i];
+        }
+
+        return sum;
+    }
+
+    /**
+     * Check one file, return an empty string if it passed.
+     */
+    std::string verify_file(const cin::VerifyReference& reference)
+    {
+        auto data{read_file(reference.output)};
+        const size_t channels{static_cast<size_t>(reference.num_channels)};
+        const size_t max_lag{reference.encoder_delay + decoder_delay + 2 * mp3_frame_size};
+
+        std::unique_ptr<hip_global_flags, int(*)(hip_t)> hip{hip_decode_init(), hip_decode_exit};
+        DecodedWindows decoded{reference, max_lag};
+        short left[2 * mp3_frame_size];
+        short right[2 * mp3_frame_size];
+
+        size_t offset{skip_id3v2(data)};
+        size_t num_headers{0};
+        size_t bad_frames{0};
+        FrameHeader header{};
+
+        const auto decode{[&](uint8_t* frame, size_t length) {
+            int result{hip_decode1(hip.get(), frame, length, left, right)};
+
+            while (result != 0) {
+                if (result < 0) {
+                    bad_frames++;
+                    return;
+                }
+
+                decoded.append(left, right, result);
+                result = hip_decode1(hip.get(), frame, 0, left, right);
+            }
+        }};
+
+        while (offset + 4 <= data.size()) {
+            // An ID3v1 tag may follow the last frame.
+            if (data.size() - offset == 128 && std::equal(data.begin() + offset, data.begin() + offset + 3, "TAG")) {
+                break;
+            }
+
+            if (!parse_header(data.data() + offset, header) || offset + header.length > data.size()) {
+                return fmt::format("broken frame header at byte {} after {} frames", offset, num_headers);
+            }
+
+            if (header.sample_rate != reference.sample_rate) {
+                return fmt::format("frame {} has a sample rate of {} Hz instead of {} Hz", num_headers, header.sample_rate, reference.sample_rate);
+            }
+
+            decode(data.data() + offset, header.length);
+            offset += header.length;
+            num_headers++;
+        }
+
+        if (num_headers == 0) {
+            return "no MP3 frames";
+        }
+
+        if (bad_frames > 0) {
+            return fmt::format("{} of {} frames could not be decoded", bad_frames, num_headers);
+        }
+
+        // Align on the first window with content, silence matches any lag.
+        const size_t window_samples{cin::VerifyReference::window_frames * channels};
+        const size_t num_windows{reference.windows.size() / window_samples};
+        const auto loud{[&](size_t window) {
+            const int16_t* samples{reference.windows.data() + window * window_samples};
+            return energy(samples, window_samples) >= min_window_rms * min_window_rms * window_samples;
+        }};
+
+        size_t lag{reference.encoder_delay + decoder_delay};
+        size_t first_loud{0};
+
+        while (first_loud < num_windows && !loud(first_loud)) {
+            first_loud++;
+        }
+
+        if (first_loud < num_windows) {
+            const int16_t* samples{reference.windows.data() + first_loud * window_samples};
+            double best{squared_error(samples, decoded.at(first_loud, 0), window_samples)};
+            lag = 0;
+
+            for (size_t candidate = 1; candidate <= max_lag; ++candidate) {
+                const double error{squared_error(samples, decoded.at(first_loud, candidate), window_samples)};
+
+                if (error < best) {
+                    best = error;
+                    lag = candidate;
+                }
+            }
+        }
+
+        // LAME pads the last frame and flushes one more, anything beyond
+        // that or short of the source means frames went missing.
+        const int64_t difference{static_cast<int64_t>(decoded.frames()) - static_cast<int64_t>(lag + reference.num_frames)};
+
+        if (difference < -static_cast<int64_t>(mp3_frame_size) || difference > static_cast<int64_t>(3 * mp3_frame_size)) {
+            return fmt::format("duration differs from the source by {:.3f} s", 1.0 * difference / reference.sample_rate);
+        }
+
+        double signal{0.0};
+        double noise{0.0};
+
+        for (size_t window = first_loud; window < num_windows; ++window) {
+            if (!loud(window)) {
+                continue;
+            }
+
+            const int16_t* samples{reference.windows.data() + window * window_samples};
+            signal += energy(samples, window_samples);
+            noise += squared_error(samples, decoded.at(window, lag), window_samples);
+        }
+
+        if (signal > 0.0) {
+            const double snr_db{10.0 * std::log10(signal / std::max(noise, 1.0))};
+
+            if (snr_db < cin::Verifier::min_snr_db) {
+                return fmt::format("SNR of {:.1f} dB against the source", snr_db);
+            }
+
+            cin::log::debug(" verified {}: {} frames, SNR {:.1f} dB", reference.output.string(), num_headers, snr_db);
+        }
+
+        return {};
+    }
+}
+
+cin::VerifyReference::VerifyReference(const std::filesystem::path& input, const std::filesystem::path& output)
+: input{input}
+, output{output}
+{}
+
+void cin::VerifyReference::start(int num_channels, int sample_rate, int encoder_delay)
+{
+    this->num_channels = num_channels;
+    this->sample_rate = sample_rate;
+    this->encoder_delay = encoder_delay;
+}
+
+void cin::VerifyReference::capture(const int16_t* samples, size_t num_frames)
+{
+    while (num_frames > 0) {
+        const size_t offset{this->num_frames % stride_frames};
+        const size_t frames{std::min(num_frames, offset < window_frames ? window_frames - offset : stride_frames - offset)};
+
+        if (offset < window_frames) {
+            windows.insert(windows.end(), samples, samples + frames * num_channels);
+        }
+
+        samples += frames * num_channels;
+        num_frames -= frames;
+        this->num_frames += frames;
+    }
+}
+
+cin::Verifier::Verifier(const std::filesystem::path& report, FsyncPolicy policy, unsigned int num_threads)
+: m_report{report}
+, m_policy{policy}
+{
+    for (unsigned int i = 0; i < std::max(num_threads, 1U); ++i) {
+        m_threads.emplace_back([this]() { run(); });
+    }
+}
+
+cin::Verifier::~Verifier()
+{
+    {
+        const std::lock_guard lock{m_mutex};
+        m_stop = true;
+    }
+
+    m_pending.notify_all();
+
+    for (std::thread& thread : m_threads) {
+        thread.join();
+    }
+}
+
+void cin::Verifier::submit(VerifyReference&& reference, std::function<void(bool)> on_verified)
+{
+    {
+        const std::lock_guard lock{m_mutex};
+        m_queue.push_back({std::move(reference), std::move(on_verified)});
+    }
+
+    m_pending.notify_one();
+}
+
+void cin::Verifier::run()
+{
+    std::unique_lock lock{m_mutex};
+
+    while (true) {
+        m_pending.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+
+        if (m_queue.empty()) {
+            return;
+        }
+
+        const Pending pending{std::move(m_queue.front())};
+        const VerifyReference& reference{pending.reference};
+        m_queue.pop_front();
+        lock.unlock();
+
+        std::string reason;
+
+        try {
+            reason = verify_file(reference);
+        }
+        catch (const std::exception& err) {
+            reason = fmt::format("could not read: {}", err.what());
+        }
+
+        const bool passed{reason.empty()};
+
+        if (!passed) {
+            cin::log::error("Verification of {} failed: {}", reference.output.string(), reason);
+        }
+
+        lock.lock();
+        m_verified++;
+
+        if (!passed) {
+            m_failures.push_back({reference.output, std::move(reason)});
+        }
+
+        lock.unlock();
+
+        // Only once the failure is listed, so a report written after the
+        // callback includes it.
+        if (pending.on_verified) {
+            pending.on_verified(passed);
+        }
+
+        lock.lock();
+    }
+}
+
+void cin::Verifier::report()
+{
+    // Encoders sharing the verifier write the same report, one at a time.
+    const std::lock_guard report_lock{m_report_mutex};
+    std::unique_lock lock{m_mutex};
+    auto report{fmt::format("# {} files verified, {} failed\n", m_verified, m_failures.size())};
+
+    for (const auto& failure : m_failures) {
+        report += fmt::format("{}\t{}\n", failure.output.string(), failure.reason);
+    }
+
+    cin::log::info("Verified {} files, {} failed, see {}", m_verified, m_failures.size(), m_report.string());
+    lock.unlock();
+
+    cin::Arena arena;
+    cin::OutputFile file{m_report, m_policy, arena};
+    file.write(reinterpret_cast<const uint8_t*>(report.data()), report.size());
+    file.commit();
+}
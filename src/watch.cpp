@@ -0,0 +1,285 @@
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include "log.h"
+#include "watch.h"
+
+namespace
+{
+    constexpr int poll_interval_ms{250};
+    constexpr uint32_t file_events{IN_CLOSE_WRITE | IN_MOVED_TO};
+    constexpr uint32_t directory_events{IN_CREATE | IN_MOVED_TO};
+
+    volatile std::sig_atomic_t g_stop{0};
+
+    void request_stop(int)
+    {
+        g_stop = 1;
+    }
+
+    // Same rule as get_valid_wav_files(), hidden files are uploads in flight.
+    bool is_candidate(const std::filesystem::path& path)
+    {
+        const auto name{path.filename().string()};
+        return !name.empty() && name.front() != '.' && path.extension() == ".wav";
+    }
+}
+
+cin::Watcher::Watcher(const Options& options)
+: m_options{options}
+, m_encoder{Paths{}, options}
+, m_pool{std::thread::hardware_concurrency()}
+{
+    m_fd = ::inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+
+    if (m_fd < 0) {
+        throw CouldNotWatch{fmt::format("Could not initialize inotify: {}", std::strerror(errno))};
+    }
+
+    add_watch(m_options.input);
+    scan(m_options.input);
+    cin::log::info("Watching {} with {} workers", m_options.input.string(), m_pool.size());
+}
+
+cin::Watcher::~Watcher()
+{
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+}
+
+void cin::Watcher::add_watch(const std::filesystem::path& directory)
+{
+    const uint32_t mask{file_events | (m_options.recursive ? directory_events : 0) | IN_ONLYDIR};
+    const int wd{::inotify_add_watch(m_fd, directory.c_str(), mask)};
+
+    if (wd < 0) {
+        throw CouldNotWatch{fmt::format("Could not watch {}: {}", directory.string(), std::strerror(errno))};
+    }
+
+    m_directories[wd] = directory;
+
+    if (!m_options.recursive) {
+        return;
+    }
+
+    std::error_code error;
+
+    for (const auto& entry : std::filesystem::directory_iterator{directory, error}) {
+        if (entry.is_directory(error) && !entry.is_symlink(error)) {
+            add_watch(entry.path());
+        }
+    }
+}
+
+void cin::Watcher::scan(const std::filesystem::path& directory)
+{
+    size_t found{0};
+
+    for (const auto& path : get_valid_wav_files(directory, m_options.recursive)) {
+        std::error_code error;
+        const auto output{std::filesystem::last_write_time(m_encoder.layout().output_path(path), error)};
+
+        if (error || output < std::filesystem::last_write_time(path, error)) {
+            note(path);
+            found++;
+        }
+    }
+
+    if (found > 0) {
+        cin::log::info("Found {} files without an up to date MP3 in {}", found, directory.string());
+    }
+}
+
+void cin::Watcher::note(const std::filesystem::path& path, clock::duration delay)
+{
+    Pending pending{clock::now() + delay, {}};
+
+    if (stamp_file(path, pending.stamp)) {
+        m_pending[path] = pending;
+    }
+}
+
+void cin::Watcher::read_events()
+{
+    alignas(inotify_event) char buffer[64 * 1024];
+
+    while (true) {
+        const ssize_t size{::read(m_fd, buffer, sizeof(buffer))};
+
+        if (size <= 0) {
+            return;
+        }
+
+        for (ssize_t offset = 0; offset < size;) {
+            const auto* event{reinterpret_cast<const inotify_event*>(buffer + offset)};
+            offset += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                cin::log::warn("Missed file events, rescanning {}", m_options.input.string());
+                scan(m_options.input);
+                continue;
+            }
+
+            if (event->mask & IN_IGNORED) {
+                m_directories.erase(event->wd);
+                continue;
+            }
+
+            const auto directory{m_directories.find(event->wd)};
+
+            if (directory == m_directories.end() || event->len == 0) {
+                continue;
+            }
+
+            const auto path{directory->second / event->name};
+
+            // Files can land in a new directory before it is watched. Without
+            // --recursive, directories moved in are ignored like others.
+            if (event->mask & IN_ISDIR) {
+                if (!m_options.recursive) {
+                    continue;
+                }
+
+                try {
+                    add_watch(path);
+                    scan(path);
+                }
+                catch (const CouldNotWatch& err) {
+                    cin::log::warn("{}", err.what());
+                }
+            }
+            else if (is_candidate(path)) {
+                note(path);
+            }
+        }
+    }
+}
+
+void cin::Watcher::submit_settled()
+{
+    Paths held;
+
+    {
+        const std::lock_guard lock{m_mutex};
+        held.swap(m_held);
+    }
+
+    for (const auto& path : held) {
+        note(path, m_encoder.retry_interval());
+    }
+
+    const auto now{clock::now()};
+    const auto settle{std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>{m_options.watch_settle})};
+
+    for (auto pending = m_pending.begin(); pending != m_pending.end();) {
+        if (now - pending->second.changed < settle) {
+            ++pending;
+            continue;
+        }
+
+        FileStamp current{};
+
+        if (!stamp_file(pending->first, current)) {
+            pending = m_pending.erase(pending);
+            continue;
+        }
+
+        // Still growing, wait for another quiet period.
+        if (!(current == pending->second.stamp)) {
+            pending->second = {now, current};
+            ++pending;
+            continue;
+        }
+
+        {
+            const std::lock_guard lock{m_mutex};
+
+            if (m_running.count(pending->first) > 0) {
+                ++pending;
+                continue;
+            }
+
+            m_running.insert(pending->first);
+        }
+
+        submit(pending->first);
+        pending = m_pending.erase(pending);
+    }
+}
+
+void cin::Watcher::submit(const std::filesystem::path& path)
+{
+    auto deadline{WorkerPool::clock::time_point::max()};
+
+    if (m_options.deadline > 0.0) {
+        deadline = WorkerPool::clock::now()
+            + std::chrono::duration_cast<WorkerPool::clock::duration>(std::chrono::duration<double>{m_options.deadline});
+    }
+
+    m_queued++;
+    m_pool.submit([this, path](Arena& arena) {
+        bool held{false};
+
+        try {
+            held = !m_encoder.encode_one(path, arena);
+        }
+        catch (const std::exception& err) {
+            cin::log::error("Error processing {}: {}", path.string(), err.what());
+        }
+
+        const std::lock_guard lock{m_mutex};
+        m_running.erase(path);
+
+        if (held) {
+            m_held.push_back(path);
+        }
+
+        m_idle.notify_all();
+    }, m_options.priority, deadline);
+}
+
+void cin::Watcher::run()
+{
+    struct sigaction action{};
+    action.sa_handler = request_stop;
+    sigemptyset(&action.sa_mask);
+    ::sigaction(SIGINT, &action, nullptr);
+    ::sigaction(SIGTERM, &action, nullptr);
+
+    while (g_stop == 0) {
+        int timeout{poll_interval_ms};
+
+        if (!m_pending.empty()) {
+            const auto settle{std::chrono::duration<double, std::milli>{m_options.watch_settle * 1000.0}};
+            const auto earliest{std::min_element(m_pending.begin(), m_pending.end(), [](const auto& a, const auto& b) {
+                return a.second.changed < b.second.changed;
+            })};
+            const std::chrono::duration<double, std::milli> remaining{earliest->second.changed + settle - clock::now()};
+            timeout = std::clamp(static_cast<int>(remaining.count()) + 1, 0, poll_interval_ms);
+        }
+
+        pollfd events{m_fd, POLLIN, 0};
+
+        if (::poll(&events, 1, timeout) > 0) {
+            read_events();
+        }
+
+        submit_settled();
+    }
+
+    cin::log::info("Stopping after {} files, waiting for running encodes", m_queued);
+
+    {
+        std::unique_lock lock{m_mutex};
+        m_idle.wait(lock, [this]() { return m_running.empty(); });
+    }
+
+    // The outputs stay next to the output archive, so the scan after a
+    // restart only picks up inputs without an up to date MP3.
+    m_encoder.finish(true);
+}
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cstring>
 #include <sndfile.h>
 #include "encoder.h"
 #include "log.h"
@@ -17,6 +19,44 @@ namespace
 
 cin::WavFile::WavFile(const std::filesystem::path& path)
 : m_sf{sf_open(path.c_str(), SFM_READ, &m_info), close_sf}
+{
+    check_format();
+}
+
+cin::WavFile::WavFile(const uint8_t* data, size_t size)
+: m_memory{std::make_unique<Memory>(Memory{data, static_cast<sf_count_t>(size), 0})}
+, m_sf{nullptr, close_sf}
+{
+    static SF_VIRTUAL_IO io{
+        [](void* user_data) {
+            return static_cast<Memory*>(user_data)->size;
+        },
+        [](sf_count_t offset, int whence, void* user_data) {
+            auto* memory{static_cast<Memory*>(user_data)};
+            const sf_count_t base{whence == SEEK_CUR ? memory->position : whence == SEEK_END ? memory->size : 0};
+            memory->position = std::clamp<sf_count_t>(base + offset, 0, memory->size);
+            return memory->position;
+        },
+        [](void* data, sf_count_t count, void* user_data) {
+            auto* memory{static_cast<Memory*>(user_data)};
+            const sf_count_t size{std::min(count, memory->size - memory->position)};
+            std::memcpy(data, memory->data + memory->position, static_cast<size_t>(size));
+            memory->position += size;
+            return size;
+        },
+        [](const void*, sf_count_t, void*) {
+            return sf_count_t{0};
+        },
+        [](void* user_data) {
+            return static_cast<Memory*>(user_data)->position;
+        },
+    };
+
+    m_sf.reset(sf_open_virtual(&io, SFM_READ, &m_info, m_memory.get()));
+    check_format();
+}
+
+void cin::WavFile::check_format() const
 {
     if (!m_sf) {
         throw cin::WavFile::CouldNotRead{sf_strerror(nullptr)};
@@ -45,9 +85,9 @@ int cin::WavFile::sample_rate() const
     return m_info.samplerate;
 }
 
-size_t cin::WavFile::read_samples(std::vector<int16_t>& samples, int num_frames) const
+size_t cin::WavFile::read_samples(Buffer<int16_t>& samples, int num_frames) const
 {
-    samples.resize(num_frames * m_info.channels * sizeof(int16_t));
+    samples.resize(static_cast<size_t>(num_frames) * m_info.channels);
     const auto read_size{static_cast<size_t>(sf_readf_short(m_sf.get(), samples.data(), num_frames)) * m_info.channels};
     samples.resize(read_size);
     return read_size;
@@ -0,0 +1,160 @@
+#include <algorithm>
+#include "log.h"
+#include "worker_pool.h"
+
+const char* cin::priority_name(Priority priority)
+{
+    switch (priority) {
+    case Priority::interactive:
+        return "interactive";
+    case Priority::bulk:
+        return "bulk";
+    default:
+        return "normal";
+    }
+}
+
+cin::WorkerPool::WorkerPool(unsigned int num_workers)
+{
+    for (unsigned int i = 0; i < std::max(num_workers, 1U); ++i) {
+        m_workers.emplace_back([this]() { work(); });
+    }
+}
+
+cin::WorkerPool::~WorkerPool()
+{
+    {
+        const std::lock_guard lock{m_mutex};
+        m_stop = true;
+    }
+
+    m_pending.notify_all();
+
+    for (std::thread& thread : m_workers) {
+        thread.join();
+    }
+
+    for (size_t i = 0; i < num_classes; ++i) {
+        const auto priority{static_cast<Priority>(i)};
+        const WaitStats stats{wait_stats(priority)};
+
+        if (stats.count > 0) {
+            cin::log::info("Queue {}: {} files, wait p50 {:.2f} ms, p99 {:.2f} ms, max {:.2f} ms, {} late",
+                priority_name(priority), stats.count, stats.p50_ms, stats.p99_ms, stats.max_ms, stats.late);
+        }
+    }
+}
+
+void cin::WorkerPool::submit(Task task, Priority priority, clock::time_point deadline)
+{
+    {
+        const std::lock_guard lock{m_mutex};
+        auto& queue{m_classes[static_cast<size_t>(priority)].queue};
+        queue.emplace(std::make_pair(deadline, m_sequence++), Entry{std::move(task), clock::now()});
+    }
+
+    m_pending.notify_one();
+}
+
+size_t cin::WorkerPool::size() const
+{
+    return m_workers.size();
+}
+
+cin::WorkerPool::WaitStats cin::WorkerPool::wait_stats(Priority priority) const
+{
+    const std::lock_guard lock{m_mutex};
+    const Class& queue_class{m_classes[static_cast<size_t>(priority)]};
+    WaitStats stats;
+    stats.count = queue_class.count;
+    stats.max_ms = queue_class.max_ms;
+    stats.late = queue_class.late;
+
+    if (queue_class.waits.empty()) {
+        return stats;
+    }
+
+    std::vector<float> waits{queue_class.waits};
+    const auto percentile = [&waits](double p) {
+        const auto nth{waits.begin() + static_cast<ptrdiff_t>(p * static_cast<double>(waits.size() - 1))};
+        std::nth_element(waits.begin(), nth, waits.end());
+        return static_cast<double>(*nth);
+    };
+
+    stats.p50_ms = percentile(0.50);
+    stats.p99_ms = percentile(0.99);
+    return stats;
+}
+
+bool cin::WorkerPool::empty() const
+{
+    return std::all_of(m_classes.begin(), m_classes.end(), [](const Class& c) { return c.queue.empty(); });
+}
+
+cin::WorkerPool::Task cin::WorkerPool::take()
+{
+    const auto now{clock::now()};
+    Class* highest{nullptr};
+    Class* overdue{nullptr};
+
+    // Overdue work of any class goes first, otherwise the highest class.
+    for (Class& candidate : m_classes) {
+        if (candidate.queue.empty()) {
+            continue;
+        }
+
+        if (highest == nullptr) {
+            highest = &candidate;
+        }
+
+        const auto deadline{candidate.queue.begin()->first.first};
+
+        if (deadline <= now && (overdue == nullptr || deadline < overdue->queue.begin()->first.first)) {
+            overdue = &candidate;
+        }
+    }
+
+    Class* chosen{overdue != nullptr ? overdue : highest};
+    const auto head{chosen->queue.begin()};
+    const double wait_ms{std::chrono::duration<double, std::milli>{now - head->second.queued}.count()};
+
+    if (chosen->waits.size() < wait_samples) {
+        chosen->waits.push_back(static_cast<float>(wait_ms));
+    }
+    else {
+        chosen->waits[chosen->next_wait] = static_cast<float>(wait_ms);
+        chosen->next_wait = (chosen->next_wait + 1) % wait_samples;
+    }
+
+    chosen->count++;
+    chosen->max_ms = std::max(chosen->max_ms, wait_ms);
+    chosen->late += head->first.first < now ? 1 : 0;
+
+    Task task{std::move(head->second.task)};
+    chosen->queue.erase(head);
+    return task;
+}
+
+void cin::WorkerPool::work()
+{
+    cin::Arena arena;
+    std::unique_lock lock{m_mutex};
+
+    while (true) {
+        m_pending.wait(lock, [this]() { return m_stop || !empty(); });
+
+        if (empty()) {
+            break;
+        }
+
+        const Task task{take()};
+        lock.unlock();
+
+        task(arena);
+
+        lock.lock();
+    }
+
+    const auto& stats{arena.stats()};
+    cin::log::debug("Worker: {} files, {} chunk allocations", stats.resets, stats.chunk_allocations);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdlib>
+#include <filesystem>
+#include <unistd.h>
+#include "log.h"
+
+/**
+ * Minimal test support: each test is an executable that reports failed
+ * checks on stderr and returns their count from main().
+ */
+namespace cin::test
+{
+    /** Number of failed checks so far. */
+    inline int failures{0};
+
+    inline void check(bool condition, const char* expression, const char* file, int line)
+    {
+        if (!condition) {
+            fmt::print(stderr, "{}:{}: check failed: {}\n", file, line, expression);
+            failures++;
+        }
+    }
+
+    /**
+     * Directory below the system temporary directory that is removed with
+     * everything in it when the object goes out of scope.
+     */
+    class TempDir {
+    public:
+        TempDir()
+        : m_path{std::filesystem::temp_directory_path() / fmt::format("encoder-test-{}-{}", getpid(), counter()++)}
+        {
+            std::filesystem::create_directories(m_path);
+        }
+
+        TempDir(const TempDir&) = delete;
+        TempDir& operator=(const TempDir&) = delete;
+
+        ~TempDir()
+        {
+            std::error_code error;
+            std::filesystem::remove_all(m_path, error);
+        }
+
+        const std::filesystem::path& path() const
+        {
+            return m_path;
+        }
+
+    private:
+        static int& counter()
+        {
+            static int value{0};
+            return value;
+        }
+
+        std::filesystem::path m_path;
+    };
+
+    /**
+     * Return the exit status of a test executable.
+     *
+     * @return EXIT_SUCCESS if no check failed.
+     */
+    inline int result()
+    {
+        if (failures > 0) {
+            fmt::print(stderr, "{} checks failed\n", failures);
+            return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+    }
+}
+
+#define CHECK(condition) cin::test::check(static_cast<bool>(condition), #condition, __FILE__, __LINE__)
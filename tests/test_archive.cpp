@@ -0,0 +1,322 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <zlib.h>
+#include "archive.h"
+#include "check.h"
+
+namespace
+{
+    void write_file(const std::filesystem::path& path, const std::string& data)
+    {
+        std::ofstream file{path, std::ios::binary | std::ios::trunc};
+        file << data;
+    }
+
+    std::string read_member(const cin::Archive& archive, const std::filesystem::path& member)
+    {
+        cin::Buffer<uint8_t> contents;
+        archive.read(member, contents);
+        return {contents.begin(), contents.end()};
+    }
+
+    // Whether opening @p path fails with CouldNotRead rather than anything else.
+    bool is_rejected(const std::filesystem::path& path)
+    {
+        try {
+            const cin::Archive archive{path};
+        }
+        catch (const cin::Archive::CouldNotRead&) {
+            return true;
+        }
+
+        return false;
+    }
+
+    std::vector<std::string> names(const cin::Archive& archive)
+    {
+        std::vector<std::string> result;
+
+        for (const auto& path : archive.paths()) {
+            result.push_back(path.filename().string());
+        }
+
+        return result;
+    }
+
+    // GNU tar header, with the size in base-256 if @p binary_size is set.
+    std::string tar_header(const std::string& name, uint64_t size, bool binary_size = false)
+    {
+        std::string header(512, '\0');
+        name.copy(header.data(), std::min<size_t>(name.size(), 100));
+        std::snprintf(header.data() + 100, 8, "%07o", 0644);
+
+        if (binary_size) {
+            header[124] = static_cast<char>(0x80);
+
+            for (size_t i = 0; i < 8; ++i) {
+                header[135 - i] = static_cast<char>((size >> (8 * i)) & 0xff);
+            }
+        }
+        else {
+            std::snprintf(header.data() + 124, 12, "%011llo", static_cast<unsigned long long>(size));
+        }
+
+        header[156] = '0';
+        std::memcpy(header.data() + 257, "ustar  ", 8);
+
+        unsigned int sum{0};
+
+        for (size_t i = 0; i < header.size(); ++i) {
+            sum += i >= 148 && i < 156 ? ' ' : static_cast<uint8_t>(header[i]);
+        }
+
+        std::snprintf(header.data() + 148, 8, "%06o", sum);
+        header[155] = ' ';
+        return header;
+    }
+
+    std::string tar_member(const std::string& name, const std::string& data)
+    {
+        return tar_header(name, data.size()) + data + std::string((512 - data.size() % 512) % 512, '\0');
+    }
+
+    void put_le(std::string& out, uint64_t value, size_t bytes)
+    {
+        for (size_t i = 0; i < bytes; ++i) {
+            out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+        }
+    }
+
+    std::string deflate_raw(const std::string& data)
+    {
+        z_stream stream{};
+        deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+        std::string out(deflateBound(&stream, data.size()), '\0');
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+        stream.avail_in = static_cast<uInt>(data.size());
+        stream.next_out = reinterpret_cast<Bytef*>(out.data());
+        stream.avail_out = static_cast<uInt>(out.size());
+        deflate(&stream, Z_FINISH);
+        out.resize(stream.total_out);
+        deflateEnd(&stream);
+        return out;
+    }
+
+    struct ZipMember {
+        std::string name;
+        std::string data;
+        bool deflated;
+        // Uncompressed size written to the directory, the real one if 0.
+        uint64_t claimed_size;
+    };
+
+    std::string zip(const std::vector<ZipMember>& members)
+    {
+        std::string file;
+        std::string directory;
+
+        for (const auto& member : members) {
+            const std::string stored{member.deflated ? deflate_raw(member.data) : member.data};
+            const uint32_t crc{static_cast<uint32_t>(crc32(0, reinterpret_cast<const Bytef*>(member.data.data()),
+                static_cast<uInt>(member.data.size())))};
+            const uint64_t size{member.claimed_size > 0 ? member.claimed_size : member.data.size()};
+            const uint64_t offset{file.size()};
+
+            put_le(file, 0x04034b50, 4);
+            put_le(file, 20, 2);
+            put_le(file, 0, 2);
+            put_le(file, member.deflated ? 8 : 0, 2);
+            put_le(file, 0, 4);
+            put_le(file, crc, 4);
+            put_le(file, stored.size(), 4);
+            put_le(file, size, 4);
+            put_le(file, member.name.size(), 2);
+            put_le(file, 0, 2);
+            file += member.name + stored;
+
+            put_le(directory, 0x02014b50, 4);
+            put_le(directory, 20, 2);
+            put_le(directory, 20, 2);
+            put_le(directory, 0, 2);
+            put_le(directory, member.deflated ? 8 : 0, 2);
+            put_le(directory, 0, 4);
+            put_le(directory, crc, 4);
+            put_le(directory, stored.size(), 4);
+            put_le(directory, size, 4);
+            put_le(directory, member.name.size(), 2);
+            put_le(directory, 0, 2);
+            put_le(directory, 0, 2);
+            put_le(directory, 0, 2);
+            put_le(directory, 0, 2);
+            put_le(directory, 0, 4);
+            put_le(directory, offset, 4);
+            directory += member.name;
+        }
+
+        const uint64_t directory_offset{file.size()};
+        file += directory;
+        put_le(file, 0x06054b50, 4);
+        put_le(file, 0, 4);
+        put_le(file, members.size(), 2);
+        put_le(file, members.size(), 2);
+        put_le(file, directory.size(), 4);
+        put_le(file, directory_offset, 4);
+        put_le(file, 0, 2);
+        return file;
+    }
+
+    // Archives written by write_tar() read back, non-WAV files are left out.
+    void test_tar_round_trip()
+    {
+        cin::test::TempDir dir;
+        const auto files{dir.path() / "files"};
+        const auto path{dir.path() / "inputs.tar"};
+        const std::string large(70000, 'x');
+        std::filesystem::create_directories(files / "sub");
+        write_file(files / "a.wav", "RIFF a");
+        write_file(files / "sub" / "b.wav", large);
+        write_file(files / "notes.txt", "not audio");
+
+        CHECK(cin::write_tar(path, files, cin::FsyncPolicy::none) == 3);
+
+        const cin::Archive archive{path};
+        CHECK((names(archive) == std::vector<std::string>{"a.wav", "b.wav"}));
+        CHECK(read_member(archive, path / "a.wav") == "RIFF a");
+        CHECK(read_member(archive, path / "sub" / "b.wav") == large);
+        CHECK(archive.size(path / "sub" / "b.wav") == large.size());
+        CHECK(archive.size(path / "missing.wav") == 0);
+    }
+
+    void test_tar_truncated()
+    {
+        cin::test::TempDir dir;
+        const auto path{dir.path() / "inputs.tar"};
+        write_file(path, tar_member("a.wav", std::string(2000, 'a')).substr(0, 1024));
+        CHECK(is_rejected(path));
+    }
+
+    // A base-256 size near 2^64 must not wrap the bounds check.
+    void test_tar_huge_size()
+    {
+        cin::test::TempDir dir;
+        const auto path{dir.path() / "inputs.tar"};
+        write_file(path, tar_header("a.wav", UINT64_MAX - 256, true) + std::string(1024, '\0'));
+        CHECK(is_rejected(path));
+    }
+
+    // Names that would be mirrored outside the output directory are skipped.
+    void test_tar_path_escape()
+    {
+        cin::test::TempDir dir;
+        const auto path{dir.path() / "inputs.tar"};
+        write_file(path, tar_member("../evil.wav", "evil") + tar_member("/abs.wav", "abs")
+            + tar_member("sub/../../up.wav", "up") + tar_member("ok.wav", "ok") + std::string(1024, '\0'));
+
+        const cin::Archive archive{path};
+        CHECK(names(archive) == std::vector<std::string>{"ok.wav"});
+        CHECK(read_member(archive, path / "ok.wav") == "ok");
+    }
+
+    void test_zip_round_trip()
+    {
+        cin::test::TempDir dir;
+        const auto path{dir.path() / "inputs.zip"};
+        std::string pattern;
+
+        for (int i = 0; i < 10000; ++i) {
+            pattern += std::to_string(i % 97);
+        }
+
+        write_file(path, zip({{"stored.wav", "RIFF stored", false, 0}, {"sub/deflated.wav", pattern, true, 0},
+            {"notes.txt", "not audio", false, 0}, {"../evil.wav", "evil", false, 0}}));
+
+        const cin::Archive archive{path};
+        CHECK((names(archive) == std::vector<std::string>{"stored.wav", "deflated.wav"}));
+        CHECK(read_member(archive, path / "stored.wav") == "RIFF stored");
+        CHECK(read_member(archive, path / "sub" / "deflated.wav") == pattern);
+    }
+
+    void test_zip_truncated()
+    {
+        cin::test::TempDir dir;
+        const auto path{dir.path() / "inputs.zip"};
+        const std::string complete{zip({{"a.wav", std::string(4000, 'a'), false, 0}})};
+
+        // Cut inside the member, then also lose the directory.
+        std::string cut{complete};
+        cut.erase(100, 2000);
+        write_file(path, cut);
+        CHECK(is_rejected(path));
+
+        write_file(path, complete.substr(0, 2000));
+        CHECK(is_rejected(path));
+    }
+
+    // A deflated member claiming more than deflate can produce would be
+    // allocated in full, a stored one must have matching sizes.
+    void test_zip_bad_sizes()
+    {
+        cin::test::TempDir dir;
+        const auto path{dir.path() / "inputs.zip"};
+
+        write_file(path, zip({{"a.wav", std::string(1000, 'a'), true, 0xfffffff0}}));
+        CHECK(is_rejected(path));
+
+        write_file(path, zip({{"a.wav", "RIFF", false, 0xfffffff0}}));
+        CHECK(is_rejected(path));
+    }
+
+    // Zip64 directory fields whose sum wraps around 2^64.
+    void test_zip64_directory_overflow()
+    {
+        cin::test::TempDir dir;
+        const auto path{dir.path() / "inputs.zip"};
+        std::string file{zip({{"a.wav", "RIFF", false, 0}})};
+        const size_t end{file.size() - 22};
+        file.resize(end);
+
+        const uint64_t record_offset{file.size()};
+        put_le(file, 0x06064b50, 4);
+        put_le(file, 44, 8);
+        put_le(file, 45, 2);
+        put_le(file, 45, 2);
+        put_le(file, 0, 4);
+        put_le(file, 0, 4);
+        put_le(file, 1, 8);
+        put_le(file, 1, 8);
+        put_le(file, UINT64_MAX - 7, 8);
+        put_le(file, 16, 8);
+
+        put_le(file, 0x07064b50, 4);
+        put_le(file, 0, 4);
+        put_le(file, record_offset, 8);
+        put_le(file, 1, 4);
+
+        put_le(file, 0x06054b50, 4);
+        put_le(file, 0, 4);
+        put_le(file, 0xffff, 2);
+        put_le(file, 0xffff, 2);
+        put_le(file, 0xffffffff, 4);
+        put_le(file, 0xffffffff, 4);
+        put_le(file, 0, 2);
+
+        write_file(path, file);
+        CHECK(is_rejected(path));
+    }
+}
+
+int main()
+{
+    test_tar_round_trip();
+    test_tar_truncated();
+    test_tar_huge_size();
+    test_tar_path_escape();
+    test_zip_round_trip();
+    test_zip_truncated();
+    test_zip_bad_sizes();
+    test_zip64_directory_overflow();
+    return cin::test::result();
+}
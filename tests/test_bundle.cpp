@@ -0,0 +1,128 @@
+#include <string>
+#include <vector>
+#include "bundle.h"
+#include "check.h"
+#include "output.h"
+
+namespace
+{
+    void append(cin::BundleWriter& writer, const std::string& name, const std::string& data, double duration)
+    {
+        writer.append(name, reinterpret_cast<const uint8_t*>(data.data()), data.size(), duration);
+    }
+
+    std::string read(const cin::BundleReader& reader, const std::string& name)
+    {
+        cin::Buffer<uint8_t> data;
+
+        if (!reader.read(name, data)) {
+            return "<missing>";
+        }
+
+        return {data.begin(), data.end()};
+    }
+
+    // Streams read back as written, the index is sorted by name and a name
+    // appended twice keeps its last stream.
+    void test_read_back()
+    {
+        cin::test::TempDir dir;
+        const auto path{dir.path() / "out.bundle"};
+
+        {
+            cin::BundleWriter writer{path, cin::FsyncPolicy::none};
+            append(writer, "b/two.mp3", "second", 2.0);
+            append(writer, "a/one.mp3", "first", 1.0);
+            append(writer, "empty.mp3", "", 0.0);
+            append(writer, "b/two.mp3", "second again", 2.5);
+            CHECK(!std::filesystem::exists(path));
+            CHECK(writer.commit() == 3);
+        }
+
+        const cin::BundleReader reader{path};
+        CHECK((reader.names() == std::vector<std::string>{"a/one.mp3", "b/two.mp3", "empty.mp3"}));
+        CHECK(read(reader, "a/one.mp3") == "first");
+        CHECK(read(reader, "b/two.mp3") == "second again");
+        CHECK(read(reader, "empty.mp3").empty());
+        CHECK(read(reader, "missing.mp3") == "<missing>");
+
+        const auto* entry{reader.find("b/two.mp3")};
+        CHECK(entry != nullptr && entry->length == 12 && entry->duration == 2.5);
+        CHECK(reader.find("missing.mp3") == nullptr);
+    }
+
+    // A second commit() leaves the published bundle alone, appending to a
+    // committed bundle fails.
+    void test_commit_twice()
+    {
+        cin::test::TempDir dir;
+        const auto path{dir.path() / "out.bundle"};
+        cin::BundleWriter writer{path, cin::FsyncPolicy::none};
+        append(writer, "one.mp3", "first", 1.0);
+        CHECK(writer.commit() == 1);
+        CHECK(writer.commit() == 1);
+
+        bool thrown{false};
+
+        try {
+            append(writer, "two.mp3", "second", 1.0);
+        }
+        catch (const cin::BundleWriter::CouldNotWrite&) {
+            thrown = true;
+        }
+
+        CHECK(thrown);
+
+        const cin::BundleReader reader{path};
+        CHECK(reader.names() == std::vector<std::string>{"one.mp3"});
+        CHECK(read(reader, "one.mp3") == "first");
+    }
+
+    // The bundle is written under OutputFile's temporary name. Without
+    // commit() that file is removed and no bundle appears.
+    void test_abandon()
+    {
+        cin::test::TempDir dir;
+
+        {
+            cin::BundleWriter writer{dir.path() / "out.bundle", cin::FsyncPolicy::none};
+            append(writer, "one.mp3", "first", 1.0);
+            CHECK(std::filesystem::exists(cin::temp_path(dir.path() / "out.bundle")));
+        }
+
+        CHECK(std::filesystem::is_empty(dir.path()));
+    }
+
+    void test_not_a_bundle()
+    {
+        cin::test::TempDir dir;
+        const auto path{dir.path() / "out.bundle"};
+        bool thrown{false};
+
+        {
+            cin::BundleWriter writer{path, cin::FsyncPolicy::none};
+            append(writer, "one.mp3", "first", 1.0);
+            writer.commit();
+        }
+
+        std::filesystem::resize_file(path, 40);
+
+        try {
+            const cin::BundleReader reader{path};
+        }
+        catch (const cin::BundleReader::CouldNotRead&) {
+            thrown = true;
+        }
+
+        CHECK(thrown);
+    }
+}
+
+int main()
+{
+    test_read_back();
+    test_commit_twice();
+    test_abandon();
+    test_not_a_bundle();
+    return cin::test::result();
+}
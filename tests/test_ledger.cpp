@@ -0,0 +1,127 @@
+#include <fstream>
+#include <string>
+#include "archive.h"
+#include "check.h"
+#include "ledger.h"
+
+namespace
+{
+    using Claim = cin::Ledger::Claim;
+
+    void write_file(const std::filesystem::path& path, const std::string& data)
+    {
+        std::ofstream file{path, std::ios::binary | std::ios::trunc};
+        file << data;
+    }
+
+    // The only claim file in @p ledger, empty if there is none.
+    std::filesystem::path find_claim(const std::filesystem::path& ledger)
+    {
+        for (const auto& entry : std::filesystem::directory_iterator{ledger}) {
+            if (entry.path().extension() == ".claim") {
+                return entry.path();
+            }
+        }
+
+        return {};
+    }
+
+    // A finished input is done for everyone until it changes.
+    void test_claim_and_complete()
+    {
+        cin::test::TempDir dir;
+        const auto input{dir.path() / "a.wav"};
+        const auto ledger{dir.path() / "ledger"};
+        write_file(input, "RIFF");
+
+        cin::Ledger first{ledger, dir.path(), 300.0};
+        cin::Ledger second{ledger, dir.path(), 300.0};
+
+        CHECK(first.claim(input) == Claim::claimed);
+        CHECK(second.claim(input) == Claim::held);
+
+        first.complete(input);
+        CHECK(find_claim(ledger).empty());
+        CHECK(second.claim(input) == Claim::done);
+        CHECK(first.claim(input) == Claim::done);
+
+        write_file(input, "RIFF changed");
+        CHECK(second.claim(input) == Claim::claimed);
+    }
+
+    // A failed input can be claimed by the next process right away.
+    void test_release()
+    {
+        cin::test::TempDir dir;
+        const auto input{dir.path() / "a.wav"};
+        const auto ledger{dir.path() / "ledger"};
+        write_file(input, "RIFF");
+
+        cin::Ledger first{ledger, dir.path(), 300.0};
+        cin::Ledger second{ledger, dir.path(), 300.0};
+
+        CHECK(first.claim(input) == Claim::claimed);
+        first.release(input);
+        CHECK(second.claim(input) == Claim::claimed);
+    }
+
+    // A claim nobody renewed for a whole lease is taken over, a recent one
+    // is not.
+    void test_take_over()
+    {
+        cin::test::TempDir dir;
+        const auto input{dir.path() / "a.wav"};
+        const auto ledger{dir.path() / "ledger"};
+        write_file(input, "RIFF");
+
+        cin::Ledger crashed{ledger, dir.path(), 300.0};
+        cin::Ledger other{ledger, dir.path(), 60.0};
+
+        CHECK(crashed.claim(input) == Claim::claimed);
+        const auto claim{find_claim(ledger)};
+        CHECK(!claim.empty());
+
+        std::filesystem::last_write_time(claim, std::filesystem::file_time_type::clock::now() - std::chrono::seconds{30});
+        CHECK(other.claim(input) == Claim::held);
+
+        std::filesystem::last_write_time(claim, std::filesystem::file_time_type::clock::now() - std::chrono::minutes{10});
+        CHECK(other.claim(input) == Claim::claimed);
+        CHECK(find_claim(ledger) == claim);
+
+        other.complete(input);
+        CHECK(crashed.claim(input) == Claim::done);
+    }
+
+    // Archive members are finished as long as their archive is unchanged.
+    void test_archive_member()
+    {
+        cin::test::TempDir dir;
+        const auto files{dir.path() / "files"};
+        const auto archive{dir.path() / "inputs.tar"};
+        const auto ledger{dir.path() / "ledger"};
+        std::filesystem::create_directories(files);
+        write_file(files / "a.wav", "RIFF");
+        cin::write_tar(archive, files, cin::FsyncPolicy::none);
+
+        const auto member{archive / "a.wav"};
+        cin::Ledger first{ledger, archive, 300.0};
+        cin::Ledger second{ledger, archive, 300.0};
+
+        CHECK(first.claim(member) == Claim::claimed);
+        first.complete(member);
+        CHECK(second.claim(member) == Claim::done);
+
+        write_file(files / "a.wav", "RIFF changed");
+        cin::write_tar(archive, files, cin::FsyncPolicy::none);
+        CHECK(second.claim(member) == Claim::claimed);
+    }
+}
+
+int main()
+{
+    test_claim_and_complete();
+    test_release();
+    test_take_over();
+    test_archive_member();
+    return cin::test::result();
+}
@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
+#include <utility>
+#include <vector>
+#include "check.h"
+#include "loudness.h"
+
+namespace
+{
+    constexpr double pi{3.14159265358979323846};
+    constexpr int rate{48000};
+
+    // Stereo sine segments as (seconds, peak level in dBFS), both channels in
+    // phase like the EBU Tech 3341 test signals.
+    std::vector<int16_t> sine(std::initializer_list<std::pair<double, double>> segments, double frequency = 1000.0,
+        double phase = 0.0)
+    {
+        std::vector<int16_t> samples;
+        size_t frame{0};
+
+        for (const auto& [seconds, level] : segments) {
+            const double amplitude{32768.0 * std::pow(10.0, level / 20.0)};
+            const size_t frames{static_cast<size_t>(std::lround(seconds * rate))};
+
+            for (size_t i = 0; i < frames; ++i, ++frame) {
+                const double value{amplitude * std::sin(2.0 * pi * frequency * frame / rate + phase)};
+                const auto sample{static_cast<int16_t>(std::lround(std::min(value, 32767.0)))};
+                samples.push_back(sample);
+                samples.push_back(sample);
+            }
+        }
+
+        return samples;
+    }
+
+    cin::LoudnessResult measure(const std::vector<int16_t>& samples)
+    {
+        cin::LoudnessMeter meter{rate, 2};
+
+        // Odd block sizes so hops straddle the calls.
+        for (size_t frame = 0; frame < samples.size() / 2;) {
+            const size_t frames{std::min<size_t>(4093, samples.size() / 2 - frame)};
+            meter.process(samples.data() + 2 * frame, frames);
+            frame += frames;
+        }
+
+        return meter.result();
+    }
+
+    bool near(double value, double expected, double tolerance)
+    {
+        return std::abs(value - expected) <= tolerance;
+    }
+
+    // Tech 3341 cases 1 and 2, the meter must read a 1 kHz sine at its level.
+    void test_sine()
+    {
+        const auto loud{measure(sine({{20.0, -23.0}}))};
+        CHECK(loud.valid());
+        CHECK(near(loud.integrated_lufs, -23.0, 0.1));
+        CHECK(near(loud.replaygain_db, 5.0, 0.1));
+        CHECK(near(loud.sample_peak_dbfs, -23.0, 0.05));
+        CHECK(near(loud.duration, 20.0, 1e-9));
+
+        const auto quiet{measure(sine({{20.0, -33.0}}))};
+        CHECK(near(quiet.integrated_lufs, -33.0, 0.1));
+    }
+
+    // Tech 3341 cases 3 to 5, quiet parts below the relative gate do not count,
+    // the absolute gate drops -72 dBFS before the relative gate is computed.
+    void test_gating()
+    {
+        const auto case3{measure(sine({{10.0, -36.0}, {60.0, -23.0}, {10.0, -36.0}}))};
+        CHECK(near(case3.integrated_lufs, -23.0, 0.1));
+
+        const auto case4{measure(sine({{10.0, -72.0}, {10.0, -36.0}, {60.0, -23.0}, {10.0, -36.0}, {10.0, -72.0}}))};
+        CHECK(near(case4.integrated_lufs, -23.0, 0.1));
+
+        const auto case5{measure(sine({{20.0, -26.0}, {20.1, -20.0}, {20.0, -26.0}}))};
+        CHECK(near(case5.integrated_lufs, -23.0, 0.1));
+    }
+
+    // Nothing above the absolute gate, or too short for a single 400 ms block,
+    // has no integrated loudness.
+    void test_invalid()
+    {
+        CHECK(!measure(std::vector<int16_t>(2 * rate * 5, 0)).valid());
+        CHECK(!measure(sine({{5.0, -75.0}})).valid());
+        CHECK(!measure(sine({{0.3, -23.0}})).valid());
+        CHECK(measure(sine({{0.4, -23.0}})).valid());
+    }
+
+    // A quarter sample rate sine 45 degrees out of phase never hits its peak
+    // on a sample, the true peak must see the 3 dB in between.
+    void test_true_peak()
+    {
+        const auto peak{measure(sine({{1.0, -6.0}}, rate / 4.0, pi / 4.0))};
+        CHECK(near(peak.sample_peak_dbfs, -9.01, 0.05));
+        CHECK(near(peak.true_peak_dbtp, -6.0, 0.5));
+        CHECK(near(peak.replaygain_peak, std::pow(10.0, peak.true_peak_dbtp / 20.0), 1e-9));
+    }
+}
+
+int main()
+{
+    test_sine();
+    test_gating();
+    test_invalid();
+    test_true_peak();
+    return cin::test::result();
+}
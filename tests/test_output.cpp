@@ -0,0 +1,190 @@
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "arena.h"
+#include "check.h"
+#include "output.h"
+
+namespace
+{
+    size_t count_part_files(const std::filesystem::path& directory)
+    {
+        size_t count{0};
+
+        for (const auto& entry : std::filesystem::directory_iterator{directory}) {
+            count += entry.path().extension() == ".part" ? 1 : 0;
+        }
+
+        return count;
+    }
+
+    std::string read_file(const std::filesystem::path& path)
+    {
+        std::ifstream file{path, std::ios::binary};
+        return {std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+    }
+
+    void write(cin::OutputFile& file, const std::string& data)
+    {
+        file.write(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+    }
+
+    // The temporary file holds the data until commit() renames it.
+    void test_commit()
+    {
+        cin::test::TempDir dir;
+        cin::Arena arena;
+        const auto path{dir.path() / "out.mp3"};
+
+        {
+            cin::OutputFile file{path, cin::FsyncPolicy::full, arena};
+            write(file, "hello ");
+            write(file, "world");
+            CHECK(count_part_files(dir.path()) == 1);
+            CHECK(!std::filesystem::exists(path));
+
+            const std::string patch{"HELLO"};
+            file.patch(0, reinterpret_cast<const uint8_t*>(patch.data()), patch.size());
+            file.commit();
+        }
+
+        CHECK(count_part_files(dir.path()) == 0);
+        CHECK(read_file(path) == "HELLO world");
+    }
+
+    // Writes larger than the buffer bypass it and stay in order.
+    void test_large_write()
+    {
+        cin::test::TempDir dir;
+        cin::Arena arena;
+        const auto path{dir.path() / "large.mp3"};
+        const std::string head(1000, 'a');
+        const std::string body(200000, 'b');
+
+        {
+            cin::OutputFile file{path, cin::FsyncPolicy::none, arena};
+            write(file, head);
+            write(file, body);
+            file.commit();
+        }
+
+        CHECK(read_file(path) == head + body);
+    }
+
+    // Without commit() neither the temporary file nor the output remain,
+    // and an existing output is left as it was.
+    void test_abandon()
+    {
+        cin::test::TempDir dir;
+        cin::Arena arena;
+        const auto path{dir.path() / "out.mp3"};
+
+        {
+            std::ofstream previous{path};
+            previous << "previous";
+        }
+
+        {
+            cin::OutputFile file{path, cin::FsyncPolicy::none, arena};
+            write(file, "partial");
+        }
+
+        CHECK(count_part_files(dir.path()) == 0);
+        CHECK(read_file(path) == "previous");
+    }
+
+    void test_missing_directory()
+    {
+        cin::test::TempDir dir;
+        cin::Arena arena;
+        bool thrown{false};
+
+        try {
+            cin::OutputFile file{dir.path() / "missing" / "out.mp3", cin::FsyncPolicy::none, arena};
+        }
+        catch (const cin::OutputFile::CouldNotWrite&) {
+            thrown = true;
+        }
+
+        CHECK(thrown);
+    }
+
+    // Pid of a process that has exited.
+    pid_t dead_pid()
+    {
+        const pid_t pid{::fork()};
+
+        if (pid == 0) {
+            ::_exit(0);
+        }
+
+        ::waitpid(pid, nullptr, 0);
+        return pid;
+    }
+
+    void touch(const std::filesystem::path& path)
+    {
+        std::ofstream file{path};
+    }
+
+    std::string host_name()
+    {
+        char host[256]{};
+        ::gethostname(host, sizeof(host) - 1);
+        return host;
+    }
+
+    // Temporary files of processes on this host that are gone are removed,
+    // those of other hosts only once they were not modified for a while.
+    void test_remove_stale_parts()
+    {
+        cin::test::TempDir dir;
+        const pid_t dead{dead_pid()};
+        const auto host{host_name()};
+        const auto nested{dir.path() / "nested"};
+        std::filesystem::create_directories(nested);
+
+        const auto stale{dir.path() / fmt::format(".a.mp3.{}.{}.part", host, dead)};
+        const auto stale_nested{nested / fmt::format(".b.mp3.{}.{}.part", host, dead)};
+        const auto live{dir.path() / fmt::format(".c.mp3.{}.{}.part", host, getpid())};
+        const auto other{dir.path() / fmt::format("d.mp3.{}.{}.part", host, dead)};
+        const auto remote{dir.path() / fmt::format(".e.mp3.{}x.{}.part", host, dead)};
+        const auto old_style{dir.path() / fmt::format(".f.mp3.{}.part", dead)};
+
+        for (const auto& path : {stale, stale_nested, live, other, remote, old_style}) {
+            touch(path);
+        }
+
+        CHECK(cin::remove_stale_parts(dir.path(), false, std::chrono::seconds{3600}) == 1);
+        CHECK(!std::filesystem::exists(stale));
+        CHECK(std::filesystem::exists(stale_nested));
+        CHECK(std::filesystem::exists(remote));
+
+        CHECK(cin::remove_stale_parts(dir.path(), true, std::chrono::seconds{3600}) == 1);
+        CHECK(!std::filesystem::exists(stale_nested));
+
+        // Files of other hosts are only removed once old enough.
+        std::filesystem::last_write_time(remote, std::filesystem::file_time_type::clock::now() - std::chrono::hours{2});
+        CHECK(cin::remove_stale_parts(dir.path(), true, std::chrono::seconds{3600}) == 1);
+        CHECK(!std::filesystem::exists(remote));
+        CHECK(std::filesystem::exists(old_style));
+
+        CHECK(cin::remove_stale_parts(dir.path(), true, std::chrono::seconds{0}) == 1);
+        CHECK(!std::filesystem::exists(old_style));
+        CHECK(std::filesystem::exists(live));
+        CHECK(std::filesystem::exists(other));
+        CHECK(cin::remove_stale_parts(dir.path() / "missing", true, std::chrono::seconds{0}) == 0);
+    }
+}
+
+int main()
+{
+    test_commit();
+    test_large_write();
+    test_abandon();
+    test_missing_directory();
+    test_remove_stale_parts();
+    return cin::test::result();
+}
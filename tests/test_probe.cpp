@@ -0,0 +1,165 @@
+#include <fstream>
+#include <string>
+#include "check.h"
+#include "probe.h"
+
+namespace
+{
+    void put_le(std::string& out, uint32_t value, size_t bytes)
+    {
+        for (size_t i = 0; i < bytes; ++i) {
+            out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+        }
+    }
+
+    // A chunk with its size field, padded to an even length as RIFF requires.
+    std::string chunk(const char* id, const std::string& payload)
+    {
+        std::string out{id};
+        put_le(out, static_cast<uint32_t>(payload.size()), 4);
+        out += payload;
+
+        if (payload.size() % 2 != 0) {
+            out.push_back('\0');
+        }
+
+        return out;
+    }
+
+    std::string format(uint16_t tag, int channels, int rate, int bits)
+    {
+        std::string out;
+        put_le(out, tag, 2);
+        put_le(out, channels, 2);
+        put_le(out, rate, 4);
+        put_le(out, rate * channels * bits / 8, 4);
+        put_le(out, channels * bits / 8, 2);
+        put_le(out, bits, 2);
+        return out;
+    }
+
+    // WAVE_FORMAT_EXTENSIBLE with @p sub_format as the first two bytes of the
+    // sub format GUID.
+    std::string extensible(uint16_t sub_format, int channels, int rate, int bits)
+    {
+        std::string out{format(0xfffe, channels, rate, bits)};
+        put_le(out, 22, 2);
+        put_le(out, bits, 2);
+        put_le(out, channels == 2 ? 3 : 4, 4);
+        put_le(out, sub_format, 2);
+        out += std::string{"\x00\x00\x00\x00\x10\x00\x80\x00\x00\xaa\x00\x38\x9b\x71", 14};
+        return out;
+    }
+
+    std::filesystem::path write(const cin::test::TempDir& dir, const char* name, const std::string& chunks,
+        const char* riff = "RIFF")
+    {
+        std::string data{riff};
+        put_le(data, static_cast<uint32_t>(4 + chunks.size()), 4);
+        data += "WAVE" + chunks;
+
+        const auto path{dir.path() / name};
+        std::ofstream file{path, std::ios::binary | std::ios::trunc};
+        file << data;
+        return path;
+    }
+
+    // The data chunk header claiming @p size, followed by @p bytes of samples.
+    std::string data_chunk(uint32_t size, size_t bytes)
+    {
+        std::string out{"data"};
+        put_le(out, size, 4);
+        out.append(bytes, '\0');
+        return out;
+    }
+
+    void test_pcm()
+    {
+        cin::test::TempDir dir;
+        cin::WavInfo info;
+
+        CHECK(cin::probe_wav(write(dir, "pcm.wav", chunk("fmt ", format(1, 2, 44100, 16)) + chunk("data", std::string(4000, '\0'))), info));
+        CHECK(info.num_channels == 2);
+        CHECK(info.sample_rate == 44100);
+        CHECK(info.bits_per_sample == 16);
+        CHECK(!info.float_samples);
+        CHECK(info.num_frames == 1000);
+    }
+
+    void test_extensible()
+    {
+        cin::test::TempDir dir;
+        cin::WavInfo info;
+
+        CHECK(cin::probe_wav(write(dir, "pcm.wav", chunk("fmt ", extensible(1, 2, 48000, 24)) + chunk("data", std::string(600, '\0'))), info));
+        CHECK(info.num_channels == 2);
+        CHECK(info.sample_rate == 48000);
+        CHECK(info.bits_per_sample == 24);
+        CHECK(!info.float_samples);
+        CHECK(info.num_frames == 100);
+
+        CHECK(cin::probe_wav(write(dir, "float.wav", chunk("fmt ", extensible(3, 1, 96000, 32)) + chunk("data", std::string(400, '\0'))), info));
+        CHECK(info.float_samples);
+        CHECK(info.num_frames == 100);
+
+        // A-law and friends are left to libsndfile.
+        CHECK(!cin::probe_wav(write(dir, "alaw.wav", chunk("fmt ", extensible(6, 1, 8000, 8)) + chunk("data", std::string(100, '\0'))), info));
+        CHECK(info.num_channels == 0);
+    }
+
+    // Odd sized chunks are followed by a pad byte that is not in their size,
+    // also when the chunk reaches beyond the first 4 KiB of the file.
+    void test_odd_chunks()
+    {
+        cin::test::TempDir dir;
+        cin::WavInfo info;
+        const std::string list{chunk("LIST", std::string(3, 'x'))};
+        const std::string junk{chunk("JUNK", std::string(5001, 'x'))};
+
+        CHECK(list.size() == 12);
+        CHECK(cin::probe_wav(write(dir, "list.wav", list + chunk("fmt ", format(1, 1, 22050, 16)) + junk + chunk("data", std::string(200, '\0'))), info));
+        CHECK(info.num_channels == 1);
+        CHECK(info.sample_rate == 22050);
+        CHECK(info.num_frames == 100);
+    }
+
+    // Streaming writers that crashed leave a data size of 0 or ~0, the data
+    // then runs to the end of the file, as it does if the size is too large.
+    void test_unfinalized()
+    {
+        cin::test::TempDir dir;
+        cin::WavInfo info;
+        const std::string fmt{chunk("fmt ", format(1, 2, 44100, 16))};
+
+        for (const uint32_t size : {0U, 0xffffffffU, 1000000U}) {
+            CHECK(cin::probe_wav(write(dir, "open.wav", fmt + data_chunk(size, 802)), info));
+            CHECK(info.num_frames == 200);
+        }
+    }
+
+    void test_rejected()
+    {
+        cin::test::TempDir dir;
+        cin::WavInfo info;
+        const std::string fmt{chunk("fmt ", format(1, 2, 44100, 16))};
+        const std::string data{chunk("data", std::string(400, '\0'))};
+
+        CHECK(!cin::probe_wav(write(dir, "rf64.wav", chunk("ds64", std::string(28, '\0')) + fmt + data, "RF64"), info));
+        CHECK(info.num_channels == 0);
+        CHECK(!cin::probe_wav(write(dir, "nofmt.wav", data + fmt), info));
+        CHECK(!cin::probe_wav(write(dir, "short.wav", chunk("fmt ", format(1, 2, 44100, 16).substr(0, 14)) + data), info));
+        CHECK(!cin::probe_wav(write(dir, "adpcm.wav", chunk("fmt ", format(2, 2, 44100, 4)) + data), info));
+        CHECK(!cin::probe_wav(write(dir, "nodata.wav", fmt), info));
+        CHECK(!cin::probe_wav(dir.path() / "missing.wav", info));
+    }
+}
+
+int main()
+{
+    test_pcm();
+    test_extensible();
+    test_odd_chunks();
+    test_unfinalized();
+    test_rejected();
+    return cin::test::result();
+}
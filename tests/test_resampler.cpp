@@ -0,0 +1,152 @@
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+#include "arena.h"
+#include "check.h"
+#include "resampler.h"
+
+namespace
+{
+    // Runs @p input through a resampler in blocks and flushes it.
+    std::vector<int16_t> resample(const std::vector<int16_t>& input, int channels, int input_rate, int output_rate,
+        cin::ResampleQuality quality)
+    {
+        constexpr size_t block_frames{4096};
+        cin::Arena arena;
+        cin::Resampler resampler{input_rate, output_rate, channels, quality, block_frames, arena};
+        cin::Buffer<int16_t> output;
+        std::vector<int16_t> result;
+        const size_t num_frames{input.size() / channels};
+
+        for (size_t frame = 0; frame < num_frames; frame += block_frames) {
+            const size_t frames{std::min(block_frames, num_frames - frame)};
+            resampler.process(input.data() + frame * channels, frames, output);
+            result.insert(result.end(), output.begin(), output.end());
+        }
+
+        resampler.flush(output);
+        result.insert(result.end(), output.begin(), output.end());
+        return result;
+    }
+
+    size_t expected_frames(size_t input_frames, int input_rate, int output_rate)
+    {
+        return static_cast<size_t>((static_cast<uint64_t>(input_frames) * output_rate + input_rate - 1) / input_rate);
+    }
+
+    // A constant signal keeps its level on every channel, away from the
+    // edges where the filter sees the zeros before and after the stream.
+    void test_dc_gain(int input_rate, int output_rate, cin::ResampleQuality quality)
+    {
+        constexpr int channels{2};
+        constexpr int16_t level{10000};
+        constexpr size_t edge{256};
+        const size_t input_frames{static_cast<size_t>(input_rate)};
+        std::vector<int16_t> input(input_frames * channels);
+
+        for (size_t frame = 0; frame < input_frames; ++frame) {
+            input[frame * channels] = level;
+            input[frame * channels + 1] = -level;
+        }
+
+        const auto output{resample(input, channels, input_rate, output_rate, quality)};
+        const size_t output_frames{output.size() / channels};
+        CHECK(output_frames == expected_frames(input_frames, input_rate, output_rate));
+
+        int worst{0};
+
+        for (size_t frame = edge; frame + edge < output_frames; ++frame) {
+            worst = std::max(worst, std::abs(output[frame * channels] - level));
+            worst = std::max(worst, std::abs(output[frame * channels + 1] + level));
+        }
+
+        CHECK(worst <= 1);
+    }
+
+    // An impulse comes out at the same time position, the filter delay is
+    // compensated.
+    void test_delay(int input_rate, int output_rate)
+    {
+        const size_t input_frames{static_cast<size_t>(input_rate / 2)};
+        const size_t position{input_frames / 2};
+        std::vector<int16_t> input(input_frames);
+        input[position] = 20000;
+
+        const auto output{resample(input, 1, input_rate, output_rate, cin::ResampleQuality::medium)};
+        CHECK(output.size() == expected_frames(input_frames, input_rate, output_rate));
+
+        size_t peak{0};
+
+        for (size_t frame = 0; frame < output.size(); ++frame) {
+            if (output[frame] > output[peak]) {
+                peak = frame;
+            }
+        }
+
+        const double expected{static_cast<double>(position) * output_rate / input_rate};
+        CHECK(std::abs(static_cast<double>(peak) - expected) <= 1.0);
+    }
+
+    // Output to input energy ratio in dB of a sine at @p frequency, away from
+    // the edges of the stream.
+    double tone_gain(double frequency, int input_rate, int output_rate, cin::ResampleQuality quality)
+    {
+        constexpr double pi{3.14159265358979323846};
+        constexpr size_t edge{256};
+        std::vector<int16_t> input(static_cast<size_t>(input_rate));
+        double input_energy{0.0};
+
+        for (size_t frame = 0; frame < input.size(); ++frame) {
+            input[frame] = static_cast<int16_t>(std::lround(20000.0 * std::sin(2.0 * pi * frequency * frame / input_rate)));
+            input_energy += 1.0 * input[frame] * input[frame];
+        }
+
+        const auto output{resample(input, 1, input_rate, output_rate, quality)};
+        double output_energy{0.0};
+
+        for (size_t frame = edge; frame + edge < output.size(); ++frame) {
+            output_energy += 1.0 * output[frame] * output[frame];
+        }
+
+        output_energy /= output.size() - 2 * edge;
+        input_energy /= input.size();
+        return output_energy > 0.0 ? 10.0 * std::log10(output_energy / input_energy) : -std::numeric_limits<double>::infinity();
+    }
+
+    // A tone above the output Nyquist frequency must not alias back into the
+    // band, 30 kHz from 96 kHz would land at 14.1 kHz at 44.1 kHz. 10 kHz
+    // passes within 0.3 dB.
+    void test_stopband(cin::ResampleQuality quality, double attenuation)
+    {
+        CHECK(tone_gain(30000.0, 96000, 44100, quality) < -attenuation);
+        CHECK(std::abs(tone_gain(10000.0, 96000, 44100, quality)) < 0.3);
+    }
+
+    void test_rates()
+    {
+        CHECK(cin::Resampler::is_mp3_rate(44100));
+        CHECK(!cin::Resampler::is_mp3_rate(96000));
+        CHECK(cin::Resampler::default_output_rate(88200) == 44100);
+        CHECK(cin::Resampler::default_output_rate(96000) == 48000);
+        CHECK(cin::Resampler::default_output_rate(32000) == 32000);
+    }
+}
+
+int main()
+{
+    for (const auto quality : {cin::ResampleQuality::fast, cin::ResampleQuality::medium, cin::ResampleQuality::best}) {
+        test_dc_gain(44100, 48000, quality);
+        test_dc_gain(96000, 48000, quality);
+        test_dc_gain(48000, 44100, quality);
+    }
+
+    test_stopband(cin::ResampleQuality::fast, 50.0);
+    test_stopband(cin::ResampleQuality::medium, 75.0);
+    test_stopband(cin::ResampleQuality::best, 90.0);
+    test_delay(44100, 48000);
+    test_delay(96000, 44100);
+    test_delay(22050, 48000);
+    test_rates();
+    return cin::test::result();
+}
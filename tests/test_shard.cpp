@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+#include "check.h"
+#include "shard.h"
+
+namespace
+{
+    void put_le(std::string& out, uint32_t value, size_t bytes)
+    {
+        for (size_t i = 0; i < bytes; ++i) {
+            out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+        }
+    }
+
+    // 16 bit stereo PCM at 44.1 kHz, the samples are a hole in a sparse file.
+    void write_wav(const std::filesystem::path& path, uint32_t frames)
+    {
+        std::string header{"RIFF"};
+        put_le(header, 36 + frames * 4, 4);
+        header += "WAVEfmt ";
+        put_le(header, 16, 4);
+        put_le(header, 1, 2);
+        put_le(header, 2, 2);
+        put_le(header, 44100, 4);
+        put_le(header, 44100 * 4, 4);
+        put_le(header, 4, 2);
+        put_le(header, 16, 2);
+        header += "data";
+        put_le(header, frames * 4, 4);
+
+        {
+            std::ofstream file{path, std::ios::binary | std::ios::trunc};
+            file << header;
+        }
+
+        std::filesystem::resize_file(path, header.size() + uint64_t{frames} * 4);
+    }
+
+    // A corpus of @p count files of different lengths, some in a subdirectory.
+    cin::Paths write_corpus(const std::filesystem::path& root, size_t count)
+    {
+        std::filesystem::create_directories(root / "sub");
+        std::minstd_rand random{7};
+        cin::Paths paths;
+
+        for (size_t i = 0; i < count; ++i) {
+            const auto path{root / (i % 3 == 0 ? "sub" : "") / fmt::format("{:02}.wav", i)};
+            write_wav(path, 1000 + random() % 200000);
+            paths.push_back(path);
+        }
+
+        return paths;
+    }
+
+    cin::Options shard_options(const std::filesystem::path& root, size_t index, size_t count)
+    {
+        cin::Options options;
+        options.input = root;
+        options.no_probe_cache = true;
+        options.shard_index = index;
+        options.shard_count = count;
+        return options;
+    }
+
+    std::vector<cin::Shard> split(const cin::Paths& paths, const std::filesystem::path& root, size_t count)
+    {
+        std::vector<cin::Shard> shards;
+
+        for (size_t i = 0; i < count; ++i) {
+            shards.push_back(cin::select_shard(paths, shard_options(root, i, count)));
+            std::sort(shards.back().paths.begin(), shards.back().paths.end());
+        }
+
+        return shards;
+    }
+
+    // Every order of the same corpus gives the same split, and each input
+    // lands in exactly one shard.
+    void test_deterministic()
+    {
+        cin::test::TempDir dir;
+        const auto paths{write_corpus(dir.path(), 40)};
+        const auto expected{split(paths, dir.path(), 4)};
+        cin::Paths all;
+
+        for (const auto& shard : expected) {
+            CHECK(!shard.paths.empty());
+            CHECK(shard.total_files == paths.size());
+            CHECK(shard.corpus_hash == expected.front().corpus_hash);
+            all.insert(all.end(), shard.paths.begin(), shard.paths.end());
+        }
+
+        std::sort(all.begin(), all.end());
+        CHECK(std::adjacent_find(all.begin(), all.end()) == all.end());
+        CHECK(all.size() == paths.size());
+
+        std::mt19937 random{42};
+        cin::Paths shuffled{paths};
+
+        for (int round = 0; round < 5; ++round) {
+            std::shuffle(shuffled.begin(), shuffled.end(), random);
+            const auto shards{split(shuffled, dir.path(), 4)};
+
+            for (size_t i = 0; i < shards.size(); ++i) {
+                CHECK(shards[i].paths == expected[i].paths);
+                CHECK(shards[i].corpus_hash == expected[i].corpus_hash);
+            }
+        }
+    }
+
+    // Shards differ in estimated work by less than twice the largest input.
+    void test_balanced()
+    {
+        cin::test::TempDir dir;
+        const auto paths{write_corpus(dir.path(), 60)};
+        const uint64_t largest{2 * 201000};
+
+        for (const size_t count : {2, 3, 7}) {
+            const auto shards{split(paths, dir.path(), count)};
+            const auto [least, most] = std::minmax_element(shards.begin(), shards.end(),
+                [](const cin::Shard& a, const cin::Shard& b) { return a.cost < b.cost; });
+
+            CHECK(most->cost - least->cost < 2 * largest);
+            CHECK(most->total_cost == least->total_cost);
+        }
+    }
+
+    void write_summary(const cin::Shard& shard, const std::filesystem::path& root, const std::filesystem::path& directory,
+        size_t index, size_t count)
+    {
+        auto options{shard_options(root, index, count)};
+        options.shard_summary = directory / fmt::format("shard-{}.summary", index);
+        options.fsync = cin::FsyncPolicy::none;
+        cin::write_shard_summary(shard, 0, 1.0, options);
+    }
+
+    // A shard that saw a file the other did not may have split differently,
+    // the merge must not report success.
+    void test_merge_different_corpus()
+    {
+        cin::test::TempDir dir;
+        const auto root{dir.path() / "corpus"};
+        const auto summaries{dir.path() / "summaries"};
+        std::filesystem::create_directories(summaries);
+        auto paths{write_corpus(root, 20)};
+
+        const auto before{split(paths, root, 2)};
+        write_summary(before[0], root, summaries, 0, 2);
+        write_summary(before[1], root, summaries, 1, 2);
+        CHECK(cin::merge_shard_summaries(summaries) == EXIT_SUCCESS);
+
+        write_wav(root / "late.wav", 500000);
+        paths.push_back(root / "late.wav");
+        const auto after{split(paths, root, 2)};
+        CHECK(after[1].corpus_hash != before[1].corpus_hash);
+
+        write_summary(after[1], root, summaries, 1, 2);
+        CHECK(cin::merge_shard_summaries(summaries) == EXIT_FAILURE);
+    }
+}
+
+int main()
+{
+    test_deterministic();
+    test_balanced();
+    test_merge_different_corpus();
+    return cin::test::result();
+}
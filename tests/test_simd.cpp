@@ -0,0 +1,190 @@
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "check.h"
+#include "simd.h"
+
+namespace
+{
+    // Lengths around every vector width, so each variant runs its tail code.
+    constexpr size_t max_length{133};
+
+    // Buffers that hit the edge cases: full scale of both signs, which the
+    // kernels must clamp or widen, all silence, and plain noise.
+    std::vector<std::vector<int16_t>> edge_buffers()
+    {
+        std::vector<std::vector<int16_t>> buffers;
+        std::minstd_rand random{11};
+
+        buffers.emplace_back(max_length, int16_t{0});
+        buffers.emplace_back(max_length, INT16_MAX);
+        buffers.emplace_back(max_length, INT16_MIN);
+
+        auto& alternating{buffers.emplace_back(max_length)};
+
+        for (size_t i = 0; i < max_length; ++i) {
+            alternating[i] = i % 2 == 0 ? INT16_MAX : INT16_MIN;
+        }
+
+        auto& noise{buffers.emplace_back(max_length)};
+
+        for (auto& sample : noise) {
+            sample = static_cast<int16_t>(static_cast<int>(random() % 65536) - 32768);
+        }
+
+        // Silence with one loud sample near the end, found only by the tail.
+        auto& spike{buffers.emplace_back(max_length, int16_t{0})};
+        spike[max_length - 2] = -20000;
+
+        return buffers;
+    }
+
+    template<typename T>
+    bool same(const std::vector<T>& a, const std::vector<T>& b)
+    {
+        return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0;
+    }
+
+    void test_downmix(const cin::Kernels& scalar, const cin::Kernels& kernels, const std::vector<int16_t>& samples)
+    {
+        for (int channels = 1; channels <= 8; ++channels) {
+            alignas(16) float left[8]{};
+            alignas(16) float right[8]{};
+
+            for (int channel = 0; channel < channels; ++channel) {
+                left[channel] = 1.0F;
+                right[channel] = channel % 2 == 0 ? 0.5F : 1.5F;
+            }
+
+            for (size_t frames = 0; frames <= samples.size() / channels; ++frames) {
+                std::vector<int16_t> expected(2 * frames);
+                std::vector<int16_t> actual(2 * frames);
+                scalar.downmix(left, right, channels, samples.data(), frames, expected.data());
+                kernels.downmix(left, right, channels, samples.data(), frames, actual.data());
+                CHECK(same(actual, expected));
+            }
+        }
+    }
+
+    void test_apply_gain(const cin::Kernels& scalar, const cin::Kernels& kernels, const std::vector<int16_t>& samples)
+    {
+        for (const float gain : {0.0F, 0.5F, 1.0F, 1.0001F, 4.0F}) {
+            for (size_t count = 0; count <= samples.size(); ++count) {
+                std::vector<int16_t> expected(samples.begin(), samples.begin() + count);
+                std::vector<int16_t> actual{expected};
+                scalar.apply_gain(expected.data(), count, gain);
+                kernels.apply_gain(actual.data(), count, gain);
+                CHECK(same(actual, expected));
+            }
+        }
+    }
+
+    void test_peaks(const cin::Kernels& scalar, const cin::Kernels& kernels, const std::vector<int16_t>& samples)
+    {
+        for (size_t offset = 0; offset < 4; ++offset) {
+            for (size_t count = 0; count + offset <= samples.size(); ++count) {
+                const int16_t* data{samples.data() + offset};
+                CHECK(kernels.sample_peak(data, count) == scalar.sample_peak(data, count));
+
+                for (const int16_t threshold : {0, 1000, 32767}) {
+                    CHECK(kernels.find_first_loud(data, count, threshold) == scalar.find_first_loud(data, count, threshold));
+                    CHECK(kernels.find_last_loud(data, count, threshold) == scalar.find_last_loud(data, count, threshold));
+                }
+            }
+        }
+
+        for (int channels = 1; channels <= 2; ++channels) {
+            for (size_t frames = 0; frames <= samples.size() / channels; ++frames) {
+                int16_t expected_mins[2]{INT16_MAX, INT16_MAX};
+                int16_t expected_maxs[2]{INT16_MIN, INT16_MIN};
+                int16_t mins[2]{INT16_MAX, INT16_MAX};
+                int16_t maxs[2]{INT16_MIN, INT16_MIN};
+                scalar.min_max(samples.data(), frames, channels, expected_mins, expected_maxs);
+                kernels.min_max(samples.data(), frames, channels, mins, maxs);
+                CHECK(std::equal(mins, mins + 2, expected_mins));
+                CHECK(std::equal(maxs, maxs + 2, expected_maxs));
+            }
+        }
+    }
+
+    void test_float(const cin::Kernels& scalar, const cin::Kernels& kernels, const std::vector<int16_t>& samples)
+    {
+        std::vector<float> floats(samples.size());
+        std::transform(samples.begin(), samples.end(), floats.begin(), [](int16_t s) { return s / 32768.0F; });
+        alignas(16) float coefficients[64];
+
+        for (size_t i = 0; i < std::size(coefficients); ++i) {
+            coefficients[i] = (i % 2 == 0 ? 1.0F : -1.0F) / (1.0F + i);
+        }
+
+        for (size_t n = 0; n <= std::size(coefficients); ++n) {
+            const float expected{scalar.dot(coefficients, floats.data(), n)};
+            const float actual{kernels.dot(coefficients, floats.data(), n)};
+            CHECK(std::memcmp(&actual, &expected, sizeof(float)) == 0);
+        }
+
+        for (size_t start = 0; start + 12 <= floats.size(); start += 7) {
+            const float expected{scalar.interpolated_peak(floats.data() + start, coefficients)};
+            const float actual{kernels.interpolated_peak(floats.data() + start, coefficients)};
+            CHECK(std::memcmp(&actual, &expected, sizeof(float)) == 0);
+        }
+    }
+
+    // The scalar kernels themselves on the edges the wider ones are held to.
+    void test_scalar()
+    {
+        const cin::Kernels& scalar{cin::kernels_for(cin::SimdLevel::scalar)};
+        std::vector<int16_t> samples{1000, -32768, 32767, 5};
+
+        CHECK(scalar.sample_peak(samples.data(), samples.size()) == 32768);
+        CHECK(scalar.find_first_loud(samples.data(), samples.size(), 32767) == 1);
+        CHECK(scalar.find_last_loud(samples.data(), samples.size(), 999) == 3);
+
+        const std::vector<int16_t> silence(100, 0);
+        CHECK(scalar.sample_peak(silence.data(), silence.size()) == 0);
+        CHECK(scalar.find_first_loud(silence.data(), silence.size(), 0) == silence.size());
+        CHECK(scalar.find_last_loud(silence.data(), silence.size(), 0) == 0);
+
+        scalar.apply_gain(samples.data(), samples.size(), 40.0F);
+        CHECK((samples == std::vector<int16_t>{32767, -32768, 32767, 200}));
+    }
+
+    void test_levels()
+    {
+        const cin::Kernels& scalar{cin::kernels_for(cin::SimdLevel::scalar)};
+        const auto best{cin::detect_simd()};
+
+        for (auto level = cin::SimdLevel::sse2; level <= best; level = static_cast<cin::SimdLevel>(static_cast<int>(level) + 1)) {
+            const cin::Kernels& kernels{cin::kernels_for(level)};
+            CHECK(kernels.level == level);
+
+            for (const auto& samples : edge_buffers()) {
+                test_downmix(scalar, kernels, samples);
+                test_apply_gain(scalar, kernels, samples);
+                test_peaks(scalar, kernels, samples);
+                test_float(scalar, kernels, samples);
+            }
+        }
+
+        if (best != cin::SimdLevel::avx512) {
+            bool thrown{false};
+
+            try {
+                cin::kernels_for(cin::SimdLevel::avx512);
+            }
+            catch (const cin::UnsupportedSimd&) {
+                thrown = true;
+            }
+
+            CHECK(thrown);
+        }
+    }
+}
+
+int main()
+{
+    test_scalar();
+    test_levels();
+    return cin::test::result();
+}
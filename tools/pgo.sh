@@ -0,0 +1,245 @@
+#!/bin/sh
+# Profile guided and link time optimized build of the encoder.
+#
+#   pgo.sh build|benchmark cmake|meson <compiler id> <source dir> <work dir>
+#
+# build      Builds a plain release encoder in <work>/baseline and an
+#            instrumented one in <work>/pgo, trains the latter on wavfiles/
+#            and synthetic long files, rebuilds <work>/pgo in place with the
+#            profile and LTO, then runs the benchmark.
+# benchmark  Encodes the training corpus with both encoders and reports the
+#            best wall time of $PGO_RUNS runs (default 3) and the speedup.
+#
+# The CMake and meson targets named pgo and pgo-benchmark call this script.
+# The profile is rebuilt in the instrumented tree because GCC matches
+# profiles to object files by path.
+
+set -eu
+
+if [ $# -ne 5 ]; then
+    echo "Usage: $0 build|benchmark cmake|meson <compiler id> <source dir> <work dir>" >&2
+    exit 1
+fi
+
+mode=$1
+system=$2
+compiler=$3
+source=$4
+work=$5
+baseline=$work/baseline
+pgo=$work/pgo
+corpus=$work/corpus
+runs=${PGO_RUNS:-3}
+
+case $compiler in
+    *[Cc]lang*) clang=1 ;;
+    *) clang=0 ;;
+esac
+
+# configure <dir> off|generate|use ON|OFF
+configure()
+{
+    mkdir -p "$1"
+
+    case $system in
+        cmake)
+            (cd "$1" && cmake -DCMAKE_BUILD_TYPE=Release -DENCODER_PGO="$2" -DENCODER_LTO="$3" "$source" >/dev/null)
+            ;;
+        meson)
+            lto=false
+            args=
+
+            if [ "$3" = ON ]; then
+                lto=true
+            fi
+
+            # Threads update the counters concurrently, CMake sets this itself.
+            if [ "$2" = generate ] && [ $clang -eq 0 ]; then
+                args=-fprofile-update=atomic
+            fi
+
+            if [ -f "$1/build.ninja" ]; then
+                meson configure "$1" -Db_pgo="$2" -Db_lto=$lto -Dcpp_args="$args" >/dev/null
+            else
+                meson setup "$1" "$source" --buildtype=release -Db_pgo="$2" -Db_lto=$lto -Dcpp_args="$args" >/dev/null
+            fi
+            ;;
+    esac
+}
+
+build()
+{
+    case $system in
+        cmake) cmake --build "$1" ;;
+        meson) ninja -C "$1" ;;
+    esac
+}
+
+# le <value> <bytes>: little endian binary
+le()
+{
+    value=$1
+    bytes=$2
+
+    while [ "$bytes" -gt 0 ]; do
+        printf "\\$(printf %o $((value & 255)))"
+        value=$((value >> 8))
+        bytes=$((bytes - 1))
+    done
+}
+
+# write_wav <path> <channels> <rate>: 24 bit PCM of $corpus/data.raw
+write_wav()
+{
+    block=$(($2 * 3))
+    total=$(wc -c < "$corpus/data.raw")
+    size=$((total - total % block))
+
+    {
+        printf RIFF
+        le $((36 + size)) 4
+        printf 'WAVEfmt '
+        le 16 4
+        le 1 2
+        le "$2" 2
+        le "$3" 4
+        le $(($3 * block)) 4
+        le $block 2
+        le 24 2
+        printf data
+        le $size 4
+        head -c $size "$corpus/data.raw"
+    } > "$1"
+}
+
+# Long inputs made of all samples of wavfiles/: as they are, declared as
+# 96 kHz to go through the resampler, and as 5.1 to go through the downmix.
+make_corpus()
+{
+    rm -rf "$corpus"
+    mkdir -p "$corpus"
+    : > "$corpus/data.raw"
+
+    for wav in "$source"/wavfiles/*.wav; do
+        # Only canonical 44 byte headers of 24 bit stereo.
+        format=$(od -An -tx1 -j20 -N20 "$wav" | tr -d ' \n')
+
+        if [ "$format" != 0100020044ac0000980904000600180064617461 ]; then
+            continue
+        fi
+
+        size=$(od -An -tu4 -j40 -N4 "$wav" | tr -d ' ')
+        tail -c +45 "$wav" | head -c "$size" >> "$corpus/data.raw"
+    done
+
+    write_wav "$corpus/long-stereo.wav" 2 44100
+    write_wav "$corpus/long-96k.wav" 2 96000
+    write_wav "$corpus/long-5.1.wav" 6 48000
+    rm "$corpus/data.raw"
+}
+
+# encode <input dir> <output dir> [options]: fails unless the encoder
+# succeeds and writes an MP3 for every input
+encode()
+{
+    input=$1
+    output=$2
+    shift 2
+    "$pgo/encoder" "$input" --output-dir "$output" "$@" || return 1
+
+    expected=$(find "$input" -maxdepth 1 -name '*.wav' ! -name '.*' | wc -l)
+    written=$(find "$output" -name '*.mp3' | wc -l)
+
+    if [ "$written" -ne "$expected" ]; then
+        echo "Only $written of $expected files encoded to $output" >&2
+        return 1
+    fi
+}
+
+# Covers the default path, streaming blocks, analysis, trimming,
+# normalization, peaks and the resampler at its best quality. Run in a
+# context where set -e does not apply, so every step checks for failure.
+train()
+{
+    out=$work/out
+    rm -rf "$out"
+    encode "$source/wavfiles" "$out/default" || return 1
+    encode "$source/wavfiles" "$out/streaming" --streaming --loudness both --peaks binary || return 1
+    encode "$corpus" "$out/normalize" --normalize -14 --trim -60 --peaks json || return 1
+    encode "$corpus" "$out/resample" --resample 48000 --resample-quality best --loudness json || return 1
+    rm -rf "$out"
+}
+
+merge_profile()
+{
+    if [ $clang -eq 1 ]; then
+        "${LLVM_PROFDATA:-llvm-profdata}" merge -output="$pgo/default.profdata" "$pgo"/profile/*.profraw
+    fi
+}
+
+# best_time <encoder>: best wall time in seconds of $runs encodes of the corpus
+best_time()
+{
+    best=
+    run=0
+
+    while [ $run -lt "$runs" ]; do
+        rm -rf "$work/out"
+        start=$(date +%s.%N)
+        "$1" "$corpus" --output-dir "$work/out" --loudness json >/dev/null 2>&1
+        end=$(date +%s.%N)
+        best=$(awk -v best="$best" -v start="$start" -v end="$end" \
+            'BEGIN { t = end - start; if (best == "" || t < best) best = t; printf "%.3f", best }')
+        run=$((run + 1))
+    done
+
+    rm -rf "$work/out"
+    echo "$best"
+}
+
+benchmark()
+{
+    if [ ! -x "$baseline/encoder" ] || [ ! -x "$pgo/encoder" ] || [ ! -d "$corpus" ]; then
+        echo "No PGO build in $work, build the pgo target first" >&2
+        exit 1
+    fi
+
+    plain=$(best_time "$baseline/encoder")
+    optimized=$(best_time "$pgo/encoder")
+    awk -v plain="$plain" -v optimized="$optimized" \
+        'BEGIN { printf "baseline %.3f s\npgo+lto %.3f s\nspeedup %.2fx\n", plain, optimized, plain / optimized }'
+}
+
+case $mode in
+    build)
+        configure "$baseline" off OFF
+        build "$baseline"
+
+        configure "$pgo" generate OFF
+        build "$pgo"
+        make_corpus
+
+        echo "Training on $source/wavfiles and $corpus"
+        find "$pgo" -name '*.gcda' -exec rm {} +
+        rm -rf "$pgo/profile"
+        export LLVM_PROFILE_FILE="$pgo/profile/%p-%m.profraw"
+        # Errors the encoder only logs, e.g. of a single file, count too.
+        if ! train > "$work/training.log" 2>&1 || grep -q ERROR "$work/training.log"; then
+            echo "Training failed, see $work/training.log" >&2
+            exit 1
+        fi
+        unset LLVM_PROFILE_FILE
+        merge_profile
+
+        configure "$pgo" use ON
+        build "$pgo"
+        benchmark
+        ;;
+    benchmark)
+        benchmark
+        ;;
+    *)
+        echo "Unknown mode $mode" >&2
+        exit 1
+        ;;
+esac